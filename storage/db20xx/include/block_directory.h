@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+
+namespace db20xx {
+
+/**
+@brief
+  Append-only directory of table blocks, indexed by block id.
+
+  Block ids are dense and increase monotonically, so blocks are kept in a
+  two-level array instead of a hash map: a fixed top level of segment
+  pointers, each segment holds SEGMENT_SIZE block pointers. Segments are
+  allocated on demand and never move, get() is two atomic loads without
+  any lock.
+
+  A block id may be handed out before its block is published by set(),
+  get() returns nullptr for such blocks.
+*/
+template <typename BlockType>
+class BlockDirectory {
+ public:
+  static const uint32_t SEGMENT_BITS = 10;
+  static const uint32_t SEGMENT_SIZE = 1 << SEGMENT_BITS;
+  static const uint32_t MAX_SEGMENT_NUM = 4096;
+  static const uint32_t MAX_BLOCK_NUM = SEGMENT_SIZE * MAX_SEGMENT_NUM;
+
+  BlockDirectory() {
+    for (auto &segment : segments_) segment.store(nullptr);
+  }
+  BlockDirectory(const BlockDirectory &) = delete;
+  BlockDirectory &operator=(const BlockDirectory &) = delete;
+  ~BlockDirectory() {
+    for (auto &segment : segments_) free(segment.load());
+  }
+
+  /**
+  @brief
+    publish block [block_id], each block id is set only once.
+  */
+  void set(uint32_t block_id, BlockType *block) {
+    assert(block_id < MAX_BLOCK_NUM);
+    std::atomic<BlockType *> *segment = get_or_alloc_segment(block_id);
+    segment[block_id & (SEGMENT_SIZE - 1)].store(block,
+                                                 std::memory_order_release);
+  }
+
+  BlockType *get(uint32_t block_id) const {
+    if (block_id >= MAX_BLOCK_NUM) return nullptr;
+    std::atomic<BlockType *> *segment =
+        segments_[block_id >> SEGMENT_BITS].load(std::memory_order_acquire);
+    if (segment == nullptr) return nullptr;
+    return segment[block_id & (SEGMENT_SIZE - 1)].load(
+        std::memory_order_acquire);
+  }
+
+  /**
+  @brief
+    hint the cpu to load the header of block [block_id], used by
+    sequential scans before they reach the block.
+  */
+  void prefetch(uint32_t block_id) const {
+    BlockType *block = get(block_id);
+    if (block != nullptr) __builtin_prefetch(block, 0, 3);
+  }
+
+ private:
+  std::atomic<BlockType *> *get_or_alloc_segment(uint32_t block_id) {
+    std::atomic<std::atomic<BlockType *> *> &slot =
+        segments_[block_id >> SEGMENT_BITS];
+    std::atomic<BlockType *> *segment = slot.load(std::memory_order_acquire);
+    if (segment != nullptr) return segment;
+
+    // concurrent writers may race for a new segment, the loser frees its own
+    std::atomic<BlockType *> *new_segment =
+        static_cast<std::atomic<BlockType *> *>(
+            calloc(SEGMENT_SIZE, sizeof(std::atomic<BlockType *>)));
+    if (slot.compare_exchange_strong(segment, new_segment,
+                                     std::memory_order_acq_rel)) {
+      return new_segment;
+    }
+    free(new_segment);
+    return segment;
+  }
+
+ private:
+  std::atomic<std::atomic<BlockType *> *> segments_[MAX_SEGMENT_NUM];
+};
+
+}  // namespace db20xx
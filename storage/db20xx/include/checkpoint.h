@@ -0,0 +1,116 @@
+#pragma once
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "epoch.h"
+#include "utils.h"
+
+namespace db20xx {
+
+class Table;
+class ThreadContext;
+
+/**
+ *@brief
+ *  layout of a checkpoint file:
+ *    [CheckpointFileHeader]
+ *    [CheckpointTableHeader | table definition | table data] ...
+ *  table data is a sequence of
+ *    [block id | idx in block | payload]
+ *  one for every version chain alive in the checkpoint.
+ */
+struct CheckpointFileHeader {
+  uint32_t magic_;
+  uint32_t table_num_;
+  // replay the redo log from here
+  uint64_t checkpoint_lsn_;
+  uint32_t next_table_id_;
+  uint32_t checksum_;  // of the fields above
+};
+
+struct CheckpointTableHeader {
+  uint32_t definition_length_;
+  uint32_t vchain_head_block_num_;
+  uint64_t entry_num_;
+  uint64_t data_length_;
+  uint32_t checksum_;  // of definition and data
+  uint32_t reserved_;
+};
+
+/**
+ *@brief
+ *  Fuzzy checkpoint, bounds the redo log that recovery has to replay.
+ *
+ *  The checkpointer remembers the current lsn, waits until every transaction
+ *  that was running at that point has finished (two epoch advances), and
+ *  then copies the latest committed version of every version chain without
+ *  stopping anybody. Transactions committing during the copy may or may not
+ *  be in the checkpoint, their log records come after checkpoint_lsn and are
+ *  replayed on top of it. Replaying an upsert or delete twice is harmless
+ *  because it carries the whole new version.
+ *
+ *  The checkpoint is written to a temporary file and renamed once the redo
+ *  log covering the copy is synced, then the log before checkpoint_lsn is
+ *  discarded.
+ *
+ *  Recovery loads the tables with one thread per table, every thread also
+ *  rebuilds the indexes of its table. The log tail is replayed afterwards.
+ */
+class Checkpointer {
+ public:
+  /**
+   *@brief start the background checkpoint thread
+   */
+  static void start(const std::string &log_dir);
+  static void stop();
+
+  /**
+   *@brief
+   *  take a checkpoint now
+   *@return false if it was not taken
+   */
+  static bool checkpoint();
+
+  /**
+   *@brief
+   *  load the checkpoint under [log_dir] if there is one, return the lsn
+   *  from which the redo log should be replayed.
+   */
+  static void load(const std::string &log_dir, uint64_t &checkpoint_lsn,
+                   ThreadContext *thd_ctx);
+
+ public:
+  static const uint32_t CHECKPOINT_MAGIC = 0x4b434244;  // "DBCK"
+  static const uint32_t CHECK_INTERVAL_MS = 10000;
+  // take a checkpoint when the log has grown this much since the last one
+  static const uint64_t CHECKPOINT_LOG_GROWTH = 256UL << 20;
+  static const uint64_t WRITE_BUFFER_SIZE = 4UL << 20;
+  static constexpr const char *CHECKPOINT_FILE_NAME = "db20xx_checkpoint";
+
+ private:
+  static void checkpoint_loop();
+  static void wait_for_running_transactions();
+  static void write_table(int fd, uint64_t &file_offset,
+                          const std::string &db_name, Table *table);
+  static bool load_table(Table *table, const CheckpointTableHeader &header,
+                         const char *definition, ThreadContext *thd_ctx);
+
+ private:
+  static std::string log_dir_;
+  // serializes checkpoints
+  static std::mutex checkpoint_lock_;
+  static std::atomic<uint64_t> last_checkpoint_lsn_;
+  // keeps copied versions from being reclaimed by garbage collector
+  static LocalEpochManager local_epoch_;
+
+  static std::thread checkpoint_thread_;
+  static std::mutex checkpoint_thread_lock_;
+  static std::condition_variable checkpoint_thread_cv_;
+  static bool checkpoint_thread_running_;
+};
+
+}  // namespace db20xx
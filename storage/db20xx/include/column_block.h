@@ -0,0 +1,193 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "./predicate.h"
+#include "./version_chain.h"
+
+namespace db20xx {
+
+class Schema;
+
+/**
+ * @brief
+ *   how the rows of a table are laid out. A COLUMNAR table also keeps its
+ *   inline fields column-major in a ColumnBlock per version chain head
+ *   block, which read-only scans read instead of the records.
+ */
+enum StorageLayout : uint8_t {
+  STORAGE_LAYOUT_ROW = 0,
+  STORAGE_LAYOUT_COLUMNAR
+};
+
+/**
+ * @brief
+ *   where the null bytes and the inline fields of a columnar table live in
+ *   its column blocks. Every column is an array of ENTRY_CAPACITY values
+ *   in the mysql storage format, the value of entry i is at i * length.
+ *   Integer, YEAR and DATE columns have a zone map.
+ */
+class ColumnLayout {
+ public:
+  struct Column {
+    uint32_t field_id_;
+    uint32_t offset_in_record_;
+    uint32_t offset_in_mysql_record_;
+    uint32_t length_;
+    uint32_t offset_in_block_;
+    // null bit, null_mask_ is 0 for a not null field
+    uint32_t null_offset_;
+    uint8_t null_mask_;
+    // index of the zone map of the column, -1 if it has none
+    int32_t zone_;
+    bool is_signed_;
+  };
+
+  void build(const Schema &schema);
+
+  uint32_t get_block_size() const { return block_size_; }
+  uint32_t get_null_byte_length() const { return null_byte_length_; }
+  uint32_t get_null_bytes_offset() const { return null_bytes_offset_; }
+  uint32_t get_zone_num() const { return zone_num_; }
+  const std::vector<Column> &get_columns() const { return columns_; }
+
+  /**
+   * @brief
+   *   column of the field at offset_in_record in the payload, -1 if the
+   *   field is not inline
+   */
+  int32_t find_column(uint32_t offset_in_record) const;
+  // column of field field_id, -1 if the field is not inline
+  int32_t get_field_column(uint32_t field_id) const {
+    return field_columns_[field_id];
+  }
+
+ private:
+  std::vector<Column> columns_;
+  std::vector<int32_t> field_columns_;
+  uint32_t null_byte_length_ = 0;
+  uint32_t null_bytes_offset_ = 0;
+  uint32_t zone_num_ = 0;
+  uint32_t block_size_ = 0;
+};
+
+/**
+ * @brief
+ *   what a scan reads from column blocks: the null bytes and the projected
+ *   columns, copied to mysql records, and the terms of a pushed predicate
+ *   bound to their columns.
+ */
+class ColumnScanPlan {
+ public:
+  struct Term {
+    Predicate::Term term_;
+    uint32_t column_;
+  };
+
+  /**
+   * @brief
+   *   false if a field of field_ids is not stored in column blocks, fields
+   *   compared by predicate are always inline.
+   */
+  bool build(const ColumnLayout &layout,
+             const std::vector<uint32_t> &field_ids,
+             const Predicate &predicate);
+
+  const std::vector<uint32_t> &get_columns() const { return columns_; }
+  const std::vector<Term> &get_terms() const { return terms_; }
+
+ private:
+  std::vector<uint32_t> columns_;
+  std::vector<Term> terms_;
+};
+
+/**
+ * @brief
+ *   PAX copy of a version chain head block of a columnar table, entry i
+ *   holds the inline fields of the latest committed version of chain i.
+ *
+ *   The MVCC state is summarized in the stamps leading the block, apart
+ *   from the columns:
+ *     [LOCKED | VALID | DELETED | begin timestamp of the version]
+ *   A stamp is 0 while no version is stored. A committing transaction
+ *   stores the latest version of each chain it modified before it leaves
+ *   its epoch, so for a read-only transaction the stored version is the
+ *   visible one as long as its begin timestamp is not newer than the
+ *   snapshot. Other entries are read from their version chains.
+ *
+ *   Stamps only grow, a writer locks the stamp, writes the values and
+ *   publishes the new stamp. Readers read the values between two loads of
+ *   the stamp and drop them if it has changed.
+ *
+ *   A zone map holds the min and max of the values ever stored in a
+ *   column, so that blocks whose values can not satisfy a predicate are
+ *   skipped. Values are mapped to unsigned order, signed ones with the
+ *   sign bit flipped.
+ */
+class ColumnBlock {
+ public:
+  static const uint32_t ENTRY_CAPACITY = VersionChainHeadBlock::ENTRY_CAPACITY;
+  static const uint64_t STAMP_LOCKED = uint64_t(1) << 63;
+  static const uint64_t STAMP_VALID = uint64_t(1) << 62;
+  static const uint64_t STAMP_DELETED = uint64_t(1) << 61;
+  static const uint64_t STAMP_TIMESTAMP_MASK = STAMP_DELETED - 1;
+
+  static ColumnBlock *create(const ColumnLayout &layout);
+
+  static uint64_t make_stamp(uint64_t begin_ts, bool deleted) {
+    return STAMP_VALID | (deleted ? STAMP_DELETED : 0) |
+           (begin_ts & STAMP_TIMESTAMP_MASK);
+  }
+
+  /**
+   * @brief
+   *   store the payload of a version with stamp to entry idx, payload is
+   *   not read for a deleted version. A newer stamp stored already wins.
+   *   If wait is false, give up rather than wait for another writer.
+   * @return
+   *   false if the version is not stored
+   */
+  bool store(const ColumnLayout &layout, uint32_t idx, const char *payload,
+             uint64_t stamp, bool wait);
+
+  uint64_t load_stamp(uint32_t idx) const {
+    return stamps()[idx].load(std::memory_order_acquire);
+  }
+
+  const char *get_column(const ColumnLayout::Column &column) const {
+    return data() + column.offset_in_block_;
+  }
+  const char *get_null_bytes(const ColumnLayout &layout) const {
+    return data() + layout.get_null_bytes_offset();
+  }
+
+  /**
+   * @brief
+   *   whether no value stored in the block satisfies the terms of plan
+   */
+  bool zone_excludes(const ColumnLayout &layout,
+                     const ColumnScanPlan &plan) const;
+
+ private:
+  struct Zone {
+    std::atomic<uint64_t> min_;
+    std::atomic<uint64_t> max_;
+  };
+
+  // the stamps lead the block, followed by the zone maps
+  std::atomic<uint64_t> *stamps() const {
+    return reinterpret_cast<std::atomic<uint64_t> *>(
+        const_cast<char *>(data_));
+  }
+  Zone *zones() const {
+    return reinterpret_cast<Zone *>(const_cast<char *>(data_) +
+                                    ENTRY_CAPACITY * sizeof(uint64_t));
+  }
+  const char *data() const { return data_; }
+  static void widen_zone(Zone &zone, uint64_t value);
+
+ private:
+  char data_[0];
+};
+
+}  // namespace db20xx
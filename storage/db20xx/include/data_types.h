@@ -33,6 +33,12 @@ const uint64_t INVALID_READ_TIMESTAMP = 0;
 const uint64_t INVALID_TIMESTAMP = 0;
 const uint64_t MIN_TIMESTAMP = 0;
 const uint64_t MAX_TIMESTAMP = std::numeric_limits<uint64_t>::max();
+// owner of the latest version of a dead version chain, no insert may reuse
+// the chain anymore because its keys are being removed from indexes
+const uint64_t DEAD_TRANSACTION_ID = std::numeric_limits<uint64_t>::max();
+// owner of a latest delta version replaced by its consolidated copy, it is
+// older than every transaction, so lockers retry on the new latest version
+const uint64_t REPLACED_TRANSACTION_ID = 1;
 
 // epoch-based transaction id
 const uint64_t INVALID_EPOCH_ID = std::numeric_limits<uint64_t>::max();
@@ -50,5 +56,12 @@ enum RecordVersionVisibility {
 constexpr uint32_t DB20XX_MAX_KEYS = 255;
 constexpr uint32_t DB20XX_MAX_KEY_PARTS = 255;
 constexpr uint32_t DB20XX_MAX_KEY_LENGTH = 255;
+// entries of a non-unique index are suffixed by the row id, see MasstreeIndex
+constexpr uint32_t DB20XX_ROW_ID_LENGTH = sizeof(uint64_t);
+// keys encoded by KeyEncodePlan, sort keys of collated strings take more
+// bytes than the strings
+constexpr uint32_t DB20XX_MAX_ENCODED_KEY_LENGTH = 4096 - DB20XX_ROW_ID_LENGTH;
+constexpr uint32_t DB20XX_MAX_INDEX_KEY_LENGTH =
+    DB20XX_MAX_ENCODED_KEY_LENGTH + DB20XX_ROW_ID_LENGTH;
 
 }
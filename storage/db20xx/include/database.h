@@ -7,7 +7,10 @@ public:
   Database(const std::string db_name):db_name_(db_name){}
 
   bool check_table_existence(const std::string &table_name);
-  Table* create_table(const std::string &table_name, Schema &schema);
+  Table *create_table(
+      const std::string &table_name, Schema &schema,
+      uint32_t records_per_block = Table::DEFAULT_RECORDS_PER_BLOCK,
+      StorageLayout storage_layout = STORAGE_LAYOUT_ROW);
   Table* get_table(const std::string table_name);
 
 private:
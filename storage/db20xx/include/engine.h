@@ -19,9 +19,14 @@ public:
   */
   // static Engine& GetInstance();
 
-  /** @brief 初始化db20xx存储引擎
+  /** @brief 初始化db20xx存储引擎, 从log_dir下的redo log恢复数据.
+             log_dir为空时不记录redo log
   */
-  static void init() {}
+  static void init(const std::string &log_dir);
+
+  /** @brief 关闭db20xx存储引擎, 停止后台线程
+  */
+  static void deinit();
 
 /*===============methods for database==================*/
   static bool check_database_existence(const std::string &db_name);
@@ -1,108 +1,139 @@
 #pragma once
 #include <sys/types.h>
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <mutex>
-#include <unordered_map>
+#include <thread>
+#include <vector>
 #include "utils.h"
 #include "data_types.h"
 
 namespace db20xx {
 
-class Epoch {
-public:
-  Epoch(uint64_t epoch_id, uint64_t transaction_count)
-    : epoch_id_(epoch_id),
-      transaction_count_(transaction_count){}
-
-public:
-  uint64_t epoch_id_;
-  uint64_t transaction_count_;
-};
-
 /**
- *@brief <NOT SURE> FIXME
- *  Several threads that have common mod belong to one LocalEpochManager;
+ *@brief
+ *  Epoch state of one transaction context.
  *
- *  LocalEpoch has a set of epochs with increasing epoch id, we also has an
- *  extra variable expoch_id_lower_bound_ to record the lowbound.
+ *  A context runs at most one transaction at a time, so the local epoch is
+ *  simply the epoch its running transaction entered, or INVALID_EPOCH_ID
+ *  when it is idle. The global epoch manager scans all local epochs to find
+ *  the minimum active epoch.
  *
- *  Each epoch has many transactions, we only record transaction numbers in
- *  each epoch.
+ *  Transaction ids are (epoch_id << 32) | txn_seq. txn_seq is taken from a
+ *  batch reserved from the global sequence, so the shared counter is only
+ *  touched once every TXN_SEQ_BATCH_SIZE transactions.
  */
 class LocalEpochManager {
-public:
-  bool enter_epoch(uint64_t epoch_id) {
-    if (epoch_id_lower_bound_ == INVALID_EPOCH_ID) {
-      // first time for this thread to enter epoch,
-      // update epoch low bound
-      // (epoch_id_lower_bound_, ...) <NOT SURE>
-      epoch_id_lower_bound_ = epoch_id - 1;
-    } else if (epoch_id_lower_bound_ > epoch_id) {
-      //FIXME: what condition will reach here
-      //see peloton
-      return false;
-    } else {
-      // epoch_id_lower_bound_ <= new_epoch_id
-      // do nothing
-    }
-
-    // at this point, epoch_id_lower_bound_ <= new_epoch_id
-    auto epoch_itr = epochs_.find(epoch_id);
-    if (epoch_itr == epochs_.end()) {
-      Epoch *new_epoch = new Epoch(epoch_id, 1);
-      epochs_[epoch_id] = new_epoch;
-    } else {
-      epoch_itr->second->transaction_count_++;
-    }
-    return true;
+  friend class GlocalEpochManager;
+
+ public:
+  uint64_t get_current_epoch_id() const {
+    return current_epoch_id_.load();
   }
 
-private:
-  uint64_t epoch_id_lower_bound_ = INVALID_EPOCH_ID;
-  std::unordered_map<uint64_t, Epoch*> epochs_;
-  //TODO epoch queue
+ private:
+  // epoch of the running transaction, INVALID_EPOCH_ID when idle
+  std::atomic<uint64_t> current_epoch_id_{INVALID_EPOCH_ID};
+  // the running transaction reads a snapshot, set before the epoch is
+  // published
+  std::atomic<bool> snapshot_{false};
+
+  // reserved txn_seq range [next_txn_seq_, txn_seq_end_)
+  uint64_t next_txn_seq_ = 0;
+  uint64_t txn_seq_end_ = 0;
 };
 
 class GlocalEpochManager {
 public:
+  /**
+   *@brief start/stop the background epoch advancer
+   */
+  static void start();
+  static void stop();
+
+  static void register_local_epoch(LocalEpochManager *local_epoch);
+  static void unregister_local_epoch(LocalEpochManager *local_epoch);
+
   /**
    * @brief
    *   Change the state of local epoch,
    *   and return a transaction id in current global epoch
    */
-  static uint64_t enter_epoch(uint64_t thread_id) {
-    /*
-    while (true) {
-      uint64_t cur_global_epoch_id = get_current_global_epoch_id();
-      bool ret = local_epochs_[thread_id]->enter_epoch(cur_global_epoch_id);
-      if (ret) {
-        uint32_t next_txn_id = get_next_global_transaction_id();
-        return (cur_global_epoch_id << 32) | next_txn_id;
-      }
-    }
-    */
-    // FIXME: do not use epoch for now
-    (void) thread_id;
-    return current_global_epoch_id_.fetch_add(1, std::memory_order_relaxed);
-  }
+  static uint64_t enter_epoch(LocalEpochManager *local_epoch);
+
+  /**
+   * @brief
+   *   Enter the minimum epoch of running read-write transactions instead
+   *   of the current one, for a read-only transaction reading as of the
+   *   snapshot (epoch << 32). Other snapshot readers are not counted, or
+   *   overlapping readers would keep every new snapshot at the oldest one.
+   *   The minimum active epoch can not move past the epoch entered until
+   *   exit_epoch, so nothing visible in the snapshot is reclaimed.
+   *
+   *   Return INVALID_EPOCH_ID without entering if a long running
+   *   transaction holds the snapshot more than MAX_SNAPSHOT_LAG_EPOCHS
+   *   behind the global epoch, the caller runs a regular transaction.
+   */
+  static uint64_t enter_snapshot_epoch(LocalEpochManager *local_epoch);
+
+  /**
+   * @brief
+   *   called when the transaction of local epoch commits or aborts
+   */
+  static void exit_epoch(LocalEpochManager *local_epoch);
 
   static uint64_t get_current_global_epoch_id() {
     return current_global_epoch_id_.load();
   }
 
-  static uint32_t get_next_global_transaction_id() {
-    return next_global_txn_id_.fetch_add(1, std::memory_order_relaxed);
+  /**
+   * @brief
+   *   No running transaction belongs to an epoch smaller than the returned
+   *   value, and no new transaction will enter such an epoch. Hence every
+   *   transaction id smaller than (min_active_epoch_id << 32) is finished.
+   *
+   *   The value is refreshed by the epoch advancer, it only grows.
+   */
+  static uint64_t get_min_active_epoch_id() {
+    return min_active_epoch_id_.load();
   }
 
+  /**
+   * @brief
+   *   reserve [batch_size] transaction sequence numbers, return the first
+   */
+  static uint64_t get_next_global_transaction_id(uint32_t batch_size) {
+    return next_global_txn_id_.fetch_add(batch_size,
+                                         std::memory_order_relaxed);
+  }
+
+public:
+  static const uint32_t EPOCH_LENGTH_MS = 40;
+  static const uint32_t TXN_SEQ_BATCH_SIZE = 64;
+  static const uint32_t MAX_SNAPSHOT_LAG_EPOCHS = 2;
+
+private:
+  static uint64_t compute_min_active_epoch_id(bool include_snapshots);
+  static void advance_epoch_loop();
+
 private:
   //only least significant 32 bits is used,
   //because we will do left shift(<< 32) to current_global_epoch_id_
   static std::atomic<uint64_t> current_global_epoch_id_;
+  static std::atomic<uint64_t> min_active_epoch_id_;
   static std::mutex local_epochs_lock_;
-  static std::unordered_map<int, LocalEpochManager*> local_epochs_;
+  static std::vector<LocalEpochManager *> local_epochs_;
+
+  // only least significant 32 bits are used in a transaction id, the
+  // counter wraps after 2^32 transactions, which can not happen within a
+  // single epoch
+  static std::atomic<uint64_t> next_global_txn_id_;
 
-  static std::atomic<uint32_t> next_global_txn_id_;
+  static std::thread advancer_thread_;
+  static std::mutex advancer_lock_;
+  static std::condition_variable advancer_cv_;
+  static bool advancer_running_;
 };
 
 }
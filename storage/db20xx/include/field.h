@@ -2,6 +2,7 @@
 #include <cstdint>
 #include "./data_types.h"
 #include "./utils.h"
+#include "./varlen_arena.h"
 
 namespace db20xx {
 
@@ -39,6 +40,34 @@ class Field {
 
   TYPE_ID get_field_type() const { return field_type_id_; }
 
+  const std::string &get_field_name() const { return field_name_; }
+
+  uint32_t get_mysql_pack_length() const { return mysql_pack_length_; }
+
+  uint32_t get_offset_in_mysql_record() const { return off_in_mysql_record_; }
+
+  /**
+  @brief
+    attributes of the column needed to order its values in index keys,
+    see KeyEncodePlan
+  */
+  void set_unsigned(bool is_unsigned) { is_unsigned_ = is_unsigned; }
+  bool is_unsigned() const { return is_unsigned_; }
+
+  // null bit of a nullable field, the null bytes lead both the db20xx
+  // record and the mysql record
+  void set_null_bit(uint32_t null_offset, uint8_t null_mask) {
+    null_offset_ = null_offset;
+    null_mask_ = null_mask;
+  }
+  bool is_nullable() const { return null_mask_ != 0; }
+  uint32_t get_null_offset() const { return null_offset_; }
+  uint8_t get_null_mask() const { return null_mask_; }
+
+  // collation of a string field, 0 if its bytes are compared
+  void set_collation_id(uint32_t collation_id) { collation_id_ = collation_id; }
+  uint32_t get_collation_id() const { return collation_id_; }
+
   /**
   @brief
     given a record, make @data[out param] point to field data,
@@ -64,7 +93,7 @@ class Field {
       } else {
         // TODO:panic
       }
-      data = *reinterpret_cast<char **>(const_cast<char *>(fixed_size_meta));
+      data = VarlenArena::get_data(fixed_size_meta, len);
     }
   }
 
@@ -101,5 +130,10 @@ class Field {
   uint32_t mysql_pack_length_ =
       0;  // total bytes occupied by a field in mysql internal format
   uint32_t off_in_mysql_record_ = 0;
+
+  bool is_unsigned_ = false;
+  uint32_t null_offset_ = 0;
+  uint8_t null_mask_ = 0;
+  uint32_t collation_id_ = 0;
 };
 }  // namespace db20xx
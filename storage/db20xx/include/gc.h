@@ -0,0 +1,106 @@
+#pragma once
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "data_types.h"
+#include "utils.h"
+
+namespace db20xx {
+
+class Record;
+class Table;
+class ThreadContext;
+class TransactionContext;
+
+/**
+ *@brief
+ *  A record version that has been cut off from the visible part of its
+ *  version chain by a committed or aborted transaction.
+ *
+ *  The version can be unlinked and its slot reused once every transaction
+ *  that might still read it has finished, i.e. once retire_ts_ is smaller
+ *  than the oldest active transaction id.
+ */
+struct RetiredRecord {
+  Table *table_;
+  Record *record_;
+  uint64_t retire_ts_;
+};
+
+/**
+ *@brief
+ *  Background MVCC garbage collector.
+ *
+ *  Every TransactionContext keeps a private list of retired versions which
+ *  is filled at commit/abort time without any shared lock. The gc thread
+ *  periodically drains those lists and hands every version retired before
+ *  the watermark back to its table. The watermark is derived from the
+ *  minimum active epoch (see GlocalEpochManager).
+ */
+class GarbageCollector {
+ public:
+  static void start();
+  static void stop();
+
+  /**
+   *@brief
+   *  register/unregister a transaction context so that its retired
+   *  versions get collected.
+   */
+  static void register_transaction(TransactionContext *txn_ctx);
+  static void unregister_transaction(TransactionContext *txn_ctx);
+
+  /**
+   *@brief
+   *  Transaction ids smaller than the returned value are not used by any
+   *  running transaction, and will never be handed out again.
+   *  The value lags behind for up to two epochs.
+   */
+  static uint64_t get_oldest_active_transaction_id();
+
+  /**
+   *@brief
+   *  retire a version outside of any transaction, it may be read by every
+   *  transaction running now.
+   */
+  static void retire_record(Table *table, Record *record);
+
+  /**
+   *@brief
+   *  run a single collection pass, called by the gc thread.
+   *  thd_ctx is used to remove index keys of reclaimed versions, it must be
+   *  inside an index epoch.
+   */
+  static void collect(ThreadContext *thd_ctx);
+
+ public:
+  static const uint32_t GC_INTERVAL_MS = 50;
+  // thread id of the gc thread context, mysql thread ids start from 1
+  static const uint64_t GC_THREAD_ID = 0;
+
+ private:
+  static uint64_t compute_watermark();
+  static void gc_loop();
+
+ private:
+  static std::mutex txn_ctxs_lock_;
+  static std::vector<TransactionContext *> txn_ctxs_;
+
+  // versions drained from transaction contexts but not reclaimable yet,
+  // only touched by the gc thread
+  static std::vector<RetiredRecord> pending_records_;
+  // versions left behind by unregistered transaction contexts,
+  // protected by txn_ctxs_lock_
+  static std::vector<RetiredRecord> orphan_records_;
+
+  static std::thread gc_thread_;
+  static std::mutex gc_thread_lock_;
+  static std::condition_variable gc_thread_cv_;
+  static bool gc_thread_running_;
+};
+
+}  // namespace db20xx
@@ -40,6 +40,8 @@
 
 #pragma once
 #include <sys/types.h>
+#include <atomic>
+#include <vector>
 
 #include "my_base.h" /* ha_rows */
 #include "my_compiler.h"
@@ -49,7 +51,9 @@
 #include "sql/table.h"
 #include "thr_lock.h" /* THR_LOCK, THR_LOCK_DATA */
 
+#include "column_block.h"
 #include "engine.h"
+#include "predicate.h"
 #include "record.h"
 
 /** @brief
@@ -85,19 +89,110 @@ class ha_db20xx : public handler {
     for transaction
   */
   bool read_own_statement_;
+  // the table is locked for writing by the statement
+  bool write_locked_ = false;
 
   /*
     used by index_read() and index_next()
     用于记录scan的方向
   */
-  enum ha_rkey_function scan_direction_;
+  enum IndexScanState {
+    INDEX_SCAN_NONE,      // point read, nothing to scan
+    INDEX_SCAN_FORWARD,
+    INDEX_SCAN_PREFIX,    // forward, within keys prefixed by index_key_
+    INDEX_SCAN_BACKWARD
+  };
+  IndexScanState index_scan_state_ = INDEX_SCAN_NONE;
+
+  /**
+    HA_EXTRA_KEYREAD, only key columns are required
+  */
+  bool keyread_ = false;
 
   /**
    *  used in index_next() if exists multiple exact/prefix key
    */
   db20xx::Key index_key_;
+  // INDEX_SCAN_PREFIX reads rows carrying exactly index_key_
+  bool prefix_scan_full_key_ = false;
+
+  /**
+    HA_EXTRA_IGNORE_DUP_KEY and the like, a duplicate key is resolved by
+    reading the row carrying it, entries can not be deferred
+  */
+  bool handle_dup_key_ = false;
+  // Table::start_bulk_insert() was called by start_bulk_insert()
+  bool bulk_insert_ = false;
 
   db20xx::Record *current_record_;
+  // chain of the current row read from column blocks, current_record_ is
+  // nullptr for such rows
+  db20xx::VersionChainHead *current_vchain_head_ = nullptr;
+
+  /**
+    native multi-range read, see multi_range_read_init(). Ranges are taken
+    from the range sequence MRR_BATCH_RANGES at a time, the full keys of a
+    unique index among them are looked up together by
+    db20xx::Table::multi_get_records_from_index() in key order, the other
+    ranges are scanned one by one like the default implementation does.
+  */
+  struct MrrRange {
+    KEY_MULTI_RANGE range_;
+    // the range is a full key of a unique index, looked up by key_
+    bool point_;
+    db20xx::Key key_;
+    int found_;
+    db20xx::Record *record_;
+  };
+  bool mrr_native_ = false;
+  // the sequence has no more ranges
+  bool mrr_seq_end_ = false;
+  // a scan of mrr_ranges_[mrr_pos_] is open
+  bool mrr_range_scan_ = false;
+  std::vector<MrrRange> mrr_ranges_;
+  size_t mrr_pos_ = 0;
+  // range tuples are copied, the sequence may reuse its key buffer
+  std::vector<uchar> mrr_tuples_;
+  std::vector<char> mrr_key_data_;
+
+  /**
+    rows prefetched to the Record_buffer of the server, buffered_records_
+    holds the db20xx record of each buffered row.
+    一次读取一批可见行, 减少逐行调用的开销
+  */
+  std::vector<db20xx::Record *> buffered_records_;
+  // chain of each buffered row of a column scan, empty otherwise
+  std::vector<db20xx::VersionChainHead *> buffered_vchain_heads_;
+  ha_rows buffered_pos_ = 0;
+  // the scan has reached its end while filling the buffer
+  bool buffer_end_ = false;
+
+  /**
+    conditions pushed down by cond_push() and idx_cond_push(), checked on
+    db20xx records before rows are copied to the server. The index
+    condition only applies to scans of pushed_idx_cond_keyno.
+  */
+  db20xx::Predicate pushed_predicate_;
+  db20xx::Predicate pushed_idx_predicate_;
+
+  /**
+    rows are copied to the server by row_projection_ if project_rows_,
+    it is built from projection_read_set_, a copy of table->read_set.
+  */
+  MY_BITMAP projection_read_set_{};
+  bool projection_built_ = false;
+  bool project_rows_ = false;
+  db20xx::RowCopyPlan row_projection_;
+
+  /**
+    a buffered table scan of a read-only transaction on a columnar table
+    reads the column blocks if the projected columns and the pushed
+    condition only involve fixed-size columns, see
+    db20xx::Table::column_scan_get_batch(). Rows are built in column_rows_.
+  */
+  bool column_scan_ = false;
+  db20xx::ColumnScanPlan column_scan_plan_;
+  std::vector<char> column_rows_;
 
  public:
   ha_db20xx(handlerton *hton, TABLE_SHARE *table_arg);
@@ -115,10 +210,10 @@ class ha_db20xx : public handler {
     @sa handler::adjust_index_algorithm().
   */
   enum ha_key_alg get_default_index_algorithm() const override {
-    return HA_KEY_ALG_HASH;
+    return HA_KEY_ALG_BTREE;
   }
   bool is_index_algorithm_supported(enum ha_key_alg key_alg) const override {
-    return key_alg == HA_KEY_ALG_HASH;
+    return key_alg == HA_KEY_ALG_BTREE;
   }
 
   /** @brief
@@ -131,7 +226,7 @@ class ha_db20xx : public handler {
       an engine that can only handle statement-based logging. This is
       used in testing.
     */
-    return HA_BINLOG_STMT_CAPABLE;
+    return HA_BINLOG_STMT_CAPABLE | HA_COUNT_ROWS_INSTANT;
   }
 
   /** @brief
@@ -144,10 +239,7 @@ class ha_db20xx : public handler {
     If all_parts is set, MySQL wants to know the flags for the combined
     index, up to and including 'part'.
   */
-  ulong index_flags(uint inx [[maybe_unused]], uint part [[maybe_unused]],
-                    bool all_parts [[maybe_unused]]) const override {
-    return 0;
-  }
+  ulong index_flags(uint inx, uint part, bool all_parts) const override;
 
   /** @brief
     unireg.cc will call max_supported_record_length(), max_supported_keys(),
@@ -199,6 +291,12 @@ class ha_db20xx : public handler {
     return reinterpret_cast<uint>(db20xx::DB20XX_MAX_KEY_LENGTH);
   }
 
+  /** @brief
+    Scans fill the record buffer with many rows at a time, except in
+    statements which modify the rows they read.
+  */
+  bool is_record_buffer_wanted(ha_rows *const max_rows) const override;
+
   /** @brief
     Called in test_quick_select to determine if indexes should be used.
   */
@@ -248,6 +346,13 @@ class ha_db20xx : public handler {
   */
   int delete_row(const uchar *buf) override;
 
+  /** @brief
+    Entries of non-unique indexes are deferred and put in key order by
+    end_bulk_insert(), see db20xx::Table::start_bulk_insert().
+  */
+  void start_bulk_insert(ha_rows rows) override;
+  int end_bulk_insert() override;
+
   /**
      @brief
      Positions an index cursor to the index specified in the handle
@@ -255,8 +360,26 @@ class ha_db20xx : public handler {
      begin at the first key of the index.
      @returns 0 if success (found a record); non-zero if no record.
   */
+  int index_init(uint idx, bool sorted) override;
   int index_read_map(uchar *buf, const uchar *key, key_part_map keypart_map,
                      enum ha_rkey_function find_flag) override;
+
+  /** @brief
+    Multi-range read. Unsorted reads of an index are done natively, which
+    makes Batched Key Access usable, see ha_db20xx::MrrRange. Sorted reads
+    are left to the default implementation.
+  */
+  ha_rows multi_range_read_info_const(uint keyno, RANGE_SEQ_IF *seq,
+                                      void *seq_init_param, uint n_ranges,
+                                      uint *bufsz, uint *flags,
+                                      Cost_estimate *cost) override;
+  ha_rows multi_range_read_info(uint keyno, uint n_ranges, uint keys,
+                                uint *bufsz, uint *flags,
+                                Cost_estimate *cost) override;
+  int multi_range_read_init(RANGE_SEQ_IF *seq, void *seq_init_param,
+                            uint n_ranges, uint mode,
+                            HANDLER_BUFFER *buf) override;
+  int multi_range_read_next(char **range_info) override;
   /** @brief
     We implement this in ha_db20xx.cc. It's not an obligatory method;
     skip it and and MySQL will treat it as not implemented.
@@ -295,11 +418,21 @@ class ha_db20xx : public handler {
   int rnd_pos(uchar *buf, uchar *pos) override;  ///< required
   void position(const uchar *record) override;   ///< required
   int info(uint) override;                       ///< required
+  int records(ha_rows *num_rows) override;
   int extra(enum ha_extra_function operation) override;
+  int reset() override;
+  const Item *cond_push(const Item *cond) override;
+  Item *idx_cond_push(uint keyno, Item *idx_cond) override;
+  void cancel_pushed_idx_cond() override;
   int external_lock(THD *thd, int lock_type) override;  ///< required
   int delete_all_rows(void) override;
   ha_rows records_in_range(uint inx, key_range *min_key,
                            key_range *max_key) override;
+  int parallel_scan_init(void *&scan_ctx, size_t *num_threads,
+                         bool use_reserved_threads) override;
+  int parallel_scan(void *scan_ctx, void **thread_ctxs, Load_init_cbk init_fn,
+                    Load_cbk load_fn, Load_end_cbk end_fn) override;
+  void parallel_scan_end(void *scan_ctx) override;
   int delete_table(const char *from, const dd::Table *table_def) override;
   int rename_table(const char *from, const char *to,
                    const dd::Table *from_table_def,
@@ -312,7 +445,65 @@ class ha_db20xx : public handler {
       enum thr_lock_type lock_type) override;  ///< required
                                                ///
  private:
-  void build_key_from_mysql_key(const uchar *mysql_key, key_part_map keypart_map,
+  /**
+    scan context shared by the workers of a parallel scan
+  */
+  struct ParallelScanContext {
+    ParallelScanContext(uint32_t block_num, size_t thread_num,
+                        uint64_t snapshot_transaction_id, bool read_only,
+                        uint64_t thread_id)
+        : table_scan_(block_num),
+          thread_num_(thread_num),
+          snapshot_transaction_id_(snapshot_transaction_id),
+          read_only_(read_only),
+          thread_id_(thread_id) {}
+
+    db20xx::ParallelTableScan table_scan_;
+    size_t thread_num_;
+    uint64_t snapshot_transaction_id_;
+    bool read_only_;
+    uint64_t thread_id_;
+    ulong row_len_ = 0;
+    std::vector<ulong> col_offsets_;
+    std::vector<ulong> null_byte_offsets_;
+    std::vector<ulong> null_bitmasks_;
+  };
+  // rows handed to load_fn at a time are limited to this size
+  static const ulong PARALLEL_SCAN_BUFFER_SIZE = 1024 * 1024;
+  // a bulk insert of fewer rows is done row by row, 0 rows means unknown
+  static const ha_rows BULK_INSERT_MIN_ROWS = 64;
+  // ranges a native multi-range read takes from the sequence at a time
+  static const size_t MRR_BATCH_RANGES = 128;
+
+  void begin_transaction_if_needed(THD *thd);
+  int parallel_scan_worker(ParallelScanContext *ctx, void *thread_ctx,
+                           Load_init_cbk &init_fn, Load_cbk &load_fn,
+                           Load_end_cbk &end_fn, std::atomic<int> &error);
+  void build_key_from_mysql_key(uint index, const uchar *mysql_key,
+                                key_part_map keypart_map,
                                 db20xx::Key &db20xx_key,
                                 bool &full_key_search);
+  db20xx::Key build_prefix_upper_bound(const db20xx::Key &db20xx_key);
+  int turn_index_scan(bool forward, db20xx::Record *&record);
+  int finish_index_read(int found, db20xx::Record *record, uchar *mysql_record,
+                        int not_found_error, db20xx::ThreadContext *thd_ctx);
+  void update_row_projection();
+  void load_row(db20xx::Record *record, uchar *mysql_record);
+  void load_index_row(db20xx::Record *record, uchar *mysql_record);
+  bool pushed_cond_rejects(db20xx::Record *record,
+                           db20xx::ThreadContext *thd_ctx) const;
+  int advance_index_scan(db20xx::Record *&record,
+                         db20xx::ThreadContext *thd_ctx);
+  int skip_rejected_index_rows(int found, db20xx::Record *&record,
+                               uchar *mysql_record,
+                               db20xx::ThreadContext *thd_ctx);
+  bool exceeds_end_range(const uchar *mysql_record) const;
+  void reset_record_buffer();
+  int read_buffered_row(uchar *mysql_record, Record_buffer *buffer);
+  int fill_rnd_record_buffer(uchar *mysql_record, Record_buffer *buffer);
+  void update_column_scan();
+  int fill_column_record_buffer(Record_buffer *buffer);
+  int fill_index_record_buffer(uchar *mysql_record, Record_buffer *buffer);
+  bool use_native_mrr(uint keyno, uint flags) const;
+  bool fill_mrr_batch();
 };
@@ -3,6 +3,7 @@
 #include "utils.h"
 #include "schema.h"
 #include "engine.h"
+#include "predicate.h"
 
 
 // header files exported by SL and used in ha_db20xx.cc
@@ -21,5 +22,20 @@
 @param schema SE层table的schema(colunme type等信息)
 */
 void generate_db20xx_schema(TABLE *form, db20xx::Schema &schema);
+
+/**
+@brief compile the conjuncts of a pushed condition that compare an inline
+       field of table with a constant into predicate
+@param cond a condition pushed by the server
+@return true if every conjunct of cond is compiled
+*/
+bool compile_pushed_condition(const Item *cond, TABLE *table,
+                              const db20xx::Schema &schema,
+                              db20xx::Predicate &predicate);
+/**
+@brief let db20xx encode strings of index keys under their collations,
+       called before any index is built
+*/
+void set_collation_hooks();
 db20xx::threadinfo_type *get_threadinfo();
 db20xx::ThreadContext *get_thread_ctx();
@@ -1,9 +1,12 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include "masstree-beta/kvthread.hh"
 #include "masstree-beta/masstree.hh"
 #include "masstree-beta/masstree_scan.hh"
 #include "masstree-beta/masstree_tcursor.hh"
+#include "key_encode_plan.h"
 #include "record.h"
 #include "transaction.h"
 #include "utils.h"
@@ -18,13 +21,24 @@ struct KeyInfo {
   /**
     mysql keypart counted from 1,
     db20xx keypart counted from 0;
+    length is the bytes of the key part in mysql, 0 for the whole column
   */
-  void add_key_part(uint32_t key_part) { key_parts.push_back(key_part - 1); }
+  void add_key_part(uint32_t key_part, uint32_t length = 0) {
+    key_parts.push_back(key_part - 1);
+    key_part_lengths.push_back(length);
+  }
   uint32_t get_key_length() { return key_len; }
 
   Schema schema;
   std::vector<int> key_parts;
+  std::vector<uint32_t> key_part_lengths;
   uint32_t key_len = 0; //key length capacity
+  // false if rows may share a key, see MasstreeIndex for how they are kept
+  bool unique = true;
+  // a UNIQUE key with a nullable part: rows with a NULL part may share the
+  // key, so the index is not unique, the other rows are checked by Table on
+  // insert and update
+  bool nullable_unique = false;
 };
 
 class Index {
@@ -32,7 +46,10 @@ class Index {
 
  public:
   Index(void) {}
-  Index(const KeyInfo &keyinfo) : keyinfo_(keyinfo) {}
+  Index(const KeyInfo &keyinfo) : keyinfo_(keyinfo) {
+    key_plan_.build(keyinfo_.schema, keyinfo_.key_parts,
+                    keyinfo_.key_part_lengths);
+  }
   ~Index() {}
 
   virtual bool get(const Key &key, VersionChainHead *&vchain_head,
@@ -41,6 +58,9 @@ class Index {
   virtual bool put(const Key &key, VersionChainHead *vchain_head,
                    threadinfo &ti) = 0;
 
+  virtual bool remove(const Key &key, VersionChainHead *vchain_head,
+                      threadinfo &ti) = 0;
+
   /**
   @brief
     build key from a db20xx record
@@ -49,47 +69,99 @@ class Index {
     arg1 record: record payload, without record header
   */
   void build_key(const char *record, Key &output_key, ThreadContext *thd_ctx) {
-    char *key_data = thd_ctx->get_key_container();
-    char *key_cursor = key_data;
-    uint32_t key_len = 0;
-    for (auto i : keyinfo_.key_parts) {
-      const Field &field = keyinfo_.schema.get_field(i);
-      const char *field_data = nullptr;
-      uint32_t data_len = 0;
-
-      field.get_field_data(record, field_data, data_len);
-      memcpy(key_cursor, field_data, data_len);
-      key_cursor += data_len;
-      key_len += data_len;
-    }
+    build_key(record, output_key, thd_ctx->get_key_container());
+  }
 
+  /**
+  @brief
+    build key from a db20xx record to key_data, which must be able to hold
+    DB20XX_MAX_ENCODED_KEY_LENGTH bytes. Keys are encoded to compare like
+    their values, see KeyEncodePlan.
+  */
+  void build_key(const char *record, Key &output_key, char *key_data) {
     output_key.s = key_data;
-    output_key.len = key_len;
+    output_key.len = key_plan_.encode(record, key_data);
   }
 
   void build_key_from_mysql_record(const char *mysql_record, Key &output_key, ThreadContext *thd_ctx) {
     char *key_data = thd_ctx->get_key_container();
-    char *key_cursor = key_data;
-    uint32_t key_len = 0;
-    for (auto i: keyinfo_.key_parts) {
-      const Field &field = keyinfo_.schema.get_field(i);
-      const char *field_data = nullptr;
-      uint32_t data_len = 0;
-
-      field.get_mysql_field_data(mysql_record, field_data, data_len);
-      memcpy(key_cursor, field_data, data_len);
-      key_cursor += data_len;
-      key_len += data_len;
-    }
     output_key.s = key_data;
-    output_key.len = key_len;
+    output_key.len = key_plan_.encode_mysql_record(mysql_record, key_data);
+  }
+
+  /**
+  @brief
+    build the key of the first part_num parts of a key in mysql key format,
+    it prefixes the keys of rows carrying those parts
+  */
+  void build_key_from_key_tuple(const char *tuple, uint32_t part_num,
+                                Key &output_key, char *key_data) {
+    output_key.s = key_data;
+    output_key.len = key_plan_.encode_key_tuple(tuple, part_num, key_data);
   }
 
   uint32_t get_key_length() { return keyinfo_.get_key_length(); }
   const KeyInfo &get_key_info() const { return keyinfo_; }
+  const KeyEncodePlan &get_key_plan() const { return key_plan_; }
+  bool is_unique() const { return keyinfo_.unique; }
+  bool is_nullable_unique() const { return keyinfo_.nullable_unique; }
+
+  /**
+  @brief
+    whether a key part of the row is NULL, record is either a payload or a
+    mysql record, both lead with the same null bytes
+  */
+  bool has_null_key_part(const char *record) const {
+    for (int key_part : keyinfo_.key_parts) {
+      const Field &field = keyinfo_.schema.get_field(key_part);
+      if (record[field.get_null_offset()] & field.get_null_mask()) return true;
+    }
+    return false;
+  }
+
+  /**
+  @brief
+    max bytes of the key of an index entry
+  */
+  uint32_t get_max_entry_key_length() const {
+    return key_plan_.get_max_length() +
+           (is_unique() ? 0 : DB20XX_ROW_ID_LENGTH);
+  }
+
+  /**
+  @brief
+    key of the index entry of the row vchain_head, which is the key itself
+    for a unique index. A non-unique index suffixes the key with the row id,
+    the big-endian address of the version chain head, so that rows sharing
+    a key get entries of their own, ordered by row id after the key.
+  @args
+    entry_data is used if the key needs a suffix, it must be able to hold
+    key.len + DB20XX_ROW_ID_LENGTH bytes and may be key.s
+  */
+  Key build_entry_key(const Key &key, const VersionChainHead *vchain_head,
+                      char *entry_data) const {
+    if (is_unique()) return key;
+    if (entry_data != key.s) memcpy(entry_data, key.s, key.len);
+    uint64_t row_id = reinterpret_cast<uintptr_t>(vchain_head);
+    for (uint32_t i = 0; i < DB20XX_ROW_ID_LENGTH; i++)
+      entry_data[key.len + i] = static_cast<char>(
+          row_id >> (8 * (DB20XX_ROW_ID_LENGTH - 1 - i)));
+    return Key(entry_data, key.len + DB20XX_ROW_ID_LENGTH);
+  }
+
+  /**
+  @brief
+    the key of an index entry without the row id suffix
+  */
+  Key get_user_key(const Key &entry_key) const {
+    if (is_unique()) return entry_key;
+    assert(entry_key.len >= static_cast<int>(DB20XX_ROW_ID_LENGTH));
+    return Key(entry_key.s, entry_key.len - DB20XX_ROW_ID_LENGTH);
+  }
 
  protected:
   KeyInfo keyinfo_;
+  KeyEncodePlan key_plan_;
 };
 
 struct db20xx_masstree_params : public nodeparams<15, 15> {
@@ -124,7 +196,8 @@ class MasstreeIndex : public Index {
   /**
   @brief
     put a key-value pair to masstree. key consists of columns, values is
-    corresponding RecordLocation of that Record.
+    corresponding RecordLocation of that Record. The key of a non-unique
+    index is stored with the row id suffix, see build_entry_key().
 
   @return values
     @retval1 true: first put
@@ -132,7 +205,9 @@ class MasstreeIndex : public Index {
   */
   bool put(const Key &key, VersionChainHead *vchain_head,
            threadinfo &ti) override {
-    typename db20xx_masstree_type::cursor_type lp(masstree_, key);
+    char entry_data[DB20XX_MAX_INDEX_KEY_LENGTH];
+    typename db20xx_masstree_type::cursor_type lp(
+        masstree_, build_entry_key(key, vchain_head, entry_data));
     bool found = lp.find_insert(ti);
     if (!found) {
       ti.observe_phantoms(lp.node());
@@ -140,19 +215,44 @@ class MasstreeIndex : public Index {
 
     apply_put(lp.value(), vchain_head, ti);
     lp.finish(1, ti);
+    if (!found) entry_num_.fetch_add(1, std::memory_order_relaxed);
     return found;
   }
 
+  /**
+  @brief
+    remove key from masstree if it still maps to vchain_head, another
+    version chain may have taken over the key meanwhile.
+
+  @return values
+    @retval1 true: removed
+    @retval2 false: key does not exist or maps to another version chain
+  */
+  bool remove(const Key &key, VersionChainHead *vchain_head,
+              threadinfo &ti) override {
+    char entry_data[DB20XX_MAX_INDEX_KEY_LENGTH];
+    typename db20xx_masstree_type::cursor_type lp(
+        masstree_, build_entry_key(key, vchain_head, entry_data));
+    bool found = lp.find_locked(ti);
+    bool removed = found && lp.value() == vchain_head;
+    lp.finish(removed ? -1 : 0, ti);
+    if (removed) entry_num_.fetch_sub(1, std::memory_order_relaxed);
+    return removed;
+  }
+
   /**
     @brief
       given key, get the value(RecordLocation of a db20xx row) of the key
     @return values
       @retval1 true: key exists
       @retval2 false: key doesnot exist
+    only for unique indexes, rows sharing a key of a non-unique index are
+    found by scanning the entries prefixed by the key.
     FIXME: same problem with apply_put
   */
   bool get(const Key &key, VersionChainHead *&vchain_head,
            threadinfo &ti) const override {
+    assert(is_unique());
     typename db20xx_masstree_type::unlocked_cursor_type lp(masstree_, key);
     bool found = lp.find_unlocked(ti);
     if (found) vchain_head = lp.value();
@@ -206,6 +306,54 @@ class MasstreeIndex : public Index {
     }
   }
 
+  /**
+  @brief
+    number of keys in the index, including stale ones which are not
+    removed by gc yet
+  */
+  uint64_t get_entry_num() const {
+    return entry_num_.load(std::memory_order_relaxed);
+  }
+
+  /**
+  @brief
+    estimate the number of keys between min_key and max_key, nullptr means
+    unbounded. The tree is descended once for each bound, assuming every
+    subtree of a node holds the same number of keys. In a leaf, a slot
+    holding a layer of keys sharing their first 8 bytes, like the
+    duplicates of a non-unique index, weighs the keys estimated under the
+    layer, other slots weigh 1. The layer is descended if the bound goes
+    beyond its 8 bytes. Slots are counted by weight if both bounds end in
+    the same leaf. Caller must be inside an index epoch.
+  */
+  double estimate_range_keys(const Key *min_key, bool include_min,
+                             const Key *max_key, bool include_max) const {
+    double entry_num = get_entry_num();
+    RankEstimate begin, end;
+    if (min_key != nullptr) estimate_rank(*min_key, !include_min, begin);
+    if (max_key != nullptr) estimate_rank(*max_key, include_max, end);
+
+    if (min_key != nullptr && max_key != nullptr && begin.leaf_ == end.leaf_)
+      return std::max(end.smaller_in_leaf_ - begin.smaller_in_leaf_, 0.0);
+    double begin_rank = min_key ? begin.rank_ : 0;
+    double end_rank = max_key ? end.rank_ : entry_num;
+    return std::max(end_rank - begin_rank, 0.0);
+  }
+
+  /**
+  @brief
+    estimate memory used by tree nodes, assuming nodes are 3/4 full
+  */
+  uint64_t estimate_memory_size() const {
+    const uint64_t keys_per_leaf = db20xx_masstree_params::leaf_width * 3 / 4;
+    const uint64_t leaves_per_inode =
+        db20xx_masstree_params::internode_width * 3 / 4;
+    uint64_t leaf_num = get_entry_num() / keys_per_leaf + 1;
+    return leaf_num * sizeof(leaf<db20xx_masstree_params>) +
+           (leaf_num / leaves_per_inode + 1) *
+               sizeof(internode<db20xx_masstree_params>);
+  }
+
   // TODO
   // int scan(const Key &key, bool matchfirst, Scanner& scanner, threadinfo &ti)
   // const override {}
@@ -215,6 +363,102 @@ class MasstreeIndex : public Index {
   // &ti) const override {}
 
  private:
+  struct RankEstimate {
+    // estimated number of keys before the bound
+    double rank_ = 0;
+    // the leaf the bound ends in, in the deepest layer descended
+    const void *leaf_ = nullptr;
+    // weight of the slots of leaf_ before the bound
+    double smaller_in_leaf_ = 0;
+  };
+
+  // nested layers deeper than this weigh a full leaf
+  static const int MAX_WEIGHED_LAYER_DEPTH = 2;
+
+  /**
+  @brief
+    estimate the keys under a leaf slot, 1 unless it holds a layer, whose
+    nodes are assumed as full as those on its leftmost path
+  */
+  double estimate_slot_keys(const leaf<db20xx_masstree_params> *leaf_node,
+                            int p, int depth) const {
+    if (!leaf_node->is_layer(p)) return 1;
+    node_base<db20xx_masstree_params> *node = leaf_node->lv_[p].layer();
+    if (node == nullptr || depth >= MAX_WEIGHED_LAYER_DEPTH)
+      return db20xx_masstree_params::leaf_width;
+    while (!node->is_root()) node = node->maybe_parent();
+    double keys = 1;
+    while (!node->isleaf()) {
+      auto *inode = static_cast<internode<db20xx_masstree_params> *>(node);
+      keys *= inode->size() + 1;
+      node = inode->child_[0];
+    }
+    auto *layer_leaf = static_cast<leaf<db20xx_masstree_params> *>(node);
+    auto perm = layer_leaf->permutation();
+    double leaf_keys = 0;
+    for (int i = 0; i < perm.size(); i++)
+      leaf_keys += estimate_slot_keys(layer_leaf, perm[i], depth + 1);
+    return keys * std::max(leaf_keys, 1.0);
+  }
+
+  /**
+  @brief
+    estimate the number of keys smaller than [key], or not greater than
+    any key prefixed by [key] if include_prefix is true.
+  */
+  void estimate_rank(const Key &key, bool include_prefix,
+                     RankEstimate &estimate) const {
+    typedef typename db20xx_masstree_params::ikey_type ikey_type;
+    double subtree_keys = get_entry_num();
+    node_base<db20xx_masstree_params> *node = masstree_.root();
+    for (int offset = 0; node != nullptr; offset += sizeof(ikey_type)) {
+      char key_slice[sizeof(ikey_type)];
+      int slice_len =
+          std::min<int>(std::max(key.len - offset, 0), sizeof(key_slice));
+      memset(key_slice, include_prefix ? 0xff : 0, sizeof(key_slice));
+      memcpy(key_slice, key.s + offset, slice_len);
+      ikey_type ikey = string_slice<ikey_type>::make_comparable(
+          key_slice, sizeof(key_slice));
+
+      while (!node->is_root()) node = node->maybe_parent();
+      while (!node->isleaf()) {
+        auto *inode = static_cast<internode<db20xx_masstree_params> *>(node);
+        int nkeys = inode->size();
+        int child = 0;
+        while (child < nkeys && compare(ikey, inode->ikey(child)) >= 0)
+          child++;
+        subtree_keys /= nkeys + 1;
+        estimate.rank_ += subtree_keys * child;
+        node = inode->child_[child];
+      }
+
+      auto *leaf_node = static_cast<leaf<db20xx_masstree_params> *>(node);
+      auto perm = leaf_node->permutation();
+      int size = perm.size();
+      estimate.leaf_ = leaf_node;
+      estimate.smaller_in_leaf_ = 0;
+      node = nullptr;
+      double leaf_keys = 0, layer_keys = 0;
+      for (int i = 0; i < size; i++) {
+        int cmp = compare(leaf_node->ikey(perm[i]), ikey);
+        double slot_keys = estimate_slot_keys(leaf_node, perm[i], 0);
+        leaf_keys += slot_keys;
+        if (cmp < 0 || (include_prefix && cmp == 0)) {
+          estimate.smaller_in_leaf_ += slot_keys;
+        } else if (cmp == 0 && leaf_node->is_layer(perm[i]) &&
+                   key.len > offset + (int)sizeof(ikey_type)) {
+          // the bound falls inside the keys of the layer
+          node = leaf_node->lv_[perm[i]].layer();
+          layer_keys = slot_keys;
+        }
+      }
+      if (leaf_keys == 0) break;
+      estimate.rank_ +=
+          subtree_keys * estimate.smaller_in_leaf_ / leaf_keys;
+      subtree_keys = subtree_keys * layer_keys / leaf_keys;
+    }
+  }
+
   /**
   FIXME: masstree should manage leafvalue carefully to avoid concurrent
   problems.
@@ -227,6 +471,7 @@ class MasstreeIndex : public Index {
 
  private:
   db20xx_masstree_type masstree_;
+  std::atomic<uint64_t> entry_num_ = 0;
 };
 
 }  // namespace db20xx
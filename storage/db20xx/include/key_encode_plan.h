@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "./data_types.h"
+
+namespace db20xx {
+
+class Schema;
+
+/**
+ * @brief
+ *   Precompiled program encoding the keys of an index, so that keys
+ *   compare by bytes like their values compare in mysql. Masstree orders
+ *   keys by bytes, range scans and ORDER BY on an index rely on it.
+ *
+ *   Every key part is encoded as
+ *     nullable part:  [0x00] for NULL, [0x01 | value] otherwise
+ *     integer, DATE:  big-endian, the sign bit flipped if signed
+ *     FLOAT, DOUBLE:  big-endian IEEE bits, every bit flipped if negative,
+ *                     only the sign bit otherwise
+ *     DECIMAL, YEAR, TIME, DATETIME, TIMESTAMP, binary CHAR:
+ *                     the mysql bytes, which are ordered already
+ *     other strings:  sort key under the collation (the bytes of binary
+ *                     strings), 0x00 escaped to [0x00 0xff] and terminated
+ *                     by [0x00 0x01] so that a string sorts before the
+ *                     strings it prefixes. Sort keys padded to their max
+ *                     length are stored as they are.
+ *   The key of the leading parts of an index prefixes the keys of the rows
+ *   carrying them.
+ *
+ *   Adjacent not null parts stored as they are in both the db20xx and the
+ *   mysql record are encoded by a single memcpy op.
+ */
+class KeyEncodePlan {
+ public:
+  /**
+   * @brief
+   *   max bytes of the sort key of a string stored in a key part of
+   *   length bytes, padded is set if every sort key takes them
+   */
+  typedef uint32_t (*SortKeyLengthFunc)(uint32_t collation_id,
+                                        uint32_t length, bool &padded);
+  /**
+   * @brief
+   *   make the sort key of the characters of data which fit in a key part
+   *   of length bytes, return the length of the sort key
+   */
+  typedef uint32_t (*SortKeyFunc)(uint32_t collation_id, const char *data,
+                                  uint32_t data_len, uint32_t length,
+                                  char *sort_key);
+
+  /**
+   * @brief
+   *   collations are implemented by the server, it sets the hooks once
+   *   before any index is built. Strings are encoded by their bytes if no
+   *   hook is set.
+   */
+  static void set_collation_hooks(SortKeyLengthFunc sort_key_length,
+                                  SortKeyFunc make_sort_key);
+
+  enum OpKind : uint8_t {
+    COPY = 0,  // bytes already ordered
+    INT,
+    FLOAT,
+    DOUBLE,
+    STRING  // sort key
+  };
+
+  struct Op {
+    OpKind kind_;
+    bool is_signed_;
+    bool store_inline_;
+    // BLOB, a mysql record holds the pointer to its data
+    bool mysql_pointer_;
+    // null bit, null_mask_ is 0 for a not null part
+    uint8_t null_mask_;
+    uint32_t null_offset_;
+    uint32_t offset_in_record_;
+    uint32_t offset_in_mysql_record_;
+    // bytes of the value in the mysql key format, a STRING value fits in
+    // them after truncated to the key part
+    uint32_t length_;
+    // length bytes of a non-inline field
+    uint32_t length_bytes_;
+    uint32_t collation_id_;
+    // STRING: max bytes of the sort key, which are all taken if padded
+    uint32_t sort_key_length_;
+    bool padded_sort_key_;
+  };
+
+  /**
+   * @brief
+   *   compile the plan of an index
+   * @args
+   *   @arg2 key_parts ids of the fields of the key parts
+   *   @arg3 lengths bytes of each key part in mysql key format, 0 takes
+   *         the whole value
+   */
+  void build(const Schema &schema, const std::vector<int> &key_parts,
+             const std::vector<uint32_t> &lengths);
+
+  /**
+   * @brief
+   *   max bytes of an encoded key
+   */
+  uint32_t get_max_length() const { return max_length_; }
+
+  uint32_t get_part_num() const { return part_ops_.size(); }
+
+  /**
+   * @brief
+   *   bytes of encoded part [part], 0 if they are variable
+   */
+  uint32_t get_fixed_part_length(uint32_t part) const;
+
+  /**
+   * @brief
+   *   encode the key of a db20xx record payload to key, return the length
+   */
+  uint32_t encode(const char *payload, char *key) const;
+
+  /**
+   * @brief
+   *   encode the key of a mysql record to key, return the length
+   */
+  uint32_t encode_mysql_record(const char *mysql_record, char *key) const;
+
+  /**
+   * @brief
+   *   encode the first part_num parts of a key in mysql key format, which
+   *   is [null byte] [value] per part, a non-inline value is
+   *   [2 length bytes | data padded to the key part length]
+   */
+  uint32_t encode_key_tuple(const char *tuple, uint32_t part_num,
+                            char *key) const;
+
+ private:
+  template <bool FROM_MYSQL>
+  uint32_t encode_record(const char *record, char *key) const;
+  static uint32_t encode_value(const Op &op, const char *data,
+                               uint32_t data_len, char *key);
+  static uint32_t encode_string(const Op &op, const char *data,
+                                uint32_t data_len, char *key);
+  static uint32_t escape_string(const char *data, uint32_t data_len,
+                                char *key);
+
+ private:
+  // one op per key part
+  std::vector<Op> part_ops_;
+  // part_ops_ with adjacent COPY ops merged, used to encode records
+  std::vector<Op> ops_;
+  uint32_t max_length_ = 0;
+
+  static SortKeyLengthFunc sort_key_length_;
+  static SortKeyFunc make_sort_key_;
+};
+
+}  // namespace db20xx
@@ -0,0 +1,222 @@
+#pragma once
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "data_types.h"
+#include "schema.h"
+#include "utils.h"
+
+namespace db20xx {
+
+class Table;
+class TransactionContext;
+class ThreadContext;
+
+enum LogRecordType : uint32_t {
+  LOG_RECORD_INVALID = 0,
+  LOG_RECORD_CREATE_TABLE = 1,
+  LOG_RECORD_COMMIT = 2
+};
+
+enum LogEntryType : uint8_t {
+  LOG_ENTRY_UPSERT = 1,  // the version chain has a new latest version
+  LOG_ENTRY_DELETE = 2   // the version chain has been deleted
+};
+
+/**
+ *@brief write [len] bytes to fd, exit on io error
+ */
+void write_fully(int fd, const char *data, uint64_t len);
+
+/**
+ *@brief
+ *  Every log record starts with a fixed size header, followed by [length_]
+ *  bytes of body. A record whose checksum does not match is considered as
+ *  a torn write, recovery stops there.
+ */
+struct LogRecordHeader {
+  uint32_t type_;
+  uint32_t length_;
+  uint32_t checksum_;
+};
+
+/**
+ *@brief
+ *  helpers to build and parse log record bodies
+ */
+class LogWriter {
+ public:
+  explicit LogWriter(std::string &buf) : buf_(buf) {}
+  void put_u8(uint8_t value) { buf_.append((const char *)&value, 1); }
+  void put_u32(uint32_t value) { buf_.append((const char *)&value, 4); }
+  void put_u64(uint64_t value) { buf_.append((const char *)&value, 8); }
+  void put_bytes(const char *data, uint32_t len) { buf_.append(data, len); }
+  void put_string(const std::string &str) {
+    put_u32(str.size());
+    put_bytes(str.data(), str.size());
+  }
+
+ private:
+  std::string &buf_;
+};
+
+class LogReader {
+ public:
+  LogReader(const char *data, uint64_t len) : cur_(data), end_(data + len) {}
+  bool get_u8(uint8_t &value) { return get_bytes((char *)&value, 1); }
+  bool get_u32(uint32_t &value) { return get_bytes((char *)&value, 4); }
+  bool get_u64(uint64_t &value) { return get_bytes((char *)&value, 8); }
+  bool get_bytes(char *data, uint64_t len) {
+    if (remaining() < len) return false;
+    memcpy(data, cur_, len);
+    cur_ += len;
+    return true;
+  }
+  bool get_string(std::string &str) {
+    uint32_t len = 0;
+    if (!get_u32(len) || remaining() < len) return false;
+    str.assign(cur_, len);
+    cur_ += len;
+    return true;
+  }
+  const char *&cursor() { return cur_; }
+  uint64_t remaining() const { return end_ - cur_; }
+
+ private:
+  const char *cur_;
+  const char *end_;
+};
+
+/**
+ *@brief a table known to the redo log
+ */
+struct LoggedTable {
+  std::string db_name_;
+  Table *table_;
+};
+
+/**
+ *@brief
+ *  Write-ahead redo log.
+ *
+ *  At commit time a transaction serializes the new latest version of every
+ *  version chain it modified into its own log buffer, then appends the whole
+ *  buffer to the shared log buffer at once. A flusher thread writes and
+ *  fsyncs the shared buffer, so concurrent commits share one fsync (group
+ *  commit).
+ *
+ *  flush_log_at_commit decides how long a commit waits:
+ *    0: do not wait, the log is written and synced once per second
+ *    1: wait until the log is written and synced
+ *    2: wait until the log is written, it is synced once per second
+ *
+ *  Version chains are identified by (table id, vchain head block id, index
+ *  in block), recovery puts every recovered chain to the same location and
+ *  inserts it to the indexes.
+ *
+ *  Recovery starts from the latest checkpoint (see Checkpointer) and only
+ *  replays the log written after it.
+ */
+class LogManager {
+  friend class Checkpointer;
+
+ public:
+  /**
+   *@brief
+   *  open the log file under [log_dir] and start the flusher thread.
+   *  recover() must be called before.
+   */
+  static void start(const std::string &log_dir);
+  static void stop();
+  static bool is_enabled() { return enabled_; }
+
+  /**
+   *@brief
+   *  load the checkpoint and replay the log under [log_dir], recreate
+   *  tables and their contents.
+   */
+  static void recover(const std::string &log_dir);
+
+  static void set_flush_log_at_commit(uint32_t flush_log_at_commit) {
+    flush_log_at_commit_.store(flush_log_at_commit);
+  }
+
+  /**
+   *@brief
+   *  log the definition of a new table, return after it is synced.
+   */
+  static void log_create_table(const std::string &db_name, Table *table);
+
+  /**
+   *@brief
+   *  log the modify set of a committing transaction, return when it is
+   *  durable according to flush_log_at_commit.
+   */
+  static void log_commit(TransactionContext *txn_ctx);
+
+  static void serialize_table_definition(const std::string &db_name,
+                                         Table *table, std::string &buf);
+
+  static uint64_t get_buffered_lsn() {
+    std::lock_guard<std::mutex> guard(log_lock_);
+    return buffered_lsn_;
+  }
+
+  /**
+   *@brief
+   *  release the disk space of log before [lsn], which is covered by a
+   *  checkpoint. lsn of later records do not change.
+   */
+  static void discard_log_before(uint64_t lsn);
+
+  /**
+   *@brief FNV-1a, pass the previous result as [hash] to continue
+   */
+  static uint32_t compute_checksum(const char *data, uint64_t len,
+                                   uint32_t hash = CHECKSUM_SEED);
+
+ public:
+  static const uint32_t FLUSH_INTERVAL_MS = 1000;
+  static constexpr const char *LOG_FILE_NAME = "db20xx_redo.log";
+  static const uint32_t CHECKSUM_SEED = 2166136261u;
+
+ private:
+  static uint64_t append(LogRecordType type, const std::string &body);
+  static void wait_for_flush(uint64_t lsn, bool sync);
+  static void flush_loop();
+
+  static Table *get_logged_table(uint32_t table_id);
+  static bool replay_create_table(LogReader &reader, ThreadContext *thd_ctx);
+  static bool replay_commit(LogReader &reader, ThreadContext *thd_ctx);
+
+ private:
+  static bool enabled_;
+  static int log_fd_;
+  static std::atomic<uint32_t> flush_log_at_commit_;
+  static std::atomic<uint32_t> next_table_id_;
+  // table id -> table, every table that has been logged or recovered
+  static std::mutex tables_lock_;
+  static std::unordered_map<uint32_t, LoggedTable> tables_;
+
+  // log sequence number is the byte offset in log file
+  static std::mutex log_lock_;
+  static std::string log_buffer_;
+  static uint64_t buffered_lsn_;
+  static uint64_t written_lsn_;
+  static uint64_t synced_lsn_;
+  // number of commits waiting for write/sync
+  static uint32_t write_waiters_;
+  static uint32_t sync_waiters_;
+  static std::condition_variable flusher_cv_;
+  static std::condition_variable waiter_cv_;
+
+  static std::thread flusher_thread_;
+  static bool flusher_running_;
+};
+
+}  // namespace db20xx
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace db20xx {
+
+/**
+@brief
+  A conjunction of comparisons between inline fields and constants, checked
+  directly against db20xx record payloads, so that rows failing a pushed
+  down condition are never copied to the server.
+
+  The payload keeps inline fields and null bytes in the mysql storage
+  format, a field is compared as a little-endian integer or as raw bytes
+  (types whose storage format is memcmp ordered). Constants are converted
+  to the storage format of the field when the predicate is compiled.
+*/
+class Predicate {
+ public:
+  enum CompareOp { EQ = 0, NE, LT, LE, GT, GE, IS_NULL, IS_NOT_NULL };
+  enum ValueType { SIGNED_INT = 0, UNSIGNED_INT, BYTES };
+
+  struct Term {
+    CompareOp op_ = EQ;
+    ValueType value_type_ = BYTES;
+    uint32_t offset_ = 0;  // offset of the field data in payload
+    uint32_t length_ = 0;
+    uint32_t null_offset_ = 0;
+    uint8_t null_mask_ = 0;  // 0 if the field is not nullable
+    std::string bytes_;      // constant in storage format, length_ bytes
+    int64_t int_value_ = 0;  // decoded from bytes_ by add_term
+  };
+
+  void add_term(const Term &term);
+  bool empty() const { return terms_.empty(); }
+  void clear() { terms_.clear(); }
+  const std::vector<Term> &get_terms() const { return terms_; }
+
+  /**
+  @brief
+    whether the payload satisfies every term, a comparison with a NULL
+    field is false.
+  */
+  bool evaluate(const char *payload) const {
+    for (const Term &term : terms_) {
+      if (!evaluate_term(term, payload)) return false;
+    }
+    return true;
+  }
+
+  /**
+  @brief
+    whether a field value satisfies term, data points to the value in the
+    storage format. Used by scans reading fields stored apart from payloads.
+  */
+  static bool evaluate_value(const Term &term, const char *data,
+                             bool is_null);
+
+ private:
+  static bool evaluate_term(const Term &term, const char *payload) {
+    return evaluate_value(term, payload + term.offset_,
+                          (payload[term.null_offset_] & term.null_mask_) != 0);
+  }
+
+ private:
+  std::vector<Term> terms_;
+};
+
+}  // namespace db20xx
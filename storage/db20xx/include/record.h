@@ -1,5 +1,7 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
+#include <vector>
 #include "data_types.h"
 #include "return_status.h"
 #include "schema.h"
@@ -23,6 +25,23 @@ class RecordHeader {
    */
   Latch latch_;
 
+  /**
+   * A delete marker is the version appended by a delete operation.
+   * It only terminates the version chain and carries no payload,
+   * so its payload must never be interpreted.
+   */
+  bool delete_marker_ = false;
+
+  /**
+   * A delta version only stores the columns changed by its update:
+   * [changed field bitmap | null bytes | changed fields], the other
+   * columns are read from older_version_, which is always a full version.
+   * The older version counts the delta versions built on it in
+   * delta_num_, and is not reclaimed until they are gone.
+   */
+  bool delta_ = false;
+  std::atomic<uint32_t> delta_num_{0};
+
   /**
    * When each transaction starts, system will assign it a unique
    * global timestamp. This unique global timestamp is used as transaction id.
@@ -98,12 +117,88 @@ class Record {
   Record *get_older_version();
   void set_vchain_head(VersionChainHead *vchain_head);
   VersionChainHead *get_vchain_head();
+  void set_delete_marker();
+  bool is_delete_marker() const;
+  bool is_delta() const;
+  uint32_t get_delta_num() const;
 
-  void load_data_from_mysql(char *mysql_record, const Schema &schema);
+  //=======================Delta version==============================
+  /**
+   * @brief
+   *   ids of the fields mysql_record changes in this full version.
+   * @return
+   *   payload length of a delta version storing the changed fields
+   */
+  uint32_t diff_from_mysql(const char *mysql_record, const Schema &schema,
+                           std::vector<uint32_t> &changed_fields) const;
+  /**
+   * @brief
+   *   make this record a delta version of base storing changed_fields of
+   *   mysql_record, see diff_from_mysql().
+   */
+  void load_delta_from_mysql(const char *mysql_record, const Schema &schema,
+                             Record *base,
+                             const std::vector<uint32_t> &changed_fields,
+                             VarlenArena &arena);
+  /**
+   * @brief
+   *   payload of the whole row, a delta version is applied to its base in
+   *   buf, which must hold schema.get_record_data_length() bytes.
+   */
+  const char *get_full_payload(const Schema &schema, char *buf);
+
+  /**
+   * @brief
+   *   copy a whole row by the copy plan of the schema, see
+   *   Schema::compile_copy_plan(). Out-of-line data is allocated from
+   *   arena, BLOB values still pointed to by mysql_record are shared with
+   *   old_payload, the payload of the version being updated.
+   */
+  void load_data_from_mysql(char *mysql_record, const Schema &schema,
+                            VarlenArena &arena,
+                            const char *old_payload = nullptr);
   void load_data_to_mysql(char *mysql_record, const Schema &schema);
+  /**
+   * @brief
+   *   copy null bytes and the given fields only, used by index-only reads.
+   */
+  void load_fields_to_mysql(char *mysql_record, const Schema &schema,
+                            const std::vector<int> &field_ids);
+  /**
+   * @brief
+   *   copy the fields of the projection only, the rest of mysql_record is
+   *   left untouched. A delta version also copies its other changed fields.
+   */
+  void load_projection_to_mysql(char *mysql_record, const Schema &schema,
+                                const RowCopyPlan &projection);
+  /**
+   * @brief
+   *   append payload and out-of-line data to buf, used by redo log
+   */
+  void serialize_payload(const Schema &schema, std::string &buf);
+  /**
+   * @brief
+   *   inverse of serialize_payload, advance data to the end of the
+   *   serialized payload
+   */
+  void deserialize_payload(const char *&data, const Schema &schema,
+                           VarlenArena &arena);
+  /**
+   * @brief
+   *   drop the references of the payload to out-of-line VARCHAR/BLOB data
+   */
+  void release_out_of_line_data(const Schema &schema);
+  /**
+   * @brief
+   *   raw payload, the delta of a delta version, see get_full_payload()
+   */
   char *get_payload();
   RecordHeader *get_header();
 
+ private:
+  void load_delta_to_mysql(char *mysql_record, const Schema &schema);
+  void apply_delta(char *payload, const Schema &schema);
+
  private:
   RecordHeader header_;
   char payload_[0];  // payload lenght is specified in table
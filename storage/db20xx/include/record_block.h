@@ -8,15 +8,20 @@ class RecordBlock {
   friend class Table;
 
  public:
-  bool is_last_record(const Record *record);
+  /**
+   * @brief
+   *   hand out the next slot, a block is owned by one thread at a time,
+   *   see TableAllocator.
+   */
   int alloc_record(Record *&record);
+  bool is_full() const { return valid_record_num_ >= record_capacity_; }
   void get_record(TableScanCursor *scan_cursor);
 
  private:
   uint32_t block_id_ = 0;
   uint32_t record_length_ = 0;  // include header + payload
   uint32_t record_capacity_ = 0;
-  std::atomic<uint32_t> valid_record_num_ = 0;
+  uint32_t valid_record_num_ = 0;
   char records_data_[0];
 };
 
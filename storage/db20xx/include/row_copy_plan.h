@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "./varlen_arena.h"
+
+namespace db20xx {
+
+class Schema;
+
+/**
+ * @brief
+ *   Precompiled program copying rows between the mysql record format and
+ *   the db20xx payload. It is built once per schema (or per read set) so
+ *   that copying a row does not walk the fields and branch on their types.
+ *
+ *   The null bytes and every run of inline fields adjacent in both layouts
+ *   become a single memcpy op, non-inline fields become an op specialized
+ *   by field type and width of the mysql length bytes.
+ *
+ *   non-inline field in payload: [length bytes | pointer to actual data],
+ *                                see VarlenArena for short values
+ *   VARCHAR in mysql record:     [length bytes | data]
+ *   BLOB in mysql record:        [length bytes | pointer to actual data]
+ */
+class RowCopyPlan {
+ public:
+  enum OpKind : uint8_t {
+    COPY_INLINE = 0,
+    VARCHAR_1,  // VARCHAR with 1 length byte
+    VARCHAR_2,
+    BLOB_1,  // BLOB with 1 length byte, TINYBLOB
+    BLOB_2,
+    BLOB_3,
+    BLOB_4
+  };
+
+  struct Op {
+    OpKind kind_;
+    uint32_t offset_in_record_;
+    uint32_t offset_in_mysql_record_;
+    uint32_t length_;  // bytes copied by COPY_INLINE
+  };
+
+  /**
+   * @brief
+   *   compile the plan copying the null bytes and the given fields
+   * @args
+   *   @arg2 field_ids ids of the fields to copy, in ascending order
+   */
+  void build(const Schema &schema, const std::vector<uint32_t> &field_ids);
+
+  /**
+   * @brief
+   *   compile the plan copying the whole row
+   */
+  void build(const Schema &schema);
+
+  bool empty() const { return ops_.empty(); }
+
+  /**
+   * @brief
+   *   copy mysql_record to payload, out-of-line data is allocated from
+   *   arena. If old_payload is given, BLOB values mysql_record still points
+   *   to are shared with old_payload rather than copied.
+   */
+  void load_from_mysql(const char *mysql_record, char *payload,
+                       VarlenArena &arena,
+                       const char *old_payload = nullptr) const;
+
+  /**
+   * @brief
+   *   copy payload to mysql_record, bytes not covered by the plan are left
+   *   untouched. BLOB fields of mysql_record point to the out-of-line data
+   *   of the payload, they stay valid as long as the record is not
+   *   reclaimed.
+   */
+  void load_to_mysql(const char *payload, char *mysql_record) const;
+
+  /**
+   * @brief
+   *   drop the references of payload to out-of-line data of the fields
+   *   copied by the plan
+   */
+  void release_out_of_line_data(const char *payload) const;
+
+  /**
+   * @brief
+   *   add a reference of another payload to the out-of-line data of payload
+   */
+  void share_out_of_line_data(const char *payload) const;
+
+ private:
+  template <bool SHARE>
+  void reference_out_of_line_data(const char *payload) const;
+  void add_inline(uint32_t offset_in_record, uint32_t offset_in_mysql_record,
+                  uint32_t length);
+
+ private:
+  std::vector<Op> ops_;
+};
+
+}  // namespace db20xx
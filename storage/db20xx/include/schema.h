@@ -1,6 +1,7 @@
 #pragma once
 #include "./utils.h"
 #include "./field.h"
+#include "./row_copy_plan.h"
 
 namespace db20xx {
 class Schema {
@@ -57,15 +58,29 @@ public:
     return fields_[idx].data_bytes_;
   }
 
-  uint32_t get_record_data_length() {
+  uint32_t get_record_data_length() const {
     return total_size_;
   }
 
+  /**
+  @brief 在所有field加入后编译整行的拷贝计划,
+         load_data_from_mysql/load_data_to_mysql按该计划拷贝
+  */
+  void compile_copy_plan() {
+    copy_plan_.build(*this);
+  }
+
+  const RowCopyPlan &get_copy_plan() const {
+    return copy_plan_;
+  }
+
 private:
   std::vector<Field> fields_;
 
   // total_size_ = null_byte_length + all fields bytes
   uint32_t total_size_ = 0;
   uint32_t null_byte_length_ = 0;
+
+  RowCopyPlan copy_plan_;
 };
 }
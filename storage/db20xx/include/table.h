@@ -1,8 +1,15 @@
 #pragma once
 #include <sys/types.h>
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
-#include "cuckoo_map.h"
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "block_directory.h"
+#include "column_block.h"
 #include "data_types.h"
 #include "index.h"
 #include "record.h"
@@ -20,9 +27,16 @@ class TableScanCursor {
   friend class Table;
 
  public:
-  void reset() {
+  void reset() { reset(0, UINT32_MAX); }
+
+  /**
+  @brief
+    scan version chain head blocks [begin_block_id, end_block_id) only
+  */
+  void reset(uint32_t begin_block_id, uint32_t end_block_id) {
     current_block_ = nullptr;
-    block_id_ = 0;
+    block_id_ = begin_block_id;
+    end_block_id_ = end_block_id;
     idx_in_block_ = 0;
     record_ = nullptr;
   }
@@ -37,16 +51,121 @@ class TableScanCursor {
  public:
   VersionChainHeadBlock *current_block_ = nullptr;
   uint32_t block_id_ = 0;
+  uint32_t end_block_id_ = UINT32_MAX;
   uint32_t idx_in_block_ = 0;
   Record *record_ = nullptr;
 };
 
+/**
+@brief
+  shared state of a parallel table scan. Version chain head blocks have
+  dense ids, workers claim ranges of BLOCKS_PER_CLAIM blocks until all
+  blocks below block_num_ are handed out.
+*/
+class ParallelTableScan {
+ public:
+  explicit ParallelTableScan(uint32_t block_num) : block_num_(block_num) {}
+
+  /**
+  @return
+    false if every block has been claimed
+  */
+  bool claim_blocks(uint32_t &begin_block_id, uint32_t &end_block_id) {
+    uint32_t begin = next_block_id_.fetch_add(BLOCKS_PER_CLAIM);
+    if (begin >= block_num_) return false;
+    begin_block_id = begin;
+    end_block_id = std::min(begin + BLOCKS_PER_CLAIM, block_num_);
+    return true;
+  }
+
+ public:
+  static const uint32_t BLOCKS_PER_CLAIM = 4;
+
+ private:
+  const uint32_t block_num_;
+  std::atomic<uint32_t> next_block_id_ = 0;
+};
+
+/**
+@brief
+  table statistics reported to the optimizer
+*/
+struct TableStats {
+  // committed rows that are not deleted
+  uint64_t record_num_ = 0;
+  // versions invisible to new transactions that still hold record slots
+  uint64_t deleted_version_num_ = 0;
+  uint64_t data_length_ = 0;
+  uint64_t index_length_ = 0;
+};
+
+/**
+@brief
+  index entries deferred by a bulk insert of a thread. They are sorted and
+  put to the indexes in key order, so that consecutive puts descend the
+  same path of the tree.
+*/
+struct BulkInsertBuffer {
+  struct Entry {
+    // first 8 bytes of the key, big-endian and zero padded, most keys are
+    // ordered by it without touching keys_
+    uint64_t key_prefix_;
+    uint32_t key_offset_;  // in keys_ of the index
+    uint32_t key_length_;
+    VersionChainHead *vchain_head_;
+  };
+
+  explicit BulkInsertBuffer(const std::vector<bool> &deferred)
+      : deferred_(deferred),
+        keys_(deferred.size()),
+        entries_(deferred.size()) {}
+
+  bool is_deferred(uint32_t idx) const { return deferred_[idx]; }
+
+  void add(uint32_t idx, const Key &key, VersionChainHead *vchain_head) {
+    uint64_t key_prefix = 0;
+    memcpy(&key_prefix, key.s, std::min<size_t>(key.len, sizeof(key_prefix)));
+    entries_[idx].push_back({__builtin_bswap64(key_prefix),
+                             static_cast<uint32_t>(keys_[idx].size()),
+                             static_cast<uint32_t>(key.len), vchain_head});
+    keys_[idx].append(key.s, key.len);
+    entry_num_++;
+  }
+
+  // indexes whose entries are deferred
+  std::vector<bool> deferred_;
+  std::vector<std::string> keys_;
+  std::vector<std::vector<Entry>> entries_;
+  uint64_t entry_num_ = 0;
+};
+
 class Table {
   friend class TransactionContext;
+  friend class GarbageCollector;
+  friend class Checkpointer;
 
  public:
-  Table(const std::string &table_name, Schema &schema);
+  static const uint32_t DEFAULT_RECORDS_PER_BLOCK = 1024;
+
+  /**
+  @brief
+    records_per_block is the number of record slots of a record block, a
+    thread takes a whole block at a time. A COLUMNAR table also keeps the
+    latest committed versions in column blocks, see ColumnBlock.
+  */
+  Table(const std::string &table_name, Schema &schema,
+        uint32_t records_per_block = DEFAULT_RECORDS_PER_BLOCK,
+        StorageLayout storage_layout = STORAGE_LAYOUT_ROW);
   const Schema &get_schema() const;
+  const std::string &get_table_name() const { return table_name_; }
+  uint32_t get_table_id() const { return table_id_; }
+  uint32_t get_records_per_block() const { return records_in_block_; }
+  StorageLayout get_storage_layout() const { return storage_layout_; }
+  bool is_columnar() const {
+    return storage_layout_ == STORAGE_LAYOUT_COLUMNAR;
+  }
+  const ColumnLayout &get_column_layout() const { return column_layout_; }
+  void set_table_id(uint32_t table_id) { table_id_ = table_id; }
   int insert_record_from_mysql(char *mysql_record, ThreadContext *thd_ctx);
   int update_record_from_mysql(Record *old_record, char *new_mysql_record,
                                ThreadContext *thd_ctx);
@@ -59,6 +178,63 @@ class Table {
   */
   int table_scan_get(TableScanCursor &scan_cursor, bool read_own,
                      ThreadContext *thd_ctx);
+  /**
+  @brief
+    Table scan that reads up to max_num visible records into records in
+    one call, walking version chain head blocks in a tight loop.
+  @return values
+    @retval DB20XX_SUCCESS: num > 0 records are read
+    @retval DB20XX_END_OF_TABLE: no more visible record
+  */
+  int table_scan_get_batch(TableScanCursor &scan_cursor, bool read_own,
+                           ThreadContext *thd_ctx, Record **records,
+                           uint32_t max_num, uint32_t &num);
+
+  /**
+  @brief
+    table_scan_get_batch() of a read-only transaction on a columnar table,
+    reading the column blocks. Entries whose stored version is visible are
+    filtered by the terms of plan column by column, and the null bytes and
+    the columns of plan are copied to row i in rows, a mysql record of
+    row_length bytes, records[i] is nullptr. Other entries are read from
+    their version chains, records[i] is the visible version, which
+    satisfies the terms but is not copied. vchain_heads[i] is the chain
+    of row i.
+    列式扫描, 块内先按列过滤, 再拷贝投影列
+  @return values
+    @retval DB20XX_SUCCESS: num > 0 rows are read
+    @retval DB20XX_END_OF_TABLE: no more visible row
+  */
+  int column_scan_get_batch(TableScanCursor &scan_cursor,
+                            const ColumnScanPlan &plan, ThreadContext *thd_ctx,
+                            char *rows, uint32_t row_length, Record **records,
+                            VersionChainHead **vchain_heads, uint32_t max_num,
+                            uint32_t &num);
+
+  /**
+  @brief
+    location of the version chain of a record, stable for the lifetime of
+    the table, used as the row position of mysql.
+  */
+  static void get_record_location(Record *record, uint32_t &block_id,
+                                  uint32_t &idx_in_block) {
+    get_vchain_head_location(record->get_vchain_head(), block_id,
+                             idx_in_block);
+  }
+  static void get_vchain_head_location(VersionChainHead *vchain_head,
+                                       uint32_t &block_id,
+                                       uint32_t &idx_in_block);
+
+  /**
+  @brief
+    read the version chain at [block_id, idx_in_block], which is got from
+    get_record_location() before.
+  @return values
+    @retval DB20XX_KEY_NOT_EXIST: no version chain at that location
+  */
+  int get_record_by_location(uint32_t block_id, uint32_t idx_in_block,
+                             Record *&record, ThreadContext *thd_ctx,
+                             bool read_own);
 
   //=======================Index operations============================
   /**
@@ -80,16 +256,38 @@ class Table {
 
   void insert_record_to_index(VersionChainHead *vchain_head, ThreadContext *thd_ctx);
 
+  /**
+  @brief
+    insert keys of an uncommitted version to index
+  */
+  void insert_version_to_index(Record *record, ThreadContext *thd_ctx);
+
   /**
   @brief
     given a index number and its corresponding key, get the record.
+    A key of a non-unique index gets the first visible row carrying it.
   */
   int get_record_from_index(uint32_t idx, const Key &key, Record *&record,
                              ThreadContext &thd_ctx, bool read_own);
 
+  /**
+  @brief
+    get_record_from_index() for num keys, results[i] and records[i] are
+    the result of keys[i]. Keys of a unique index are looked up in groups
+    of MULTI_GET_GROUP_SIZE, the version chain heads and the latest
+    versions of a group are prefetched before any of them is read, so
+    their cache misses overlap. Sorted keys share the upper Masstree
+    nodes of their descents.
+    批量点查, 以组为单位预取, 隐藏访存延迟
+  */
+  void multi_get_records_from_index(uint32_t idx, const Key *keys,
+                                    uint32_t num, Record **records,
+                                    int *results, ThreadContext &thd_ctx,
+                                    bool read_own);
+
   int index_scan_range_first(uint32_t idx, const Key &key, Record *&record,
                               bool emit_firstkey, scan_stack_type &scan_stack,
-                              ThreadContext &thd_ctx, bool read_own) const;
+                              ThreadContext &thd_ctx, bool read_own);
 
   /**
    *@return values
@@ -98,27 +296,176 @@ class Table {
    */
   int index_scan_range_next(uint32_t idx, Record *&record,
                              scan_stack_type &scan_stack,
-                             ThreadContext &thd_ctx, bool read_own) const;
+                             ThreadContext &thd_ctx, bool read_own);
 
   int index_rscan_range_first(uint32_t idx, const Key &key, Record *&record,
                                bool emit_firstkey, scan_stack_type &scan_stack,
-                               ThreadContext &thd_ctx, bool read_own) const;
+                               ThreadContext &thd_ctx, bool read_own);
 
   int index_rscan_range_next(uint32_t idx, Record *&record,
                               scan_stack_type &scan_stack,
-                              ThreadContext &thd_ctx, bool read_own) const;
+                              ThreadContext &thd_ctx, bool read_own);
 
   uint32_t get_key_length(uint32_t idx) {
     return indexes_[idx]->get_key_length();
   }
 
+  uint32_t get_index_num() const { return indexes_.size(); }
+
+  /**
+  @brief
+    number of version chain head blocks, the id of next block allocated
+  */
+  uint32_t get_vchain_head_block_num() const {
+    return next_vchain_head_block_id_.load();
+  }
+
+  const KeyInfo &get_key_info(uint32_t idx) const {
+    return indexes_[idx]->get_key_info();
+  }
+
+  /**
+  @brief
+    build the key of the entry of a record in index [idx] to key_data,
+    which must be able to hold DB20XX_MAX_INDEX_KEY_LENGTH bytes
+  */
+  void build_key(uint32_t idx, Record *record, Key &key, char *key_data,
+                 ThreadContext *thd_ctx) {
+    indexes_[idx]->build_key(get_full_payload(record, thd_ctx), key,
+                             key_data);
+    key = indexes_[idx]->build_entry_key(key, record->get_vchain_head(),
+                                         key_data);
+  }
+
+  /**
+  @brief
+    build the key of index [idx] from the first part_num parts of a key in
+    mysql key format to key_data
+  */
+  void build_key_from_key_tuple(uint32_t idx, const char *tuple,
+                                uint32_t part_num, Key &key, char *key_data) {
+    indexes_[idx]->build_key_from_key_tuple(tuple, part_num, key, key_data);
+  }
+
+  uint32_t get_max_entry_key_length(uint32_t idx) const {
+    return indexes_[idx]->get_max_entry_key_length();
+  }
+
+  /**
+  @brief
+    search rows whose key of index [idx] is prefixed by [key], in key order.
+    With full_key set, [key] is a whole key and only rows carrying exactly
+    that key are returned, which are many for a non-unique index.
+  */
   int index_prefix_key_search(uint32_t idx, const Key &key, Record *&record,
-                               scan_stack_type &scan_stack,
-                               ThreadContext &thd_ctx, bool read_own) const;
+                              scan_stack_type &scan_stack,
+                              ThreadContext &thd_ctx, bool read_own,
+                              bool full_key = false);
 
   int index_prefix_search_next(uint32_t idx, const Key &key, Record *&record,
-                                scan_stack_type &scan_stack,
-                                ThreadContext &thd_ctx, bool read_own) const;
+                               scan_stack_type &scan_stack,
+                               ThreadContext &thd_ctx, bool read_own,
+                               bool full_key = false);
+
+  /**
+  @brief
+    whether the entry entry_key of index [idx] belongs to the search of
+    [key], see index_prefix_key_search()
+  */
+  bool entry_has_key(uint32_t idx, const Key &entry_key, const Key &key,
+                     bool full_key) const;
+
+  //=======================Statistics==================================
+  void get_table_stats(TableStats &stats) const;
+  /**
+  @brief
+    estimate the number of rows whose key of index [idx] falls between
+    min_key and max_key, nullptr means unbounded.
+  */
+  double records_in_range(uint32_t idx, const Key *min_key, bool include_min,
+                          const Key *max_key, bool include_max) const;
+  /**
+  @brief
+    estimate rows per distinct value of every key prefix of index [idx],
+    0 means unknown. Caller must be inside an index epoch.
+  */
+  void get_rec_per_key(uint32_t idx, std::vector<double> &rec_per_key,
+                       ThreadContext *thd_ctx);
+  void add_record_num(int64_t delta) {
+    record_num_.fetch_add(delta, std::memory_order_relaxed);
+  }
+  void add_deleted_version_num(int64_t delta) {
+    deleted_version_num_.fetch_add(delta, std::memory_order_relaxed);
+  }
+  /**
+  @brief
+    exact number of rows visible to the transaction of thd_ctx. It is the
+    committed row counter if no transaction is modifying the table and
+    every committed modification is visible to us, otherwise the visible
+    version chains are counted block by block.
+  */
+  int count_records(uint64_t &count, bool read_own, ThreadContext *thd_ctx);
+  /**
+  @brief
+    a transaction starts or finishes modifying the table, commit_id is
+    INVALID_TRANSACTION_ID if it aborts.
+  */
+  void register_writer() {
+    active_writer_num_.fetch_add(1, std::memory_order_acq_rel);
+  }
+  void unregister_writer(uint64_t commit_id);
+
+  //=======================Recovery====================================
+  /**
+  @brief
+    install a committed version, deserialized from data, as the only
+    version of the version chain at [block_id, idx_in_block].
+    Recovery of a table is single threaded, the replaced version is freed
+    at once.
+  @return
+    the recovered version chain
+  */
+  VersionChainHead *recover_version(uint32_t block_id, uint32_t idx_in_block,
+                                    const char *&data, ThreadContext *thd_ctx);
+  /**
+  @brief
+    the version chain at [block_id, idx_in_block] has been deleted
+  */
+  void recover_delete(uint32_t block_id, uint32_t idx_in_block,
+                      ThreadContext *thd_ctx);
+  /**
+  @brief
+    make sure vchain head blocks [0, block_num) exist, chains deleted
+    before a checkpoint leave their blocks empty in the checkpoint.
+  */
+  void reserve_recovered_vchain_head_blocks(uint32_t block_num);
+  /**
+  @brief
+    insert every recovered version chain to indexes
+  */
+  void build_recovered_indexes(ThreadContext *thd_ctx);
+
+  //=======================Bulk insert=================================
+  /**
+  @brief
+    the thread is going to insert many rows, rows is an estimate, 0 if
+    unknown. Blocks for the rows are reserved at once, and entries of
+    non-unique indexes are buffered until end_bulk_insert() puts them in
+    key order. Unique indexes, nullable ones included, are still put row
+    by row, they detect duplicate keys.
+    Rows inserted meanwhile are not found through the non-unique indexes,
+    the caller must not read them by those indexes before the end.
+  */
+  void start_bulk_insert(uint64_t rows, ThreadContext *thd_ctx);
+  void end_bulk_insert(ThreadContext *thd_ctx);
+
+  //=======================Allocation==================================
+  /**
+  @brief
+    the thread is going away, put its partially used blocks and its arena
+    back to the pools and its cached free record slots back to the table.
+  */
+  void release_allocator(TableAllocator &allocator);
 
  private:
   /**
@@ -131,44 +478,237 @@ class Table {
     location to the record
   */
   int alloc_record(Record *&record, ThreadContext *thd_ctx);
-  // FIXME: use per-thread allocator
+  /**
+  @brief
+    allocate an initialized version chain head from the block owned by
+    the thread
+  */
+  VersionChainHead *alloc_vchain_head(ThreadContext *thd_ctx);
+  bool position_scan_cursor(TableScanCursor &scan_cursor);
+  /**
+  @brief
+    called by garbage collector when no running transaction can see the
+    record anymore: unlink it from its version chain, release its
+    out-of-line data and put the slot to the free list.
+    A dead latest version (aborted or deleted insert) keeps its slot.
+  @return
+    false if the record can not be reclaimed yet
+  */
+  bool reclaim_record(Record *record, ThreadContext *thd_ctx);
+  /**
+  @brief
+    whole row of a record, a delta version is materialized in the payload
+    container of thd_ctx, valid until the container is used again.
+  */
+  const char *get_full_payload(Record *record, ThreadContext *thd_ctx) {
+    return record->get_full_payload(
+        schema_,
+        thd_ctx->get_payload_container(schema_.get_record_data_length()));
+  }
+  /**
+  @brief
+    allocate a delta version of base storing the columns mysql_record
+    changes, see RecordHeader::delta_.
+  @return
+    nullptr if base is a delta version itself, or the changed columns take
+    more than DELTA_VERSION_MAX_PERCENT of a full payload
+  */
+  Record *create_delta_version(Record *base, const char *mysql_record,
+                               ThreadContext *thd_ctx);
+  void free_delta_version(Record *record);
+  /**
+  @brief
+    replace the latest version of a chain, a committed delta version, with
+    a full copy so that its base can be reclaimed. The delta version is
+    retired.
+  */
+  void consolidate_delta_version(Record *record, ThreadContext *thd_ctx);
+  /**
+  @brief
+    remove the keys of a reclaimed version which no remaining version of
+    its chain carries.
+  @return
+    false if the chain is owned by a running transaction, try later.
+  */
+  bool remove_dead_keys(Record *record, ThreadContext *thd_ctx);
+  /**
+  @brief
+    read the version chain found in index, a version that does not carry
+    the key it is found under is reported as DB20XX_KEY_NOT_EXIST.
+  */
+  int read_indexed_vchain(uint32_t idx, const Key &key,
+                          VersionChainHead *vchain_head, Record *&record,
+                          ThreadContext &thd_ctx, bool read_own);
+  bool version_has_key(uint32_t idx, Record *record, const Key &key,
+                       ThreadContext *thd_ctx);
+  int check_nullable_unique_key(uint32_t idx, const char *mysql_record,
+                                VersionChainHead *vchain_head,
+                                ThreadContext *thd_ctx);
+  void free_record(Record *record);
+  /**
+  @brief
+    move up to FREE_RECORD_BATCH reclaimed slots to the allocator of a
+    thread
+  */
+  void take_free_records(TableAllocator &allocator);
+  /**
+  @brief
+    a block with free slots for a thread that has filled its block, a
+    partially used block left by an exited thread is preferred.
+  */
+  RecordBlock *acquire_record_block();
+  VersionChainHeadBlock *acquire_vchain_head_block();
+  /**
+  @brief
+    an arena for a thread writing out-of-line data for the first time, one
+    left by an exited thread is preferred so its current chunk fills up
+  */
+  VarlenArena *acquire_varlen_arena();
+  /**
+  @brief
+    next block of a thread that has filled its block, blocks reserved by a
+    bulk insert go first
+  */
+  RecordBlock *next_record_block(TableAllocator &allocator);
+  VersionChainHeadBlock *next_vchain_head_block(TableAllocator &allocator);
+  /**
+  @brief
+    put reserved blocks the thread has not used to the block pool
+  */
+  void release_reserved_blocks(TableAllocator &allocator);
+  /**
+  @brief
+    put the deferred entries of buffer to the indexes in key order and
+    empty it
+  */
+  void flush_bulk_insert(BulkInsertBuffer &buffer, ThreadContext *thd_ctx);
   RecordBlock *alloc_record_block();
-  // FIXME: use per-thread allocator
   VersionChainHeadBlock *alloc_vchain_head_block();
   void add_record_block(RecordBlock *block);
   void add_vchain_head_block(VersionChainHeadBlock *block);
+  /**
+  @brief
+    nullptr if the block id is allocated but the block is not published
+    yet
+  */
   RecordBlock *get_record_block(uint32_t block_id);
   VersionChainHeadBlock *get_vchain_head_block(uint32_t block_id);
+  VersionChainHead *get_recovered_vchain_head(uint32_t block_id,
+                                              uint32_t idx_in_block);
+  void remove_replaced_keys(Record *replaced, Record *record,
+                            ThreadContext *thd_ctx);
+  /**
+  @brief
+    store the latest committed version of a chain of a columnar table to
+    its column block, called by a committing transaction before it leaves
+    its epoch. payload_container holds a delta version materialized.
+  */
+  void store_columns(Record *record, std::string &payload_container);
+  /**
+  @brief
+    the visible version of a chain read by a column scan is the latest
+    one, store it to the column block unless a writer is storing a newer
+    one. Recovered versions are stored this way.
+  */
+  void fill_columns(VersionChainHead *vchain_head, Record *record,
+                    bool deleted, ThreadContext *thd_ctx);
+  ColumnBlock *get_column_block(uint32_t block_id) const {
+    return column_blocks_.get(block_id);
+  }
 
   /**
   @brief
-    initialize block writers, each thread delegate its write operation
-    to a block writer with index = thread_id % PARALLEL_WRITER_NUM.
+    arena of out-of-line VARCHAR/BLOB data written by the thread, owned by
+    its allocator like its blocks, see TableAllocator.
   */
-  void init_record_allocators();
-  void init_vchain_head_allocators();
+  VarlenArena &get_varlen_arena(ThreadContext *thd_ctx) {
+    TableAllocator &allocator = thd_ctx->get_table_allocator(this);
+    if (allocator.varlen_arena_ == nullptr)
+      allocator.varlen_arena_ = acquire_varlen_arena();
+    return *allocator.varlen_arena_;
+  }
+
+  /**
+  @brief
+    estimate rows per distinct key prefix of index [idx] from runs of
+    adjacent live keys spread over the index, caller must be inside a
+    transaction
+  */
+  void sample_rec_per_key(uint32_t idx, std::vector<double> &rec_per_key,
+                          ThreadContext *thd_ctx);
+  bool sample_entry_is_live(uint32_t idx, const Key &entry_key,
+                            VersionChainHead *vchain_head,
+                            ThreadContext *thd_ctx);
+  bool get_sample_start_key(uint32_t idx, uint64_t position, Key &key,
+                            ThreadContext *thd_ctx);
 
  private:
   // static members
-  static const uint32_t PARALLEL_WRITER_NUM = 16;
+  // a delta version larger than this percentage of a full payload is not
+  // worth the extra read cost, a full version is stored instead
+  static const uint32_t DELTA_VERSION_MAX_PERCENT = 50;
+  // reclaimed record slots a thread takes from the table at a time
+  static const uint32_t FREE_RECORD_BATCH = 64;
+  // keys read to estimate rec_per_key
+  static const uint32_t STATS_SAMPLE_KEY_NUM = 1024;
+  // runs the sampled keys are read in, each from a different position
+  static const uint32_t STATS_SAMPLE_RUN_NUM = 256;
+  // table scan prefetches the record of the entry this far ahead
+  static const uint32_t SCAN_PREFETCH_DISTANCE = 8;
+  // keys whose lookups multi_get_records_from_index() overlaps
+  static const uint32_t MULTI_GET_GROUP_SIZE = 16;
+  // deferred index entries are put once a bulk insert buffers this many
+  static const uint64_t BULK_INSERT_BUFFER_ENTRIES = 1 << 20;
+  // blocks of each kind a bulk insert reserves at most
+  static const uint32_t BULK_INSERT_MAX_RESERVED_BLOCKS = 64;
 
  private:
   // table metadata
   std::string table_name_;
   Schema schema_;
+  // identify the table in redo log
+  uint32_t table_id_ = 0;
 
   // table storage
   std::atomic<uint32_t> next_record_block_id_ = 0;
-  const uint32_t DEFAULT_RECORDS_PER_BLOCK = 1024;
-  uint32_t records_in_block_ = DEFAULT_RECORDS_PER_BLOCK;
-  CuckooMap<uint32_t, RecordBlock *> record_blocks_;
-  std::array<RecordBlock *, PARALLEL_WRITER_NUM> record_allocators_;
+  const uint32_t records_in_block_;
+  BlockDirectory<RecordBlock> record_blocks_;
+  // partially used blocks left by exited threads, see TableAllocator
+  Latch block_pool_latch_;
+  std::vector<RecordBlock *> record_block_pool_;
+  std::vector<VersionChainHeadBlock *> vchain_head_block_pool_;
+  std::atomic<uint32_t> pooled_block_num_ = 0;
+  // record slots reclaimed by garbage collector
+  Latch free_records_latch_;
+  std::vector<Record *> free_records_;
+  std::atomic<uint32_t> free_record_num_ = 0;
+  // arenas of all threads, and those left by exited threads, protected by
+  // block_pool_latch_
+  std::vector<std::unique_ptr<VarlenArena>> varlen_arenas_;
+  std::vector<VarlenArena *> varlen_arena_pool_;
+  // column blocks of a columnar table, block i copies vchain head block i
+  const StorageLayout storage_layout_;
+  ColumnLayout column_layout_;
+  BlockDirectory<ColumnBlock> column_blocks_;
 
   // index
   std::vector<MasstreeIndex *> indexes_;
   std::atomic<uint32_t> next_vchain_head_block_id_ = 0;
-  CuckooMap<uint32_t, VersionChainHeadBlock *> vchain_head_blocks_;
-  std::array<VersionChainHeadBlock *, PARALLEL_WRITER_NUM>
-      vchain_head_allocators_;
+  BlockDirectory<VersionChainHeadBlock> vchain_head_blocks_;
+
+  // statistics
+  std::atomic<int64_t> record_num_ = 0;
+  std::atomic<int64_t> deleted_version_num_ = 0;
+  // running transactions that have modified the table
+  std::atomic<int64_t> active_writer_num_ = 0;
+  // largest id of the transactions that committed to the table
+  std::atomic<uint64_t> last_commit_id_ = 0;
+  // rec_per_key of every index, resampled when the table has changed a lot
+  struct IndexStats {
+    std::vector<double> rec_per_key_;
+    int64_t sampled_record_num_ = -1;
+  };
+  std::mutex index_stats_lock_;
+  std::vector<IndexStats> index_stats_;
 };
 }  // namespace db20xx
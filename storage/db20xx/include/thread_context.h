@@ -1,12 +1,46 @@
 #pragma once
+#include <unordered_map>
+#include <vector>
 #include "masstree-beta/kvthread.hh"
+#include "epoch.h"
+#include "gc.h"
 #include "transaction.h"
+#include "varlen_arena.h"
 
 namespace db20xx {
 
 using namespace Masstree;
 typedef threadinfo threadinfo_type;
 
+class BulkInsertBuffer;
+class Record;
+class RecordBlock;
+class Table;
+class VersionChainHeadBlock;
+
+/**
+ *@brief
+ *  Blocks a thread allocates record slots and version chain heads of a
+ *  table from, and its arena of out-of-line data. They are owned by the
+ *  thread, so slots are handed out without atomics, see
+ *  Table::alloc_record().
+ */
+struct TableAllocator {
+  RecordBlock *record_block_ = nullptr;
+  VersionChainHeadBlock *vchain_head_block_ = nullptr;
+  // record slots reclaimed by garbage collector, taken from the table in
+  // batches
+  std::vector<Record *> free_records_;
+  // blocks reserved by a bulk insert, taken before new blocks
+  std::vector<RecordBlock *> reserved_record_blocks_;
+  std::vector<VersionChainHeadBlock *> reserved_vchain_head_blocks_;
+  // entries deferred by a bulk insert of the thread, nullptr outside one,
+  // see Table::start_bulk_insert()
+  BulkInsertBuffer *bulk_insert_ = nullptr;
+  // out-of-line data of the thread, taken on its first VARCHAR/BLOB value
+  VarlenArena *varlen_arena_ = nullptr;
+};
+
 class ThreadContext {
   friend class Table;
   //friend class Index;
@@ -14,14 +48,54 @@ class ThreadContext {
   friend class ha_db20xx;
 
  public:
-  ThreadContext(uint64_t thread_id) : thread_id_(thread_id) {
-    ti_ = threadinfo::make(threadinfo::TI_PROCESS, thread_id);
-  }
-  ~ThreadContext() {}
+  ThreadContext(uint64_t thread_id);
+  ~ThreadContext();
   threadinfo *get_threadinfo() const { return ti_; }
   uint64_t get_thread_id() { return thread_id_; }
   TransactionContext *get_transaction_context() { return &txn_ctx_; }
   char *get_key_container() { return key_container_; }
+  char *get_check_key_container() { return check_key_container_; }
+  /**
+   *@brief scratch buffer holding a copy of a record payload
+   */
+  char *get_payload_container(uint32_t length) {
+    if (payload_container_.size() < length) payload_container_.resize(length);
+    return &payload_container_[0];
+  }
+
+  /**
+   *@brief
+   *  allocator of the thread for table, its blocks go back to the table
+   *  when the thread context is destroyed
+   */
+  TableAllocator &get_table_allocator(Table *table) {
+    return table_allocators_[table];
+  }
+
+  /**
+   *@brief
+   *  Masstree frees a retired node once every threadinfo has left the
+   *  masstree epoch in which the node was retired. A thread stays in the
+   *  epoch while it runs a transaction, and moves to the current epoch at
+   *  statement boundaries.
+   */
+  void enter_index_epoch() { ti_->rcu_start(); }
+  void refresh_index_epoch() { ti_->rcu_quiesce(); }
+  void exit_index_epoch() { ti_->rcu_stop(); }
+
+  /**
+   *@brief advance masstree's global epoch, called by the epoch advancer
+   */
+  static void advance_index_epoch();
+
+ private:
+  /**
+   *@brief
+   *  threadinfo can not be destroyed, it is returned to a pool when the
+   *  connection goes away and reused by the next one.
+   */
+  static threadinfo *acquire_threadinfo(uint64_t thread_id);
+  static void release_threadinfo(threadinfo *ti);
 
  private:
   // logic thread id, get from mysql:current_thd->thread_id()
@@ -30,7 +104,16 @@ class ThreadContext {
   TransactionContext txn_ctx_;
 
   // avoid malloc when build temporary index key
-  char key_container_[DB20XX_MAX_KEY_LENGTH];
+  char key_container_[DB20XX_MAX_INDEX_KEY_LENGTH];
+  // key built from a record version to check against a key that may
+  // occupy key_container_
+  char check_key_container_[DB20XX_MAX_INDEX_KEY_LENGTH];
+  std::string payload_container_;
+  std::unordered_map<Table *, TableAllocator> table_allocators_;
+
+  // idle threadinfos, also protects threadinfo::allthreads
+  static std::mutex threadinfo_pool_lock_;
+  static std::vector<threadinfo *> threadinfo_pool_;
 };
 
 }  // namespace db20xx
@@ -3,9 +3,11 @@
 #include <sys/types.h>
 #include <cassert>
 #include <cstdint>
-#include <unordered_set>
+#include <unordered_map>
+#include <vector>
 #include "data_types.h"
 #include "epoch.h"
+#include "gc.h"
 #include "record.h"
 #include "record_block.h"
 #include "return_status.h"
@@ -18,10 +20,37 @@ class ThreadContext;
 
 class TransactionContext {
   friend class Table;
+  friend class GarbageCollector;
+  friend class LogManager;
  public:
   bool on_going();
   void begin_transaction(uint64_t thread_id);
 
+  /**
+   * @brief
+   *   begin a read-only transaction reading as of the snapshot below the
+   *   minimum epoch of read-write transactions. Every transaction in the
+   *   snapshot has finished, so versions are read without the header latch
+   *   and without updating last_read_ts_, such reads never retry and never
+   *   abort writers.
+   * @return
+   *   false if the snapshot misses the last commit of this context or lags
+   *   too far behind, the caller begins a regular transaction instead
+   */
+  bool begin_read_only_transaction(uint64_t thread_id);
+
+  /**
+   * @brief
+   *   read as of the snapshot of a running transaction on another thread,
+   *   e.g. in a parallel scan worker. Reads only, the running transaction
+   *   keeps its epoch so that nothing it can see is reclaimed.
+   */
+  void begin_snapshot_read(uint64_t snapshot_transaction_id,
+                           uint64_t thread_id, bool read_only);
+  void end_snapshot_read();
+  uint64_t get_transaction_id() const { return transaction_id_; }
+  bool is_read_only() const { return read_only_; }
+
   void mvto_insert(Record *record, VersionChainHead *vchain_head, Table *table, ThreadContext *thd_ctx);
   int mvto_update(Record *old_record, char *new_mysql_record, Table *table,
                   ThreadContext *thd_ctx);
@@ -29,10 +58,12 @@ class TransactionContext {
 
   /**
    * @args
-   *   @arg3 record[output] get a version visible to current transaction
+   *   @arg1 table the table that the version chain belongs to
+   *   @arg4 record[output] get a version visible to current transaction
    */
-  int mvto_read_version_chain(VersionChainHead &version_head, bool read_own,
-                              Record *&record);
+  int mvto_read_version_chain(Table *table, VersionChainHead &version_head,
+                              bool read_own, Record *&record);
+  LocalEpochManager *get_local_epoch() { return &local_epoch_; }
   int get_transaction_status();
   void set_abort();
   int commit();
@@ -41,19 +72,45 @@ class TransactionContext {
  private:
   void update_last_read_ts_if_need(Record *record);
   int mvto_read_vchain_unown(VersionChainHead &vchain_head, Record *&record);
-  int mvto_read_vchain_own(VersionChainHead &vchain_head, Record *&record);
+  int mvto_read_vchain_snapshot(VersionChainHead &vchain_head,
+                                Record *&record);
+  int mvto_read_vchain_own(Table *table, VersionChainHead &vchain_head,
+                           Record *&record);
   void reset();
-  void add_to_modify_set(Record *record);
+  void add_to_modify_set(Record *record, Table *table);
+  void retire_record(Table *table, Record *record);
 
  private:
   bool started_ = false;
   bool should_abort_ = false;
+  // a read-only transaction, transaction_id_ is its snapshot
+  bool read_only_ = false;
   uint64_t transaction_id_ = 0;
   uint64_t epoch_id_ = 0;
+  // id of the last transaction of this context that committed changes, a
+  // read-only snapshot must include it
+  uint64_t last_commit_id_ = 0;
   uint64_t thread_id_ = 0;
 
   // TODO: rename to txn_own_set_;
-  std::unordered_set<Record *> txn_modify_set_;
+  // owned record -> table it belongs to
+  std::unordered_map<Record *, Table *> txn_modify_set_;
+  // tables in txn_modify_set_
+  std::vector<Table *> txn_tables_;
+
+  // epoch of the running transaction, used to compute transaction ids
+  // and the minimum active epoch
+  LocalEpochManager local_epoch_;
+
+  // versions retired by committed/aborted transactions of this context,
+  // drained by the garbage collector
+  Latch retired_records_latch_;
+  std::vector<RetiredRecord> retired_records_;
+
+  // redo log of the committing transaction, reused across transactions
+  std::string log_buffer_;
+  // full payload of a delta version stored to a column block
+  std::string column_payload_;
 };
 
 }  // namespace db20xx
@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include "./utils.h"
+
+namespace db20xx {
+
+/**
+@brief
+  Bump allocator of out-of-line VARCHAR/BLOB values. Each thread writing
+  a table owns an arena, so values are allocated without a latch; the
+  arena of an exited thread is handed to the next one.
+
+  Values are carved from CHUNK_SIZE aligned chunks, the chunk of a value is
+  found by masking its address, so values carry no header. A chunk counts
+  the references to its values plus one held by the arena while it
+  allocates from the chunk, the chunk is freed when the count drops to 0.
+  A value larger than LARGE_VALUE_LENGTH gets an aligned chunk of its own.
+
+  A non-inline field is stored in payload as
+  [length bytes | pointer to actual data], values not longer than the
+  pointer are kept in the pointer slot itself and take no arena space.
+*/
+class VarlenArena {
+ public:
+  static const uint32_t CHUNK_SIZE = 64 * 1024;
+  static const uint32_t LARGE_VALUE_LENGTH = CHUNK_SIZE / 4;
+  static const uint32_t INLINE_LENGTH = sizeof(char *);
+
+  VarlenArena() = default;
+  VarlenArena(const VarlenArena &) = delete;
+  VarlenArena &operator=(const VarlenArena &) = delete;
+  ~VarlenArena();
+
+  /**
+  @brief
+    store a value of length bytes to the pointer slot of a field
+  */
+  void store(char *slot, const char *data, uint32_t length) {
+    if (length <= INLINE_LENGTH) {
+      memcpy(slot, data, length);
+      return;
+    }
+    char *actual_data = alloc(length);
+    memcpy(actual_data, data, length);
+    *reinterpret_cast<char **>(slot) = actual_data;
+  }
+
+  /**
+  @brief
+    data of the value stored in a pointer slot
+  */
+  static const char *get_data(const char *slot, uint32_t length) {
+    if (length <= INLINE_LENGTH) return slot;
+    return *reinterpret_cast<char *const *>(slot);
+  }
+
+  /**
+  @brief
+    the value stored in a pointer slot gets one more referencing version
+  */
+  static void share(const char *slot, uint32_t length) {
+    if (length <= INLINE_LENGTH) return;
+    get_chunk(get_data(slot, length))
+        ->ref_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+  @brief
+    drop the reference of a version to the value stored in a pointer slot
+  */
+  static void release(const char *slot, uint32_t length) {
+    if (length <= INLINE_LENGTH) return;
+    release_chunk(get_chunk(get_data(slot, length)));
+  }
+
+  /**
+  @brief
+    allocate length bytes aligned to align, which must be a power of 2 not
+    larger than 8. The memory is returned by release_data().
+  */
+  char *alloc(uint32_t length, uint32_t align = 1);
+  static void release_data(const char *data) {
+    release_chunk(get_chunk(data));
+  }
+
+ private:
+  struct Chunk {
+    std::atomic<uint32_t> ref_count_;
+    uint32_t used_;
+    uint32_t capacity_;
+    alignas(8) char data_[0];
+  };
+
+  static Chunk *new_chunk(uint32_t capacity, uint32_t ref_count);
+  static void release_chunk(Chunk *chunk);
+  static Chunk *get_chunk(const char *data) {
+    return reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(data) &
+                                     ~static_cast<uintptr_t>(CHUNK_SIZE - 1));
+  }
+
+ private:
+  Chunk *current_chunk_ = nullptr;
+};
+
+}  // namespace db20xx
@@ -9,7 +9,6 @@ class TableScanCursor;
 
 class VersionChainHead {
  public:
-  char *get_latest_record_payload();
   void set_latest_record(Record *latest_record);
   void init();
 
@@ -17,21 +16,48 @@ class VersionChainHead {
   Record *latest_record_;
 };
 
+/**
+ * A VersionChainHeadBlock occupies exactly BLOCK_SIZE bytes and is allocated
+ * with BLOCK_SIZE alignment, so the block (and the location) of a version
+ * chain can be derived from the address of its head.
+ */
 class VersionChainHeadBlock {
   friend class Table;
+  friend class Checkpointer;
 
  public:
+  /**
+   * @brief
+   *   hand out the next entry. Only the thread owning the block writes
+   *   valid_entry_num_, scanners read it to find the initialized entries.
+   */
   int alloc_vchain_head(VersionChainHead *&vchain_head);
-  bool is_last_vchain_head(VersionChainHead *vchain_head);
+  bool is_full() const {
+    return valid_entry_num_.load(std::memory_order_relaxed) >= ENTRY_CAPACITY;
+  }
   VersionChainHead *get_vchain_head(TableScanCursor *scan_cursor);
+  uint32_t get_block_id() const { return block_id_; }
+
+  static VersionChainHeadBlock *get_block(VersionChainHead *vchain_head) {
+    return reinterpret_cast<VersionChainHeadBlock *>(
+        reinterpret_cast<uintptr_t>(vchain_head) & ~(uintptr_t)(BLOCK_SIZE - 1));
+  }
+  static uint32_t get_idx_in_block(VersionChainHead *vchain_head) {
+    return vchain_head - get_block(vchain_head)->entries_;
+  }
 
  public:
-  static const uint32_t ENTRY_CAPACITY = 1024;
+  static const uint32_t BLOCK_SIZE = 8192;
+  static const uint32_t ENTRY_CAPACITY =
+      (BLOCK_SIZE - 2 * sizeof(uint32_t)) / sizeof(VersionChainHead);
 
  private:
   uint32_t block_id_ = 0;
   std::atomic<uint32_t> valid_entry_num_ = 0;
   VersionChainHead entries_[ENTRY_CAPACITY];
 };
+static_assert(sizeof(VersionChainHeadBlock) ==
+                  VersionChainHeadBlock::BLOCK_SIZE,
+              "VersionChainHeadBlock must fill its aligned block");
 
 }  // namespace db20xx
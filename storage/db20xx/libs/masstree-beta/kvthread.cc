@@ -30,9 +30,9 @@ threadinfo *threadinfo::allthreads;
 int threadinfo::no_pool_value;
 #endif
 
-//FIXME: 当前为了通过链接,错误地使用了RCU
-volatile mrcu_epoch_type globalepoch = 0;  // global epoch, updated regularly
-volatile mrcu_epoch_type active_epoch = 0;
+// advanced by db20xx::ThreadContext::advance_index_epoch()
+volatile mrcu_epoch_type globalepoch = 1;  // global epoch, updated regularly
+volatile mrcu_epoch_type active_epoch = 1;
 
 inline threadinfo::threadinfo(int purpose, int index) {
     gc_epoch_ = perform_gc_epoch_ = 0;
@@ -0,0 +1,330 @@
+#include "checkpoint.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include "log_manager.h"
+#include "message_logger.h"
+#include "record.h"
+#include "table.h"
+#include "thread_context.h"
+#include "version_chain.h"
+
+namespace db20xx {
+
+std::string Checkpointer::log_dir_;
+std::mutex Checkpointer::checkpoint_lock_;
+std::atomic<uint64_t> Checkpointer::last_checkpoint_lsn_ = 0;
+LocalEpochManager Checkpointer::local_epoch_;
+std::thread Checkpointer::checkpoint_thread_;
+std::mutex Checkpointer::checkpoint_thread_lock_;
+std::condition_variable Checkpointer::checkpoint_thread_cv_;
+bool Checkpointer::checkpoint_thread_running_ = false;
+
+static void pwrite_fully(int fd, const void *data, uint64_t len,
+                         uint64_t offset) {
+  if (::pwrite(fd, data, len, offset) != (ssize_t)len) {
+    LOG_ERROR("write checkpoint failed, errno:%d", errno);
+    exit(1);
+  }
+}
+
+static void corrupted_checkpoint(const std::string &path) {
+  LOG_ERROR("checkpoint %s is corrupted, can not recover", path.c_str());
+  exit(1);
+}
+
+//======================checkpoint thread============================
+void Checkpointer::start(const std::string &log_dir) {
+  std::lock_guard<std::mutex> guard(checkpoint_thread_lock_);
+  if (checkpoint_thread_running_ || !LogManager::is_enabled()) return;
+  log_dir_ = log_dir;
+  checkpoint_thread_running_ = true;
+  checkpoint_thread_ = std::thread(checkpoint_loop);
+}
+
+void Checkpointer::stop() {
+  {
+    std::lock_guard<std::mutex> guard(checkpoint_thread_lock_);
+    if (!checkpoint_thread_running_) return;
+    checkpoint_thread_running_ = false;
+  }
+  checkpoint_thread_cv_.notify_all();
+  checkpoint_thread_.join();
+}
+
+void Checkpointer::checkpoint_loop() {
+  std::unique_lock<std::mutex> lock(checkpoint_thread_lock_);
+  while (checkpoint_thread_running_) {
+    checkpoint_thread_cv_.wait_for(
+        lock, std::chrono::milliseconds(CHECK_INTERVAL_MS));
+    if (!checkpoint_thread_running_) break;
+
+    uint64_t log_growth =
+        LogManager::get_buffered_lsn() - last_checkpoint_lsn_.load();
+    if (log_growth < CHECKPOINT_LOG_GROWTH) continue;
+    lock.unlock();
+    checkpoint();
+    lock.lock();
+  }
+}
+
+//======================taking checkpoint============================
+bool Checkpointer::checkpoint() {
+  std::lock_guard<std::mutex> guard(checkpoint_lock_);
+  if (!LogManager::is_enabled()) return false;
+
+  uint64_t checkpoint_lsn = LogManager::get_buffered_lsn();
+  wait_for_running_transactions();
+
+  std::vector<LoggedTable> tables;
+  {
+    std::lock_guard<std::mutex> tables_guard(LogManager::tables_lock_);
+    for (auto &logged : LogManager::tables_) tables.push_back(logged.second);
+  }
+  uint32_t next_table_id = LogManager::next_table_id_.load();
+
+  std::string path = log_dir_ + "/" + CHECKPOINT_FILE_NAME;
+  std::string tmp_path = path + ".tmp";
+  int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+  if (fd < 0) {
+    LOG_ERROR("open checkpoint %s failed, errno:%d", tmp_path.c_str(), errno);
+    return false;
+  }
+
+  GlocalEpochManager::register_local_epoch(&local_epoch_);
+  uint64_t file_offset = sizeof(CheckpointFileHeader);
+  for (auto &logged : tables)
+    write_table(fd, file_offset, logged.db_name_, logged.table_);
+  GlocalEpochManager::unregister_local_epoch(&local_epoch_);
+
+  // the copy may contain versions committed after checkpoint_lsn, their
+  // log must be durable before the checkpoint is, otherwise a transaction
+  // could be recovered partially
+  LogManager::wait_for_flush(LogManager::get_buffered_lsn(), true);
+
+  CheckpointFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic_ = CHECKPOINT_MAGIC;
+  header.table_num_ = tables.size();
+  header.checkpoint_lsn_ = checkpoint_lsn;
+  header.next_table_id_ = next_table_id;
+  header.checksum_ = LogManager::compute_checksum(
+      (const char *)&header, offsetof(CheckpointFileHeader, checksum_));
+  pwrite_fully(fd, &header, sizeof(header), 0);
+  if (::fdatasync(fd) != 0) {
+    LOG_ERROR("sync checkpoint failed, errno:%d", errno);
+    exit(1);
+  }
+  ::close(fd);
+
+  if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_ERROR("rename checkpoint failed, errno:%d", errno);
+    return false;
+  }
+  int dir_fd = ::open(log_dir_.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dir_fd >= 0) {
+    ::fsync(dir_fd);
+    ::close(dir_fd);
+  }
+
+  LogManager::discard_log_before(checkpoint_lsn);
+  last_checkpoint_lsn_.store(checkpoint_lsn);
+  LOG_INFO("checkpoint taken at lsn:%lu, tables:%lu", checkpoint_lsn,
+           tables.size());
+  return true;
+}
+
+/**
+ *@brief
+ *  A transaction appends its log before installing its versions. Once the
+ *  minimum active epoch passes the current one, every transaction whose log
+ *  is before the current lsn has installed its versions.
+ */
+void Checkpointer::wait_for_running_transactions() {
+  uint64_t epoch_id = GlocalEpochManager::get_current_global_epoch_id();
+  while (GlocalEpochManager::get_min_active_epoch_id() <= epoch_id) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(GlocalEpochManager::EPOCH_LENGTH_MS));
+  }
+}
+
+/**
+ *@brief
+ *  copy the latest committed version of every version chain. A vchain head
+ *  block is copied inside an epoch, so the versions read can not be
+ *  reclaimed meanwhile.
+ */
+void Checkpointer::write_table(int fd, uint64_t &file_offset,
+                               const std::string &db_name, Table *table) {
+  const Schema &schema = table->get_schema();
+  CheckpointTableHeader header;
+  memset(&header, 0, sizeof(header));
+  uint64_t header_offset = file_offset;
+
+  std::string definition;
+  LogManager::serialize_table_definition(db_name, table, definition);
+  header.definition_length_ = definition.size();
+  header.checksum_ =
+      LogManager::compute_checksum(definition.data(), definition.size());
+  ::lseek(fd, header_offset + sizeof(header), SEEK_SET);
+  write_fully(fd, definition.data(), definition.size());
+
+  std::string buf;
+  LogWriter writer(buf);
+  uint32_t block_num = table->next_vchain_head_block_id_.load();
+  for (uint32_t block_id = 0; block_id < block_num; block_id++) {
+    VersionChainHeadBlock *block = table->get_vchain_head_block(block_id);
+    // a block being allocated holds no committed version yet
+    uint32_t entry_num =
+        block == nullptr ? 0
+                         : std::min(block->valid_entry_num_.load(),
+                                    VersionChainHeadBlock::ENTRY_CAPACITY);
+    GlocalEpochManager::enter_epoch(&local_epoch_);
+    for (uint32_t idx = 0; idx < entry_num; idx++) {
+      // latest_record_ always points to a committed version, unless the
+      // version chain is being created by an insert
+      Record *record = block->entries_[idx].latest_record_;
+      if (record == nullptr ||
+          record->get_begin_timestamp() == MAX_TIMESTAMP ||
+          record->get_end_timestamp() == MIN_TIMESTAMP)
+        continue;
+      writer.put_u32(block_id);
+      writer.put_u32(idx);
+      record->serialize_payload(schema, buf);
+      header.entry_num_++;
+    }
+    GlocalEpochManager::exit_epoch(&local_epoch_);
+
+    if (buf.size() >= WRITE_BUFFER_SIZE || block_id + 1 == block_num) {
+      header.checksum_ = LogManager::compute_checksum(buf.data(), buf.size(),
+                                                      header.checksum_);
+      write_fully(fd, buf.data(), buf.size());
+      header.data_length_ += buf.size();
+      buf.clear();
+    }
+  }
+
+  header.vchain_head_block_num_ = block_num;
+  pwrite_fully(fd, &header, sizeof(header), header_offset);
+  file_offset = header_offset + sizeof(header) + header.definition_length_ +
+                header.data_length_;
+}
+
+//======================loading checkpoint===========================
+void Checkpointer::load(const std::string &log_dir, uint64_t &checkpoint_lsn,
+                        ThreadContext *thd_ctx) {
+  checkpoint_lsn = 0;
+  std::string path = log_dir + "/" + CHECKPOINT_FILE_NAME;
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return;  // no checkpoint yet
+
+  struct stat checkpoint_stat;
+  ::fstat(fd, &checkpoint_stat);
+  uint64_t file_size = checkpoint_stat.st_size;
+  if (file_size < sizeof(CheckpointFileHeader)) corrupted_checkpoint(path);
+  void *mapped = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    LOG_ERROR("mmap checkpoint %s failed, errno:%d", path.c_str(), errno);
+    exit(1);
+  }
+  const char *file_data = (const char *)mapped;
+
+  CheckpointFileHeader header;
+  memcpy(&header, file_data, sizeof(header));
+  if (header.magic_ != CHECKPOINT_MAGIC ||
+      header.checksum_ !=
+          LogManager::compute_checksum(
+              file_data, offsetof(CheckpointFileHeader, checksum_)))
+    corrupted_checkpoint(path);
+
+  // create the tables one by one, their contents are loaded in parallel
+  struct LoadJob {
+    Table *table_;
+    CheckpointTableHeader header_;
+    const char *definition_;
+  };
+  std::vector<LoadJob> jobs;
+  uint64_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.table_num_; i++) {
+    LoadJob job;
+    if (offset + sizeof(job.header_) > file_size) corrupted_checkpoint(path);
+    memcpy(&job.header_, file_data + offset, sizeof(job.header_));
+    offset += sizeof(job.header_);
+    job.definition_ = file_data + offset;
+    offset += job.header_.definition_length_ + job.header_.data_length_;
+    if (offset > file_size) corrupted_checkpoint(path);
+
+    // a table definition starts with the table id
+    uint32_t table_id = 0;
+    if (job.header_.definition_length_ < sizeof(table_id))
+      corrupted_checkpoint(path);
+    memcpy(&table_id, job.definition_, sizeof(table_id));
+    LogReader reader(job.definition_, job.header_.definition_length_);
+    if (!LogManager::replay_create_table(reader, thd_ctx))
+      corrupted_checkpoint(path);
+    job.table_ = LogManager::get_logged_table(table_id);
+    jobs.push_back(job);
+  }
+  if (LogManager::next_table_id_.load() < header.next_table_id_)
+    LogManager::next_table_id_.store(header.next_table_id_);
+
+  uint32_t loader_num = std::max(1u, std::thread::hardware_concurrency());
+  loader_num = std::min<uint32_t>(loader_num, jobs.size());
+  // threadinfo::make is not thread safe, create contexts up front
+  std::vector<std::unique_ptr<ThreadContext>> loader_ctxs;
+  for (uint32_t i = 0; i < loader_num; i++)
+    loader_ctxs.emplace_back(new ThreadContext(i + 1));
+
+  std::atomic<uint32_t> next_job{0};
+  std::vector<std::thread> loaders;
+  for (uint32_t i = 0; i < loader_num; i++) {
+    loaders.emplace_back([&, i] {
+      uint32_t job_idx = 0;
+      while ((job_idx = next_job.fetch_add(1)) < jobs.size()) {
+        LoadJob &job = jobs[job_idx];
+        if (!load_table(job.table_, job.header_, job.definition_,
+                        loader_ctxs[i].get()))
+          corrupted_checkpoint(path);
+      }
+    });
+  }
+  for (auto &loader : loaders) loader.join();
+
+  ::munmap(mapped, file_size);
+  ::close(fd);
+  checkpoint_lsn = header.checkpoint_lsn_;
+  last_checkpoint_lsn_.store(checkpoint_lsn);
+  LOG_INFO("checkpoint loaded, lsn:%lu, tables:%u, loaders:%u",
+           checkpoint_lsn, header.table_num_, loader_num);
+}
+
+bool Checkpointer::load_table(Table *table,
+                              const CheckpointTableHeader &header,
+                              const char *definition,
+                              ThreadContext *thd_ctx) {
+  if (LogManager::compute_checksum(
+          definition, header.definition_length_ + header.data_length_) !=
+      header.checksum_)
+    return false;
+
+  table->reserve_recovered_vchain_head_blocks(header.vchain_head_block_num_);
+  LogReader reader(definition + header.definition_length_,
+                   header.data_length_);
+  for (uint64_t i = 0; i < header.entry_num_; i++) {
+    uint32_t block_id = 0, idx_in_block = 0;
+    if (!reader.get_u32(block_id) || !reader.get_u32(idx_in_block) ||
+        idx_in_block >= VersionChainHeadBlock::ENTRY_CAPACITY)
+      return false;
+    // the checksum has been verified, payload is complete
+    table->recover_version(block_id, idx_in_block, reader.cursor(), thd_ctx);
+  }
+  table->build_recovered_indexes(thd_ctx);
+  return true;
+}
+
+}  // namespace db20xx
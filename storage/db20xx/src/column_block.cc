@@ -0,0 +1,223 @@
+#include "column_block.h"
+#include <cstdlib>
+#include <cstring>
+#include "schema.h"
+
+namespace db20xx {
+
+static const uint32_t COLUMN_ALIGNMENT = 64;
+
+static uint32_t align_column(uint32_t offset) {
+  return (offset + COLUMN_ALIGNMENT - 1) & ~(COLUMN_ALIGNMENT - 1);
+}
+
+/**
+@brief
+  load an integer column value mapped to unsigned order, so that a single
+  unsigned zone map serves both signed and unsigned columns
+*/
+static uint64_t load_ordered_value(const char *data, uint32_t length,
+                                   bool is_signed) {
+  uint64_t value = 0;
+  memcpy(&value, data, length);
+  if (!is_signed) return value;
+  uint32_t shift = 64 - length * 8;
+  int64_t signed_value = static_cast<int64_t>(value << shift) >> shift;
+  return static_cast<uint64_t>(signed_value) ^ (uint64_t(1) << 63);
+}
+
+static bool has_zone_map(const Field &field, bool &is_signed) {
+  switch (field.get_field_type()) {
+    case TINYINT_ID:
+    case SMALLINT_ID:
+    case MEDIUMINT_ID:
+    case INT_ID:
+    case BIGINT_ID:
+      is_signed = !field.is_unsigned();
+      return true;
+    case YEAR_ID:
+    case DATE_ID:
+      is_signed = false;
+      return true;
+    default:
+      return false;
+  }
+}
+
+void ColumnLayout::build(const Schema &schema) {
+  columns_.clear();
+  field_columns_.assign(schema.field_num(), -1);
+  zone_num_ = 0;
+  for (uint32_t i = 0; i < schema.field_num(); i++) {
+    const Field &field = schema.get_field(i);
+    if (!field.store_inline()) continue;
+    Column column;
+    column.field_id_ = i;
+    column.offset_in_record_ = field.get_offset_in_record();
+    column.offset_in_mysql_record_ = field.get_offset_in_mysql_record();
+    column.length_ = field.get_data_bytes();
+    column.offset_in_block_ = 0;
+    column.null_offset_ = field.get_null_offset();
+    column.null_mask_ = field.get_null_mask();
+    column.is_signed_ = false;
+    column.zone_ = -1;
+    if (column.length_ <= sizeof(uint64_t) &&
+        has_zone_map(field, column.is_signed_))
+      column.zone_ = zone_num_++;
+    field_columns_[i] = columns_.size();
+    columns_.push_back(column);
+  }
+
+  // stamps, zone maps, null bytes, then the columns in field order
+  uint32_t offset = ColumnBlock::ENTRY_CAPACITY * sizeof(uint64_t) +
+                    zone_num_ * 2 * sizeof(uint64_t);
+  null_byte_length_ = schema.get_null_byte_length();
+  null_bytes_offset_ = align_column(offset);
+  offset =
+      null_bytes_offset_ + ColumnBlock::ENTRY_CAPACITY * null_byte_length_;
+  for (Column &column : columns_) {
+    column.offset_in_block_ = align_column(offset);
+    offset = column.offset_in_block_ +
+             ColumnBlock::ENTRY_CAPACITY * column.length_;
+  }
+  block_size_ = align_column(offset);
+}
+
+int32_t ColumnLayout::find_column(uint32_t offset_in_record) const {
+  for (uint32_t i = 0; i < columns_.size(); i++) {
+    if (columns_[i].offset_in_record_ == offset_in_record) return i;
+  }
+  return -1;
+}
+
+bool ColumnScanPlan::build(const ColumnLayout &layout,
+                           const std::vector<uint32_t> &field_ids,
+                           const Predicate &predicate) {
+  columns_.clear();
+  terms_.clear();
+  for (uint32_t field_id : field_ids) {
+    int32_t column = layout.get_field_column(field_id);
+    if (column < 0) return false;
+    columns_.push_back(column);
+  }
+  for (const Predicate::Term &term : predicate.get_terms()) {
+    int32_t column = layout.find_column(term.offset_);
+    if (column < 0) return false;
+    terms_.push_back(Term{term, static_cast<uint32_t>(column)});
+  }
+  return true;
+}
+
+ColumnBlock *ColumnBlock::create(const ColumnLayout &layout) {
+  void *block_mem = aligned_alloc(COLUMN_ALIGNMENT, layout.get_block_size());
+  memset(block_mem, 0, layout.get_block_size());
+  ColumnBlock *block = static_cast<ColumnBlock *>(block_mem);
+  for (uint32_t i = 0; i < layout.get_zone_num(); i++) {
+    // an empty zone, min > max until a value is stored
+    block->zones()[i].min_.store(UINT64_MAX, std::memory_order_relaxed);
+    block->zones()[i].max_.store(0, std::memory_order_relaxed);
+  }
+  return block;
+}
+
+void ColumnBlock::widen_zone(Zone &zone, uint64_t value) {
+  uint64_t min = zone.min_.load(std::memory_order_relaxed);
+  while (value < min &&
+         !zone.min_.compare_exchange_weak(min, value,
+                                          std::memory_order_relaxed)) {
+  }
+  uint64_t max = zone.max_.load(std::memory_order_relaxed);
+  while (value > max &&
+         !zone.max_.compare_exchange_weak(max, value,
+                                          std::memory_order_relaxed)) {
+  }
+}
+
+bool ColumnBlock::store(const ColumnLayout &layout, uint32_t idx,
+                        const char *payload, uint64_t stamp, bool wait) {
+  std::atomic<uint64_t> &entry_stamp = stamps()[idx];
+  uint64_t old_stamp = entry_stamp.load(std::memory_order_relaxed);
+  while (true) {
+    if (old_stamp & STAMP_LOCKED) {
+      if (!wait) return false;
+      old_stamp = entry_stamp.load(std::memory_order_relaxed);
+      continue;
+    }
+    // a version committed later is stored already
+    if ((old_stamp & STAMP_TIMESTAMP_MASK) > (stamp & STAMP_TIMESTAMP_MASK))
+      return false;
+    if (old_stamp == stamp) return true;
+    if (entry_stamp.compare_exchange_weak(old_stamp, old_stamp | STAMP_LOCKED,
+                                          std::memory_order_relaxed))
+      break;
+  }
+  // readers seeing any of the values below see the locked stamp
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (!(stamp & STAMP_DELETED)) {
+    char *data = const_cast<char *>(data_);
+    uint32_t null_byte_length = layout.get_null_byte_length();
+    memcpy(data + layout.get_null_bytes_offset() + idx * null_byte_length,
+           payload, null_byte_length);
+    for (const ColumnLayout::Column &column : layout.get_columns()) {
+      const char *value = payload + column.offset_in_record_;
+      memcpy(data + column.offset_in_block_ + idx * column.length_, value,
+             column.length_);
+      if (column.zone_ >= 0 &&
+          (payload[column.null_offset_] & column.null_mask_) == 0)
+        widen_zone(zones()[column.zone_],
+                   load_ordered_value(value, column.length_,
+                                      column.is_signed_));
+    }
+  }
+  entry_stamp.store(stamp, std::memory_order_release);
+  return true;
+}
+
+bool ColumnBlock::zone_excludes(const ColumnLayout &layout,
+                                const ColumnScanPlan &plan) const {
+  for (const ColumnScanPlan::Term &plan_term : plan.get_terms()) {
+    const Predicate::Term &term = plan_term.term_;
+    const ColumnLayout::Column &column =
+        layout.get_columns()[plan_term.column_];
+    if (column.zone_ < 0 || term.op_ == Predicate::IS_NULL ||
+        term.op_ == Predicate::IS_NOT_NULL)
+      continue;
+    if (term.value_type_ !=
+        (column.is_signed_ ? Predicate::SIGNED_INT : Predicate::UNSIGNED_INT))
+      continue;
+
+    const Zone &zone = zones()[column.zone_];
+    uint64_t min = zone.min_.load(std::memory_order_relaxed);
+    uint64_t max = zone.max_.load(std::memory_order_relaxed);
+    // only nulls are stored, no comparison holds
+    if (min > max) return true;
+    uint64_t value = static_cast<uint64_t>(term.int_value_);
+    if (column.is_signed_) value ^= uint64_t(1) << 63;
+    switch (term.op_) {
+      case Predicate::EQ:
+        if (value < min || value > max) return true;
+        break;
+      case Predicate::NE:
+        if (value == min && value == max) return true;
+        break;
+      case Predicate::LT:
+        if (min >= value) return true;
+        break;
+      case Predicate::LE:
+        if (min > value) return true;
+        break;
+      case Predicate::GT:
+        if (max <= value) return true;
+        break;
+      case Predicate::GE:
+        if (max < value) return true;
+        break;
+      default:
+        break;
+    }
+  }
+  return false;
+}
+
+}  // namespace db20xx
@@ -14,11 +14,14 @@ bool Database::check_table_existence(const std::string &table_name) {
 @return
   retval 0 success
 */
-Table* Database::create_table(const std::string &table_name, Schema &schema) {
+Table *Database::create_table(const std::string &table_name, Schema &schema,
+                              uint32_t records_per_block,
+                              StorageLayout storage_layout) {
   if (check_table_existence(table_name) == true) {
     return nullptr;
   }
-  Table *table = new Table(table_name, schema);
+  Table *table =
+      new Table(table_name, schema, records_per_block, storage_layout);
   tables_[table_name] = table;
 
   return table;
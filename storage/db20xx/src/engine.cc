@@ -1,4 +1,8 @@
 #include "engine.h"
+#include "checkpoint.h"
+#include "epoch.h"
+#include "gc.h"
+#include "log_manager.h"
 
 namespace db20xx {
 
@@ -12,6 +16,23 @@ Engine& Engine::GetInstance() {
 std::mutex Engine::databases_lock_;
 std::unordered_map<std::string, Database*> Engine::databases_;
 
+void Engine::init(const std::string &log_dir) {
+  GlocalEpochManager::start();
+  GarbageCollector::start();
+  if (!log_dir.empty()) {
+    LogManager::recover(log_dir);
+    LogManager::start(log_dir);
+    Checkpointer::start(log_dir);
+  }
+}
+
+void Engine::deinit() {
+  Checkpointer::stop();
+  LogManager::stop();
+  GarbageCollector::stop();
+  GlocalEpochManager::stop();
+}
+
 bool Engine::check_database_existence(const std::string &db_name) {
   if (databases_.find(db_name) != databases_.end())
     return true;
@@ -1,9 +1,132 @@
 #include "epoch.h"
+#include <algorithm>
+#include <chrono>
+#include "thread_context.h"
 
 namespace db20xx {
 
 std::atomic<uint64_t> GlocalEpochManager::current_global_epoch_id_ = 1;
-std::atomic<uint32_t> GlocalEpochManager::next_global_txn_id_ = 0;
-std::unordered_map<int, LocalEpochManager*> GlocalEpochManager::local_epochs_;
+std::atomic<uint64_t> GlocalEpochManager::min_active_epoch_id_ = 1;
+std::mutex GlocalEpochManager::local_epochs_lock_;
+std::vector<LocalEpochManager *> GlocalEpochManager::local_epochs_;
+std::atomic<uint64_t> GlocalEpochManager::next_global_txn_id_ = 0;
+std::thread GlocalEpochManager::advancer_thread_;
+std::mutex GlocalEpochManager::advancer_lock_;
+std::condition_variable GlocalEpochManager::advancer_cv_;
+bool GlocalEpochManager::advancer_running_ = false;
+
+void GlocalEpochManager::start() {
+  std::lock_guard<std::mutex> guard(advancer_lock_);
+  if (advancer_running_) return;
+  advancer_running_ = true;
+  advancer_thread_ = std::thread(advance_epoch_loop);
+}
+
+void GlocalEpochManager::stop() {
+  {
+    std::lock_guard<std::mutex> guard(advancer_lock_);
+    if (!advancer_running_) return;
+    advancer_running_ = false;
+  }
+  advancer_cv_.notify_all();
+  advancer_thread_.join();
+}
+
+void GlocalEpochManager::register_local_epoch(LocalEpochManager *local_epoch) {
+  std::lock_guard<std::mutex> guard(local_epochs_lock_);
+  local_epochs_.push_back(local_epoch);
+}
+
+void GlocalEpochManager::unregister_local_epoch(
+    LocalEpochManager *local_epoch) {
+  std::lock_guard<std::mutex> guard(local_epochs_lock_);
+  auto iter = std::find(local_epochs_.begin(), local_epochs_.end(),
+                        local_epoch);
+  if (iter != local_epochs_.end()) local_epochs_.erase(iter);
+}
+
+/**
+ *@brief
+ *  Publish the epoch to the local epoch first, then check that the global
+ *  epoch has not moved. Otherwise the advancer may have scanned the local
+ *  epochs in between and published a minimum active epoch above ours.
+ */
+uint64_t GlocalEpochManager::enter_epoch(LocalEpochManager *local_epoch) {
+  uint64_t epoch_id = 0;
+  local_epoch->snapshot_.store(false);
+  while (true) {
+    epoch_id = get_current_global_epoch_id();
+    local_epoch->current_epoch_id_.store(epoch_id);
+    if (epoch_id == get_current_global_epoch_id()) break;
+  }
+
+  if (local_epoch->next_txn_seq_ == local_epoch->txn_seq_end_) {
+    local_epoch->next_txn_seq_ =
+        get_next_global_transaction_id(TXN_SEQ_BATCH_SIZE);
+    local_epoch->txn_seq_end_ =
+        local_epoch->next_txn_seq_ + TXN_SEQ_BATCH_SIZE;
+  }
+  uint64_t txn_seq = local_epoch->next_txn_seq_++ & 0xFFFFFFFF;
+  return (epoch_id << 32) | txn_seq;
+}
+
+/**
+ *@brief
+ *  The advancer computes and publishes the minimum active epoch under
+ *  local_epochs_lock_, publishing our local epoch under the same lock keeps
+ *  it from moving past the epoch we read.
+ */
+uint64_t GlocalEpochManager::enter_snapshot_epoch(
+    LocalEpochManager *local_epoch) {
+  std::lock_guard<std::mutex> guard(local_epochs_lock_);
+  uint64_t epoch_id = compute_min_active_epoch_id(false);
+  if (epoch_id + MAX_SNAPSHOT_LAG_EPOCHS < get_current_global_epoch_id())
+    return INVALID_EPOCH_ID;
+  local_epoch->snapshot_.store(true);
+  local_epoch->current_epoch_id_.store(epoch_id);
+  return epoch_id;
+}
+
+void GlocalEpochManager::exit_epoch(LocalEpochManager *local_epoch) {
+  local_epoch->current_epoch_id_.store(INVALID_EPOCH_ID);
+}
+
+/**
+ *@brief
+ *  caller must hold local_epochs_lock_. The epoch of a local epoch is read
+ *  before its snapshot_ flag, which is set before the epoch is published,
+ *  so a read-write transaction is never taken for a snapshot reader.
+ */
+uint64_t GlocalEpochManager::compute_min_active_epoch_id(
+    bool include_snapshots) {
+  // read the global epoch before the local ones, a transaction entering
+  // after this point gets an epoch no smaller than it
+  uint64_t min_epoch_id = get_current_global_epoch_id();
+  for (auto local_epoch : local_epochs_) {
+    uint64_t epoch_id = local_epoch->get_current_epoch_id();
+    if (epoch_id >= min_epoch_id) continue;
+    if (!include_snapshots && local_epoch->snapshot_.load()) continue;
+    min_epoch_id = epoch_id;
+  }
+  return min_epoch_id;
+}
+
+void GlocalEpochManager::advance_epoch_loop() {
+  std::unique_lock<std::mutex> lock(advancer_lock_);
+  while (advancer_running_) {
+    advancer_cv_.wait_for(lock, std::chrono::milliseconds(EPOCH_LENGTH_MS));
+    if (!advancer_running_) break;
+
+    current_global_epoch_id_.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> guard(local_epochs_lock_);
+      // snapshot readers hold back gc and checkpoints, not new snapshots
+      uint64_t min_epoch_id = compute_min_active_epoch_id(true);
+      if (min_epoch_id > min_active_epoch_id_.load())
+        min_active_epoch_id_.store(min_epoch_id);
+    }
+    ThreadContext::advance_index_epoch();
+  }
+}
 
 }
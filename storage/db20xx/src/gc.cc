@@ -0,0 +1,140 @@
+#include "gc.h"
+#include <algorithm>
+#include <chrono>
+#include "epoch.h"
+#include "message_logger.h"
+#include "record.h"
+#include "table.h"
+#include "thread_context.h"
+#include "transaction.h"
+
+namespace db20xx {
+
+std::mutex GarbageCollector::txn_ctxs_lock_;
+std::vector<TransactionContext *> GarbageCollector::txn_ctxs_;
+std::vector<RetiredRecord> GarbageCollector::pending_records_;
+std::vector<RetiredRecord> GarbageCollector::orphan_records_;
+std::thread GarbageCollector::gc_thread_;
+std::mutex GarbageCollector::gc_thread_lock_;
+std::condition_variable GarbageCollector::gc_thread_cv_;
+bool GarbageCollector::gc_thread_running_ = false;
+
+void GarbageCollector::start() {
+  std::lock_guard<std::mutex> guard(gc_thread_lock_);
+  if (gc_thread_running_) return;
+  gc_thread_running_ = true;
+  gc_thread_ = std::thread(gc_loop);
+}
+
+void GarbageCollector::stop() {
+  {
+    std::lock_guard<std::mutex> guard(gc_thread_lock_);
+    if (!gc_thread_running_) return;
+    gc_thread_running_ = false;
+  }
+  gc_thread_cv_.notify_all();
+  gc_thread_.join();
+}
+
+void GarbageCollector::register_transaction(TransactionContext *txn_ctx) {
+  std::lock_guard<std::mutex> guard(txn_ctxs_lock_);
+  txn_ctxs_.push_back(txn_ctx);
+}
+
+void GarbageCollector::unregister_transaction(TransactionContext *txn_ctx) {
+  std::lock_guard<std::mutex> guard(txn_ctxs_lock_);
+  auto iter = std::find(txn_ctxs_.begin(), txn_ctxs_.end(), txn_ctx);
+  if (iter == txn_ctxs_.end()) return;
+  txn_ctxs_.erase(iter);
+
+  // the context is going away, keep its retired versions for later passes
+  txn_ctx->retired_records_latch_.lock();
+  orphan_records_.insert(orphan_records_.end(),
+                         txn_ctx->retired_records_.begin(),
+                         txn_ctx->retired_records_.end());
+  txn_ctx->retired_records_.clear();
+  txn_ctx->retired_records_latch_.unlock();
+}
+
+/**
+ *@brief
+ *  Every transaction in an epoch smaller than the minimum active epoch has
+ *  finished, and its id is smaller than (min_active_epoch_id << 32).
+ */
+uint64_t GarbageCollector::compute_watermark() {
+  return GlocalEpochManager::get_min_active_epoch_id() << 32;
+}
+
+uint64_t GarbageCollector::get_oldest_active_transaction_id() {
+  return compute_watermark();
+}
+
+void GarbageCollector::retire_record(Table *table, Record *record) {
+  // transaction ids handed out from now on are larger than the timestamp
+  uint64_t retire_ts =
+      (GlocalEpochManager::get_current_global_epoch_id() << 32) | 0xffffffff;
+  table->add_deleted_version_num(1);
+  std::lock_guard<std::mutex> guard(txn_ctxs_lock_);
+  orphan_records_.push_back({table, record, retire_ts});
+}
+
+void GarbageCollector::collect(ThreadContext *thd_ctx) {
+  uint64_t watermark = compute_watermark();
+
+  {
+    std::lock_guard<std::mutex> guard(txn_ctxs_lock_);
+
+    pending_records_.insert(pending_records_.end(), orphan_records_.begin(),
+                            orphan_records_.end());
+    orphan_records_.clear();
+
+    for (auto txn_ctx : txn_ctxs_) {
+      txn_ctx->retired_records_latch_.lock();
+      pending_records_.insert(pending_records_.end(),
+                              txn_ctx->retired_records_.begin(),
+                              txn_ctx->retired_records_.end());
+      txn_ctx->retired_records_.clear();
+      txn_ctx->retired_records_latch_.unlock();
+    }
+  }
+
+  // Versions retired by transaction [x] may be read by transactions older
+  // than [x], they can be reclaimed once all of them have finished.
+  // A version whose chain is owned by a running transaction is kept for
+  // the next pass, the owner may be putting keys to the indexes.
+  size_t kept = 0;
+  size_t reclaimed = 0;
+  for (size_t i = 0; i < pending_records_.size(); i++) {
+    RetiredRecord &retired = pending_records_[i];
+    if (retired.retire_ts_ < watermark &&
+        retired.table_->reclaim_record(retired.record_, thd_ctx)) {
+      reclaimed++;
+    } else {
+      pending_records_[kept++] = retired;
+    }
+  }
+  pending_records_.resize(kept);
+
+  if (reclaimed > 0) {
+    LOG_TRACE("gc: watermark:%lu, reclaimed:%lu, pending:%lu", watermark,
+              reclaimed, kept);
+  }
+}
+
+void GarbageCollector::gc_loop() {
+  ThreadContext gc_ctx(GC_THREAD_ID);
+  std::unique_lock<std::mutex> lock(gc_thread_lock_);
+  while (gc_thread_running_) {
+    gc_thread_cv_.wait_for(lock, std::chrono::milliseconds(GC_INTERVAL_MS));
+    if (!gc_thread_running_) break;
+
+    lock.unlock();
+    // masstree nodes removed in this pass are freed after we leave
+    gc_ctx.enter_index_epoch();
+    collect(&gc_ctx);
+    gc_ctx.exit_index_epoch();
+    lock.lock();
+  }
+}
+
+}  // namespace db20xx
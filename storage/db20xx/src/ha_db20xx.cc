@@ -82,14 +82,24 @@
     -Brian
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "ha_db20xx.h"
 #include "message_logger.h"
 #include "my_dbug.h"
 #include "mysql/plugin.h"
 #include "return_status.h"
+#include "sql/mysqld.h"  // mysql_real_data_home
+#include "sql/opt_hints.h"
+#include "sql/record_buffer.h"
 #include "sql/sql_class.h"
+#include "sql/sql_lex.h"
 #include "sql/sql_plugin.h"
 #include "sql/sql_select.h"  // actual_key_parts
 #include "thread_context.h"
@@ -97,6 +107,7 @@
 
 #include "engine.h"
 #include "ha_db20xx_help.h"
+#include "log_manager.h"
 #include "transaction.h"
 
 static handler *db20xx_create_handler(handlerton *hton, TABLE_SHARE *table,
@@ -215,7 +226,12 @@ int ha_db20xx::open(const char *name, int, uint, const dd::Table *) {
 
   db20xx_table_ = database->get_table(table_name);
   if (db20xx_table_ == nullptr) return HA_ERR_NO_SUCH_TABLE;
+  // row position: block id and index in block of the version chain
+  ref_length = 2 * sizeof(uint32_t);
 
+  if (bitmap_init(&projection_read_set_, nullptr, table->s->fields))
+    return HA_ERR_OUT_OF_MEM;
+  projection_built_ = false;
   return 0;
 }
 
@@ -236,6 +252,7 @@ int ha_db20xx::open(const char *name, int, uint, const dd::Table *) {
 
 int ha_db20xx::close(void) {
   DBUG_TRACE;
+  bitmap_free(&projection_read_set_);
   return 0;
 }
 
@@ -257,6 +274,8 @@ int ha_db20xx::close(void) {
 int ha_db20xx::write_row(uchar *sl_record) {
   DBUG_TRACE;
   db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  if (thd_ctx->get_transaction_context()->is_read_only())
+    return HA_ERR_TABLE_READONLY;
   int ret = db20xx_table_->insert_record_from_mysql((char *)sl_record, thd_ctx);
   if (ret == db20xx::DB20XX_KEY_EXIST)
     return HA_ERR_FOUND_DUPP_KEY;
@@ -266,6 +285,33 @@ int ha_db20xx::write_row(uchar *sl_record) {
   return 0;
 }
 
+/**
+  @brief
+  start_bulk_insert() is called before a multi-row INSERT, LOAD DATA or
+  ALTER TABLE copies rows in. The server does not read the table by its
+  indexes until end_bulk_insert(), unless the statement resolves duplicate
+  keys, then rows are inserted one by one.
+*/
+void ha_db20xx::start_bulk_insert(ha_rows rows) {
+  DBUG_TRACE;
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  if (handle_dup_key_ || (rows != 0 && rows < BULK_INSERT_MIN_ROWS) ||
+      thd_ctx->get_transaction_context()->is_read_only())
+    return;
+  db20xx_table_->start_bulk_insert(rows, thd_ctx);
+  bulk_insert_ = true;
+}
+
+int ha_db20xx::end_bulk_insert() {
+  DBUG_TRACE;
+  if (!bulk_insert_) return 0;
+  // entries of rows which are rolled back are removed like those of any
+  // aborted insert
+  db20xx_table_->end_bulk_insert(get_thread_ctx());
+  bulk_insert_ = false;
+  return 0;
+}
+
 /**
   @brief
   update_row() updates a row. old_data will have the previous row record in it,
@@ -288,8 +334,15 @@ int ha_db20xx::update_row(const uchar *old_row, uchar *new_row) {
   (void)old_row;
   DBUG_TRACE;
   db20xx::ThreadContext *thd_ctx = get_thread_ctx();
-  db20xx_table_->update_record_from_mysql(current_record_, (char *)new_row,
-                                          thd_ctx);
+  if (thd_ctx->get_transaction_context()->is_read_only())
+    return HA_ERR_TABLE_READONLY;
+  int ret = db20xx_table_->update_record_from_mysql(current_record_,
+                                                    (char *)new_row, thd_ctx);
+  if (ret == db20xx::DB20XX_KEY_EXIST)
+    return HA_ERR_FOUND_DUPP_KEY;
+  else if (ret == db20xx::DB20XX_ABORT)
+    return HA_ERR_GENERIC;
+
   return 0;
 }
 
@@ -316,55 +369,64 @@ int ha_db20xx::update_row(const uchar *old_row, uchar *new_row) {
 int ha_db20xx::delete_row(const uchar *) {
   DBUG_TRACE;
   db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  if (thd_ctx->get_transaction_context()->is_read_only())
+    return HA_ERR_TABLE_READONLY;
   db20xx_table_->delete_record(current_record_, thd_ctx);
 
   return 0;
 }
 
-void ha_db20xx::build_key_from_mysql_key(const uchar *mysql_key,
-                                           key_part_map keypart_map,
-                                           db20xx::Key &db20xx_key,
-                                           bool &full_key_search) {
+void ha_db20xx::build_key_from_mysql_key(uint index, const uchar *mysql_key,
+                                         key_part_map keypart_map,
+                                         db20xx::Key &db20xx_key,
+                                         bool &full_key_search) {
   /* works only with key prefixes */
   assert(((keypart_map + 1) & keypart_map) == 0);
 
-  KEY *key_info = table->key_info + active_index;
-  KEY_PART_INFO *key_part = key_info->key_part;
-  KEY_PART_INFO *end_key_part = key_part + actual_key_parts(key_info);
-  uint full_key_part_num = end_key_part - key_part;
+  KEY *key_info = table->key_info + index;
+  uint full_key_part_num = actual_key_parts(key_info);
   uint used_key_part_num = 0;
-  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
-
-  char *materized_key = thd_ctx->get_key_container();
-  uint key_len = 0;
-
-  char *p = materized_key;
-  while (key_part < end_key_part && keypart_map) {
-    uint part_len = 0;
-    if (key_part->store_length == key_part->length) {
-      part_len = key_part->length;
-      memcpy(p, mysql_key, part_len);
-      p += part_len;
-      mysql_key += part_len;
-    } else {
-      uint len_bytes = key_part->store_length - key_part->length;
-      memcpy(&part_len, mysql_key, len_bytes);
-      mysql_key += len_bytes;
-      memcpy(p, mysql_key, part_len);
-      p += part_len;
-      mysql_key += key_part->length;
-    }
-
-    key_len += part_len;
+  while (used_key_part_num < full_key_part_num && keypart_map) {
     keypart_map >>= 1;
-    key_part++;
     used_key_part_num++;
   }
 
-  db20xx_key.assign((const char *)materized_key, key_len);
+  db20xx_table_->build_key_from_key_tuple(
+      index, reinterpret_cast<const char *>(mysql_key), used_key_part_num,
+      db20xx_key, get_thread_ctx()->get_key_container());
   full_key_search = (used_key_part_num == full_key_part_num ? true : false);
 }
 
+/**
+  @brief
+    Masstree is ordered, keys are encoded so that their bytes sort like
+    the values of their parts, see db20xx::KeyEncodePlan.
+*/
+ulong ha_db20xx::index_flags(uint inx, uint part, bool all_parts) const {
+  ulong flags = HA_READ_NEXT | HA_READ_PREV | HA_READ_ORDER | HA_READ_RANGE |
+                HA_KEY_SCAN_NOT_ROR | HA_DO_INDEX_COND_PUSHDOWN;
+  if (table_share == nullptr || inx >= table_share->keys) return flags;
+
+  const KEY &key_info = table_share->key_info[inx];
+  if (part >= key_info.user_defined_key_parts) return flags;
+
+  bool covered = true;
+  for (uint i = all_parts ? 0 : part; i <= part; i++) {
+    const KEY_PART_INFO &key_part = key_info.key_part[i];
+    // BLOB columns are not copied by Record::load_fields_to_mysql
+    covered = covered && !key_part.field->is_flag_set(BLOB_FLAG);
+  }
+  if (covered) flags |= HA_KEYREAD_ONLY;
+  return flags;
+}
+
+int ha_db20xx::index_init(uint idx, bool) {
+  DBUG_TRACE;
+  active_index = idx;
+  update_row_projection();
+  return 0;
+}
+
 /**
    @brief
    Positions an index cursor to the index specified in the handle
@@ -379,47 +441,281 @@ int ha_db20xx::index_read_map(uchar *mysql_record, const uchar *key,
   db20xx::Record *record = nullptr;
   db20xx::ThreadContext *thd_ctx = get_thread_ctx();
   int found = db20xx::DB20XX_SUCCESS;
-  scan_direction_ = find_flag;  // flag的定义见include/my_base.h
-  build_key_from_mysql_key(key, keypart_map, index_key_, full_key_search);
-
-  if (!full_key_search) {
-    assert(find_flag == HA_READ_KEY_EXACT);
-    found = db20xx_table_->index_prefix_key_search(
-        active_index, index_key_, record, masstree_scan_stack_, *thd_ctx,
-        read_own_statement_);
-  } else if (find_flag == HA_READ_KEY_EXACT) {
-    found = db20xx_table_->get_record_from_index(
-        active_index, index_key_, record, *thd_ctx, read_own_statement_);
-  } else if (find_flag == HA_READ_KEY_OR_NEXT) {
-    found = db20xx_table_->index_scan_range_first(
-        active_index, index_key_, record, true, masstree_scan_stack_, *thd_ctx,
-        read_own_statement_);
-  } else if (find_flag == HA_READ_AFTER_KEY) {
-    found = db20xx_table_->index_scan_range_first(
-        active_index, index_key_, record, false, masstree_scan_stack_, *thd_ctx,
-        read_own_statement_);
-  } else if (find_flag == HA_READ_KEY_OR_PREV) {
-    found = db20xx_table_->index_rscan_range_first(
-        active_index, index_key_, record, true, masstree_scan_stack_, *thd_ctx,
-        read_own_statement_);
-  } else if (find_flag == HA_READ_BEFORE_KEY) {
-    found = db20xx_table_->index_rscan_range_first(
-        active_index, index_key_, record, false, masstree_scan_stack_, *thd_ctx,
-        read_own_statement_);
-  } else {
-    // TODO:panic
-    assert(false);
+  reset_record_buffer();
+  build_key_from_mysql_key(active_index, key, keypart_map, index_key_,
+                           full_key_search);
+  // only a full key of a unique index maps to one index entry, a partial
+  // key stands for every key it prefixes and a key of a non-unique index
+  // for every entry suffixed by a row id
+  bool exact_key =
+      full_key_search && db20xx_table_->get_key_info(active_index).unique;
+  prefix_scan_full_key_ = full_key_search;
+  // find_flag的定义见include/my_base.h
+  db20xx::Key bound_key =
+      exact_key ? index_key_ : build_prefix_upper_bound(index_key_);
+
+  switch (find_flag) {
+    case HA_READ_KEY_EXACT:
+    case HA_READ_PREFIX:
+      if (exact_key) {
+        index_scan_state_ = INDEX_SCAN_NONE;
+        found = db20xx_table_->get_record_from_index(
+            active_index, index_key_, record, *thd_ctx, read_own_statement_);
+      } else {
+        index_scan_state_ = INDEX_SCAN_PREFIX;
+        found = db20xx_table_->index_prefix_key_search(
+            active_index, index_key_, record, masstree_scan_stack_, *thd_ctx,
+            read_own_statement_, prefix_scan_full_key_);
+      }
+      break;
+    case HA_READ_KEY_OR_NEXT:
+      index_scan_state_ = INDEX_SCAN_FORWARD;
+      found = db20xx_table_->index_scan_range_first(
+          active_index, index_key_, record, true, masstree_scan_stack_,
+          *thd_ctx, read_own_statement_);
+      break;
+    case HA_READ_AFTER_KEY:
+      index_scan_state_ = INDEX_SCAN_FORWARD;
+      found = db20xx_table_->index_scan_range_first(
+          active_index, bound_key, record, false, masstree_scan_stack_,
+          *thd_ctx, read_own_statement_);
+      break;
+    case HA_READ_KEY_OR_PREV:
+    case HA_READ_PREFIX_LAST_OR_PREV:
+      index_scan_state_ = INDEX_SCAN_BACKWARD;
+      found = db20xx_table_->index_rscan_range_first(
+          active_index, bound_key, record, true, masstree_scan_stack_,
+          *thd_ctx, read_own_statement_);
+      break;
+    case HA_READ_BEFORE_KEY:
+      index_scan_state_ = INDEX_SCAN_BACKWARD;
+      found = db20xx_table_->index_rscan_range_first(
+          active_index, index_key_, record, false, masstree_scan_stack_,
+          *thd_ctx, read_own_statement_);
+      break;
+    case HA_READ_PREFIX_LAST: {
+      index_scan_state_ = INDEX_SCAN_BACKWARD;
+      found = db20xx_table_->index_rscan_range_first(
+          active_index, bound_key, record, true, masstree_scan_stack_,
+          *thd_ctx, read_own_statement_);
+      // rows failing the pushed conditions are skipped within the key
+      while (found == db20xx::DB20XX_SUCCESS) {
+        // the last key not greater than bound_key may not match
+        db20xx::Key current_key =
+            masstree_scan_stack_.get_current_key().full_string();
+        if (!db20xx_table_->entry_has_key(active_index, current_key,
+                                          index_key_, full_key_search)) {
+          found = db20xx::DB20XX_KEY_NOT_EXIST;
+          break;
+        }
+        if (!pushed_cond_rejects(record, thd_ctx)) break;
+        found = db20xx_table_->index_rscan_range_next(
+            active_index, record, masstree_scan_stack_, *thd_ctx,
+            read_own_statement_);
+      }
+      break;
+    }
+    default:
+      // TODO:panic
+      assert(false);
+      return HA_ERR_WRONG_COMMAND;
   }
 
-  if (found == db20xx::DB20XX_SUCCESS) {
-    record->load_data_to_mysql((char *)mysql_record,
-                               db20xx_table_->get_schema());
-    current_record_ = record;
-    return 0;
-  } else if (found == db20xx::DB20XX_ABORT) {
-    return HA_ERR_GENERIC;
-  } else
-    return HA_ERR_KEY_NOT_FOUND;
+  return finish_index_read(found, record, mysql_record, HA_ERR_KEY_NOT_FOUND,
+                           thd_ctx);
+}
+
+/**
+  @brief
+    the costs are those of the default implementation, the native one is
+    chosen for unsorted reads if the mrr optimizer switch or an MRR hint
+    allows it
+*/
+ha_rows ha_db20xx::multi_range_read_info_const(uint keyno, RANGE_SEQ_IF *seq,
+                                               void *seq_init_param,
+                                               uint n_ranges, uint *bufsz,
+                                               uint *flags,
+                                               Cost_estimate *cost) {
+  uint requested_flags = *flags;
+  ha_rows rows = handler::multi_range_read_info_const(
+      keyno, seq, seq_init_param, n_ranges, bufsz, flags, cost);
+  if (rows != HA_POS_ERROR && use_native_mrr(keyno, requested_flags))
+    *flags &= ~HA_MRR_USE_DEFAULT_IMPL;
+  return rows;
+}
+
+ha_rows ha_db20xx::multi_range_read_info(uint keyno, uint n_ranges, uint keys,
+                                         uint *bufsz, uint *flags,
+                                         Cost_estimate *cost) {
+  uint requested_flags = *flags;
+  ha_rows rows = handler::multi_range_read_info(keyno, n_ranges, keys, bufsz,
+                                                flags, cost);
+  if (rows != HA_POS_ERROR && use_native_mrr(keyno, requested_flags))
+    *flags &= ~HA_MRR_USE_DEFAULT_IMPL;
+  return rows;
+}
+
+/**
+  @brief
+    whether a read of index keyno requested with flags can be done
+    natively, sorted reads are not
+*/
+bool ha_db20xx::use_native_mrr(uint keyno, uint flags) const {
+  if (flags & (HA_MRR_USE_DEFAULT_IMPL | HA_MRR_SORTED)) return false;
+  TABLE_LIST *table_list = table->pos_in_table_list;
+  return table_list != nullptr &&
+         hint_key_state(ha_thd(), table_list, keyno, MRR_HINT_ENUM,
+                        OPTIMIZER_SWITCH_MRR);
+}
+
+int ha_db20xx::multi_range_read_init(RANGE_SEQ_IF *seq, void *seq_init_param,
+                                     uint n_ranges, uint mode,
+                                     HANDLER_BUFFER *buf) {
+  DBUG_TRACE;
+  mrr_native_ = !(mode & (HA_MRR_USE_DEFAULT_IMPL | HA_MRR_SORTED));
+  if (!mrr_native_)
+    return handler::multi_range_read_init(seq, seq_init_param, n_ranges, mode,
+                                          buf);
+
+  // rows are read to table->record[0], the buffer is not needed
+  mrr_iter = seq->init(seq_init_param, n_ranges, mode);
+  mrr_funcs = *seq;
+  mrr_is_output_sorted = false;
+  mrr_seq_end_ = false;
+  mrr_range_scan_ = false;
+  mrr_ranges_.clear();
+  mrr_pos_ = 0;
+  return 0;
+}
+
+/**
+  @brief
+    take the next batch of ranges from the sequence and look up its point
+    ranges, false if the sequence has no more ranges. Rows are returned in
+    the order of the ranges, the lookups are done in key order.
+*/
+bool ha_db20xx::fill_mrr_batch() {
+  mrr_ranges_.clear();
+  mrr_tuples_.clear();
+  mrr_pos_ = 0;
+  if (mrr_seq_end_) return false;
+
+  uint full_key_part_num = actual_key_parts(table->key_info + active_index);
+  key_part_map full_keypart_map = make_prev_keypart_map(full_key_part_num);
+  bool unique = db20xx_table_->get_key_info(active_index).unique;
+  uint32_t max_key_length =
+      db20xx_table_->get_max_entry_key_length(active_index);
+  if (mrr_key_data_.size() < MRR_BATCH_RANGES * max_key_length)
+    mrr_key_data_.resize(MRR_BATCH_RANGES * max_key_length);
+
+  // offsets of the copied start and end tuples, mrr_tuples_ may grow
+  std::vector<size_t> tuple_offsets;
+  MrrRange entry;
+  while (mrr_ranges_.size() < MRR_BATCH_RANGES) {
+    if (mrr_funcs.next(mrr_iter, &entry.range_)) {
+      mrr_seq_end_ = true;
+      break;
+    }
+    const KEY_MULTI_RANGE &range = entry.range_;
+    entry.point_ = unique && (range.range_flag & EQ_RANGE) &&
+                   !(range.range_flag & NULL_RANGE) &&
+                   (range.start_key.keypart_map & full_keypart_map) ==
+                       full_keypart_map;
+    entry.found_ = db20xx::DB20XX_KEY_NOT_EXIST;
+    entry.record_ = nullptr;
+    if (entry.point_) {
+      db20xx_table_->build_key_from_key_tuple(
+          active_index, reinterpret_cast<const char *>(range.start_key.key),
+          full_key_part_num, entry.key_,
+          mrr_key_data_.data() + mrr_ranges_.size() * max_key_length);
+    } else {
+      for (const key_range *key : {&range.start_key, &range.end_key}) {
+        tuple_offsets.push_back(mrr_tuples_.size());
+        if (key->keypart_map == 0) continue;
+        mrr_tuples_.insert(mrr_tuples_.end(), key->key,
+                           key->key + key->length);
+      }
+    }
+    mrr_ranges_.push_back(entry);
+  }
+
+  std::vector<uint32_t> points;
+  size_t tuple_idx = 0;
+  for (uint32_t i = 0; i < mrr_ranges_.size(); i++) {
+    MrrRange &range = mrr_ranges_[i];
+    if (range.point_) {
+      points.push_back(i);
+      continue;
+    }
+    range.range_.start_key.key = mrr_tuples_.data() + tuple_offsets[tuple_idx];
+    range.range_.end_key.key =
+        mrr_tuples_.data() + tuple_offsets[tuple_idx + 1];
+    tuple_idx += 2;
+  }
+  if (points.empty()) return !mrr_ranges_.empty();
+
+  std::sort(points.begin(), points.end(), [this](uint32_t a, uint32_t b) {
+    const db20xx::Key &key_a = mrr_ranges_[a].key_;
+    const db20xx::Key &key_b = mrr_ranges_[b].key_;
+    return key_a.compare(key_b.s, key_b.len) < 0;
+  });
+  std::vector<db20xx::Key> keys;
+  for (uint32_t i : points) keys.push_back(mrr_ranges_[i].key_);
+  std::vector<db20xx::Record *> records(points.size());
+  std::vector<int> results(points.size());
+  db20xx_table_->multi_get_records_from_index(
+      active_index, keys.data(), keys.size(), records.data(), results.data(),
+      *get_thread_ctx(), read_own_statement_);
+  for (size_t i = 0; i < points.size(); i++) {
+    mrr_ranges_[points[i]].found_ = results[i];
+    mrr_ranges_[points[i]].record_ = records[i];
+  }
+  return true;
+}
+
+int ha_db20xx::multi_range_read_next(char **range_info) {
+  DBUG_TRACE;
+  if (!mrr_native_) return handler::multi_range_read_next(range_info);
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+
+  while (true) {
+    if (mrr_range_scan_) {
+      int ret = read_range_next();
+      if (ret != HA_ERR_END_OF_FILE) {
+        *range_info = mrr_ranges_[mrr_pos_].range_.ptr;
+        return ret;
+      }
+      mrr_range_scan_ = false;
+      mrr_pos_++;
+    }
+    if (mrr_pos_ == mrr_ranges_.size() && !fill_mrr_batch())
+      return HA_ERR_END_OF_FILE;
+
+    MrrRange &entry = mrr_ranges_[mrr_pos_];
+    if (entry.point_) {
+      mrr_pos_++;
+      if (entry.found_ == db20xx::DB20XX_ABORT) return HA_ERR_GENERIC;
+      if (entry.found_ != db20xx::DB20XX_SUCCESS ||
+          pushed_cond_rejects(entry.record_, thd_ctx))
+        continue;
+      load_index_row(entry.record_, table->record[0]);
+      current_record_ = entry.record_;
+      *range_info = entry.range_.ptr;
+      return 0;
+    }
+
+    KEY_MULTI_RANGE &range = entry.range_;
+    int ret = read_range_first(
+        range.start_key.keypart_map ? &range.start_key : nullptr,
+        range.end_key.keypart_map ? &range.end_key : nullptr,
+        range.range_flag & EQ_RANGE, false);
+    if (ret != HA_ERR_END_OF_FILE) {
+      mrr_range_scan_ = ret == 0;
+      *range_info = range.ptr;
+      return ret;
+    }
+    mrr_pos_++;
+  }
 }
 
 /**
@@ -428,41 +724,36 @@ int ha_db20xx::index_read_map(uchar *mysql_record, const uchar *key,
 */
 
 int ha_db20xx::index_next(uchar *mysql_record) {
-  db20xx::Record *record;
+  db20xx::Record *record = nullptr;
   db20xx::ThreadContext *thd_ctx = get_thread_ctx();
-  int found = false;
+  int found = db20xx::DB20XX_SUCCESS;
 
-  switch (scan_direction_) {
-    case HA_READ_KEY_OR_NEXT:
-    case HA_READ_AFTER_KEY:
+  Record_buffer *buffer = ha_get_record_buffer();
+  if (buffer != nullptr && (index_scan_state_ == INDEX_SCAN_FORWARD ||
+                            index_scan_state_ == INDEX_SCAN_PREFIX))
+    return read_buffered_row(mysql_record, buffer);
+
+  switch (index_scan_state_) {
+    case INDEX_SCAN_FORWARD:
       found = db20xx_table_->index_scan_range_next(
           active_index, record, masstree_scan_stack_, *thd_ctx,
           read_own_statement_);
       break;
-    case HA_READ_KEY_OR_PREV:
-    case HA_READ_BEFORE_KEY:
-      found = db20xx_table_->index_rscan_range_next(
-          active_index, record, masstree_scan_stack_, *thd_ctx,
-          read_own_statement_);
-      break;
-    case HA_READ_KEY_EXACT:
+    case INDEX_SCAN_PREFIX:
       found = db20xx_table_->index_prefix_search_next(
           active_index, index_key_, record, masstree_scan_stack_, *thd_ctx,
-          read_own_statement_);
+          read_own_statement_, prefix_scan_full_key_);
       break;
-    default:
-      // TODO:panic
-      assert(false);
+    case INDEX_SCAN_BACKWARD:
+      found = turn_index_scan(true, record);
       break;
+    case INDEX_SCAN_NONE:
+      // a full key of a unique index maps to one version chain
+      return HA_ERR_END_OF_FILE;
   }
 
-  if (found == db20xx::DB20XX_SUCCESS) {
-    record->load_data_to_mysql((char *)mysql_record,
-                               db20xx_table_->get_schema());
-    current_record_ = record;
-    return 0;
-  } else
-    return HA_ERR_KEY_NOT_FOUND;
+  return finish_index_read(found, record, mysql_record, HA_ERR_END_OF_FILE,
+                           thd_ctx);
 }
 
 /**
@@ -470,11 +761,32 @@ int ha_db20xx::index_next(uchar *mysql_record) {
   Used to read backwards through the index.
 */
 
-int ha_db20xx::index_prev(uchar *) {
-  int rc;
+int ha_db20xx::index_prev(uchar *mysql_record) {
   DBUG_TRACE;
-  rc = HA_ERR_WRONG_COMMAND;
-  return rc;
+  db20xx::Record *record = nullptr;
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  int found = db20xx::DB20XX_SUCCESS;
+
+  Record_buffer *buffer = ha_get_record_buffer();
+  if (buffer != nullptr && index_scan_state_ == INDEX_SCAN_BACKWARD)
+    return read_buffered_row(mysql_record, buffer);
+
+  switch (index_scan_state_) {
+    case INDEX_SCAN_BACKWARD:
+      found = db20xx_table_->index_rscan_range_next(
+          active_index, record, masstree_scan_stack_, *thd_ctx,
+          read_own_statement_);
+      break;
+    case INDEX_SCAN_FORWARD:
+    case INDEX_SCAN_PREFIX:
+      found = turn_index_scan(false, record);
+      break;
+    case INDEX_SCAN_NONE:
+      return HA_ERR_END_OF_FILE;
+  }
+
+  return finish_index_read(found, record, mysql_record, HA_ERR_END_OF_FILE,
+                           thd_ctx);
 }
 
 /**
@@ -487,11 +799,19 @@ int ha_db20xx::index_prev(uchar *) {
   @see
   opt_range.cc, opt_sum.cc, sql_handler.cc and sql_select.cc
 */
-int ha_db20xx::index_first(uchar *) {
-  int rc;
+int ha_db20xx::index_first(uchar *mysql_record) {
   DBUG_TRACE;
-  rc = HA_ERR_WRONG_COMMAND;
-  return rc;
+  db20xx::Record *record = nullptr;
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  index_key_.assign(thd_ctx->get_key_container(), 0);
+  reset_record_buffer();
+
+  index_scan_state_ = INDEX_SCAN_FORWARD;
+  int found = db20xx_table_->index_scan_range_first(
+      active_index, index_key_, record, true, masstree_scan_stack_, *thd_ctx,
+      read_own_statement_);
+  return finish_index_read(found, record, mysql_record, HA_ERR_END_OF_FILE,
+                           thd_ctx);
 }
 
 /**
@@ -504,11 +824,378 @@ int ha_db20xx::index_first(uchar *) {
   @see
   opt_range.cc, opt_sum.cc, sql_handler.cc and sql_select.cc
 */
-int ha_db20xx::index_last(uchar *) {
-  int rc;
+int ha_db20xx::index_last(uchar *mysql_record) {
   DBUG_TRACE;
-  rc = HA_ERR_WRONG_COMMAND;
-  return rc;
+  db20xx::Record *record = nullptr;
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  index_key_.assign(thd_ctx->get_key_container(), 0);
+  reset_record_buffer();
+
+  index_scan_state_ = INDEX_SCAN_BACKWARD;
+  int found = db20xx_table_->index_rscan_range_first(
+      active_index, build_prefix_upper_bound(index_key_), record, true,
+      masstree_scan_stack_, *thd_ctx, read_own_statement_);
+  return finish_index_read(found, record, mysql_record, HA_ERR_END_OF_FILE,
+                           thd_ctx);
+}
+
+/**
+  @brief
+    a key not less than any key prefixed by db20xx_key, built behind
+    db20xx_key in the key container.
+*/
+db20xx::Key ha_db20xx::build_prefix_upper_bound(const db20xx::Key &db20xx_key) {
+  char *key_data = get_thread_ctx()->get_key_container();
+  assert(db20xx_key.s == key_data);
+  // also above the entries of the key suffixed by row ids
+  uint32_t bound_length =
+      db20xx_table_->get_max_entry_key_length(active_index);
+  memset(key_data + db20xx_key.len, 0xff, bound_length - db20xx_key.len);
+  return db20xx::Key(key_data, bound_length);
+}
+
+/**
+  @brief
+    change the direction of the running index scan, continue from the
+    current key.
+*/
+int ha_db20xx::turn_index_scan(bool forward, db20xx::Record *&record) {
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  db20xx::Key current_key;
+  if (!buffered_records_.empty()) {
+    // the scan stack has run ahead of the current row to fill the buffer
+    db20xx_table_->build_key(active_index, current_record_, current_key,
+                             thd_ctx->get_key_container(), thd_ctx);
+  } else {
+    current_key = masstree_scan_stack_.get_current_key().full_string();
+  }
+  // the scan stack is reset before it is positioned again
+  std::string position(current_key.s, current_key.len);
+  current_key.assign(position.data(), position.size());
+  reset_record_buffer();
+
+  if (forward) {
+    index_scan_state_ = INDEX_SCAN_FORWARD;
+    return db20xx_table_->index_scan_range_first(
+        active_index, current_key, record, false, masstree_scan_stack_,
+        *thd_ctx, read_own_statement_);
+  } else {
+    index_scan_state_ = INDEX_SCAN_BACKWARD;
+    return db20xx_table_->index_rscan_range_first(
+        active_index, current_key, record, false, masstree_scan_stack_,
+        *thd_ctx, read_own_statement_);
+  }
+}
+
+int ha_db20xx::finish_index_read(int found, db20xx::Record *record,
+                                 uchar *mysql_record, int not_found_error,
+                                 db20xx::ThreadContext *thd_ctx) {
+  found = skip_rejected_index_rows(found, record, mysql_record, thd_ctx);
+  if (found == db20xx::DB20XX_SUCCESS) {
+    load_index_row(record, mysql_record);
+    if (exceeds_end_range(mysql_record)) {
+      buffer_end_ = true;
+      return not_found_error;
+    }
+    current_record_ = record;
+    return 0;
+  } else if (found == db20xx::DB20XX_ABORT) {
+    return HA_ERR_GENERIC;
+  } else
+    return not_found_error;
+}
+
+/**
+  @brief
+    only the columns in the read set are copied, the copy plan is rebuilt
+    when the read set changes, i.e. about once per statement. Rows of a
+    table modified by the statement are copied whole: update_row() stores
+    the whole row the server hands back.
+*/
+void ha_db20xx::update_row_projection() {
+  project_rows_ = false;
+  if (write_locked_ || read_own_statement_) return;
+
+  if (!projection_built_ ||
+      !bitmap_cmp(&projection_read_set_, table->read_set)) {
+    const db20xx::Schema &schema = db20xx_table_->get_schema();
+    std::vector<uint32_t> field_ids;
+    for (uint32_t i = 0; i < schema.field_num(); i++) {
+      if (bitmap_is_set(table->read_set, i)) field_ids.push_back(i);
+    }
+    bitmap_copy(&projection_read_set_, table->read_set);
+    row_projection_.build(schema, field_ids);
+    projection_built_ = true;
+  }
+  project_rows_ = true;
+}
+
+void ha_db20xx::load_row(db20xx::Record *record, uchar *mysql_record) {
+  if (project_rows_) {
+    record->load_projection_to_mysql((char *)mysql_record,
+                                     db20xx_table_->get_schema(),
+                                     row_projection_);
+  } else {
+    record->load_data_to_mysql((char *)mysql_record,
+                               db20xx_table_->get_schema());
+  }
+}
+
+void ha_db20xx::load_index_row(db20xx::Record *record, uchar *mysql_record) {
+  if (keyread_) {
+    record->load_fields_to_mysql(
+        (char *)mysql_record, db20xx_table_->get_schema(),
+        db20xx_table_->get_key_info(active_index).key_parts);
+  } else {
+    load_row(record, mysql_record);
+  }
+}
+
+/**
+  @brief
+    whether the row fails a pushed condition, checked on the payload so
+    that the row is not copied to the server. The payload is only built
+    if a condition applies to the scan.
+*/
+bool ha_db20xx::pushed_cond_rejects(db20xx::Record *record,
+                                    db20xx::ThreadContext *thd_ctx) const {
+  bool check_idx_cond = inited == INDEX &&
+                        active_index == pushed_idx_cond_keyno &&
+                        !pushed_idx_predicate_.empty();
+  if (pushed_predicate_.empty() && !check_idx_cond) return false;
+
+  const db20xx::Schema &schema = db20xx_table_->get_schema();
+  const char *payload = record->get_full_payload(
+      schema, thd_ctx->get_payload_container(schema.get_record_data_length()));
+  if (!pushed_predicate_.empty() && !pushed_predicate_.evaluate(payload))
+    return true;
+  return check_idx_cond && !pushed_idx_predicate_.evaluate(payload);
+}
+
+/**
+  @brief
+    move the index scan to the next entry in its current direction.
+*/
+int ha_db20xx::advance_index_scan(db20xx::Record *&record,
+                                  db20xx::ThreadContext *thd_ctx) {
+  switch (index_scan_state_) {
+    case INDEX_SCAN_FORWARD:
+      return db20xx_table_->index_scan_range_next(
+          active_index, record, masstree_scan_stack_, *thd_ctx,
+          read_own_statement_);
+    case INDEX_SCAN_PREFIX:
+      return db20xx_table_->index_prefix_search_next(
+          active_index, index_key_, record, masstree_scan_stack_, *thd_ctx,
+          read_own_statement_, prefix_scan_full_key_);
+    case INDEX_SCAN_BACKWARD:
+      return db20xx_table_->index_rscan_range_next(
+          active_index, record, masstree_scan_stack_, *thd_ctx,
+          read_own_statement_);
+    case INDEX_SCAN_NONE:
+      // a full key of a unique index maps to one version chain
+      break;
+  }
+  return db20xx::DB20XX_KEY_NOT_EXIST;
+}
+
+/**
+  @brief
+    skip index entries whose rows fail the pushed conditions. Only the key
+    columns of a skipped row are copied, to stop at the end of the range
+    instead of running through the rest of the index. The end range of a
+    descending scan is only set with a pushed index condition.
+*/
+int ha_db20xx::skip_rejected_index_rows(int found, db20xx::Record *&record,
+                                        uchar *mysql_record,
+                                        db20xx::ThreadContext *thd_ctx) {
+  bool check_end_range =
+      end_range != nullptr && mysql_record == table->record[0] &&
+      (index_scan_state_ != INDEX_SCAN_BACKWARD || pushed_idx_cond != nullptr);
+  while (found == db20xx::DB20XX_SUCCESS &&
+         pushed_cond_rejects(record, thd_ctx)) {
+    if (check_end_range) {
+      record->load_fields_to_mysql(
+          (char *)mysql_record, db20xx_table_->get_schema(),
+          db20xx_table_->get_key_info(active_index).key_parts);
+      if (compare_key_icp(end_range) > 0)
+        return db20xx::DB20XX_KEY_NOT_EXIST;
+    }
+    found = advance_index_scan(record, thd_ctx);
+  }
+  return found;
+}
+
+/**
+  @brief
+    once the server hands over a record buffer, it leaves the end range
+    check of ascending range scans to the storage engine. Descending scans
+    only set an end range with index condition pushdown.
+*/
+bool ha_db20xx::exceeds_end_range(const uchar *mysql_record) const {
+  const Record_buffer *buffer = ha_get_record_buffer();
+  return buffer != nullptr && !buffer->is_out_of_range() &&
+         end_range != nullptr && index_scan_state_ != INDEX_SCAN_BACKWARD &&
+         compare_key_in_buffer(mysql_record) > 0;
+}
+
+bool ha_db20xx::is_record_buffer_wanted(ha_rows *const max_rows) const {
+  // rows modified by the statement itself are read one at a time
+  if (read_own_statement_) {
+    *max_rows = 0;
+    return false;
+  }
+  *max_rows = db20xx::VersionChainHeadBlock::ENTRY_CAPACITY;
+  return true;
+}
+
+/**
+  @brief
+    forget the buffered rows, called when a scan is (re)positioned.
+*/
+void ha_db20xx::reset_record_buffer() {
+  buffered_records_.clear();
+  buffered_vchain_heads_.clear();
+  buffered_pos_ = 0;
+  buffer_end_ = false;
+  Record_buffer *buffer = ha_get_record_buffer();
+  if (buffer != nullptr) buffer->clear();
+}
+
+/**
+  @brief
+    return the next buffered row, fill the buffer with the next batch of
+    rows if all buffered rows have been returned.
+*/
+int ha_db20xx::read_buffered_row(uchar *mysql_record, Record_buffer *buffer) {
+  if (buffered_pos_ == buffer->records()) {
+    if (buffer_end_) return HA_ERR_END_OF_FILE;
+    buffer->clear();
+    buffered_records_.clear();
+    buffered_vchain_heads_.clear();
+    buffered_pos_ = 0;
+
+    int ret = inited == RND ? fill_rnd_record_buffer(mysql_record, buffer)
+                            : fill_index_record_buffer(mysql_record, buffer);
+    if (ret != 0) return ret;
+    if (buffer->records() == 0) return HA_ERR_END_OF_FILE;
+  }
+
+  // only the columns up to the last one read are kept in the buffer
+  memcpy(mysql_record, buffer->record(buffered_pos_), buffer->record_size());
+  if (!buffered_vchain_heads_.empty())
+    current_vchain_head_ = buffered_vchain_heads_[buffered_pos_];
+  current_record_ = buffered_records_[buffered_pos_++];
+  return 0;
+}
+
+int ha_db20xx::fill_rnd_record_buffer(uchar *mysql_record,
+                                      Record_buffer *buffer) {
+  if (column_scan_) return fill_column_record_buffer(buffer);
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  uint32_t max_num = static_cast<uint32_t>(buffer->max_records());
+
+  // rows failing the pushed conditions leave room for the next batch
+  while (!buffer_end_ && buffered_records_.size() < max_num) {
+    uint32_t kept = buffered_records_.size();
+    uint32_t num = 0;
+    buffered_records_.resize(max_num);
+    int ret = db20xx_table_->table_scan_get_batch(
+        seq_scan_cursor_, read_own_statement_, thd_ctx,
+        buffered_records_.data() + kept, max_num - kept, num);
+    if (ret == db20xx::DB20XX_RETRY || ret == db20xx::DB20XX_ABORT) {
+      buffered_records_.clear();
+      return HA_ERR_GENERIC;
+    }
+    if (num < max_num - kept) buffer_end_ = true;
+
+    for (uint32_t i = kept; i < kept + num; i++) {
+      if (!pushed_cond_rejects(buffered_records_[i], thd_ctx))
+        buffered_records_[kept++] = buffered_records_[i];
+    }
+    buffered_records_.resize(kept);
+  }
+
+  for (db20xx::Record *record : buffered_records_) {
+    load_row(record, mysql_record);
+    memcpy(buffer->add_record(), mysql_record, buffer->record_size());
+  }
+  return 0;
+}
+
+/**
+  @brief
+    rows served by column blocks come built, those read from version
+    chains are loaded by the row projection.
+*/
+int ha_db20xx::fill_column_record_buffer(Record_buffer *buffer) {
+  uint32_t max_num = static_cast<uint32_t>(buffer->max_records());
+  uint32_t row_length = table->s->reclength;
+  column_rows_.resize(static_cast<size_t>(max_num) * row_length);
+  buffered_records_.resize(max_num);
+  buffered_vchain_heads_.resize(max_num);
+  uint32_t num = 0;
+  int ret = db20xx_table_->column_scan_get_batch(
+      seq_scan_cursor_, column_scan_plan_, get_thread_ctx(),
+      column_rows_.data(), row_length, buffered_records_.data(),
+      buffered_vchain_heads_.data(), max_num, num);
+  if (ret != db20xx::DB20XX_SUCCESS && ret != db20xx::DB20XX_END_OF_TABLE) {
+    reset_record_buffer();
+    return HA_ERR_GENERIC;
+  }
+  if (num < max_num) buffer_end_ = true;
+  buffered_records_.resize(num);
+  buffered_vchain_heads_.resize(num);
+
+  for (uint32_t i = 0; i < num; i++) {
+    uchar *row = reinterpret_cast<uchar *>(&column_rows_[i * row_length]);
+    if (buffered_records_[i] != nullptr) load_row(buffered_records_[i], row);
+    memcpy(buffer->add_record(), row, buffer->record_size());
+  }
+  return 0;
+}
+
+/**
+  @brief
+    decide whether the table scan reads column blocks, after the row
+    projection is updated.
+*/
+void ha_db20xx::update_column_scan() {
+  column_scan_ = false;
+  if (!project_rows_ || !db20xx_table_->is_columnar() ||
+      !get_thread_ctx()->get_transaction_context()->is_read_only())
+    return;
+  const db20xx::Schema &schema = db20xx_table_->get_schema();
+  std::vector<uint32_t> field_ids;
+  for (uint32_t i = 0; i < schema.field_num(); i++) {
+    if (bitmap_is_set(&projection_read_set_, i)) field_ids.push_back(i);
+  }
+  column_scan_ = column_scan_plan_.build(db20xx_table_->get_column_layout(),
+                                         field_ids, pushed_predicate_);
+}
+
+int ha_db20xx::fill_index_record_buffer(uchar *mysql_record,
+                                        Record_buffer *buffer) {
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  while (buffer->records() < buffer->max_records()) {
+    db20xx::Record *record = nullptr;
+    int found = advance_index_scan(record, thd_ctx);
+    found = skip_rejected_index_rows(found, record, mysql_record, thd_ctx);
+    if (found == db20xx::DB20XX_ABORT) return HA_ERR_GENERIC;
+    if (found != db20xx::DB20XX_SUCCESS) {
+      buffer_end_ = true;
+      break;
+    }
+
+    load_index_row(record, mysql_record);
+    if (exceeds_end_range(mysql_record)) {
+      buffer->set_out_of_range(true);
+      buffer_end_ = true;
+      break;
+    }
+    memcpy(buffer->add_record(), mysql_record, buffer->record_size());
+    buffered_records_.push_back(record);
+  }
+  return 0;
 }
 
 /**
@@ -528,6 +1215,9 @@ int ha_db20xx::index_last(uchar *) {
 int ha_db20xx::rnd_init(bool) {
   DBUG_TRACE;
   seq_scan_cursor_.reset();
+  reset_record_buffer();
+  update_row_projection();
+  update_column_scan();
 
   return 0;
 }
@@ -558,27 +1248,33 @@ int ha_db20xx::rnd_next(uchar *sl_record) {
   int ret = db20xx::DB20XX_SUCCESS;
   db20xx::ThreadContext *thd_ctx = get_thread_ctx();
 
-  ret = db20xx_table_->table_scan_get(seq_scan_cursor_, read_own_statement_,
-                                      thd_ctx);
-  if (ret == db20xx::DB20XX_END_OF_TABLE) return HA_ERR_END_OF_FILE;
-
-  if (ret == db20xx::DB20XX_RETRY || ret == db20xx::DB20XX_FAIL
-      || ret == db20xx::DB20XX_ABORT) {
-    // db20xx::LOG_DEBUG("can not read a visible version, abort");
-    return HA_ERR_GENERIC;
+  Record_buffer *buffer = ha_get_record_buffer();
+  if (buffer != nullptr) {
+    ret = read_buffered_row(sl_record, buffer);
+    if (ret == 0) table->set_found_row();
+    return ret;
   }
 
-  if (ret == db20xx::DB20XX_INVISIBLE_VERSION ||
-      ret == db20xx::DB20XX_DELETED_VERSION) {
+  while (true) {
+    ret = db20xx_table_->table_scan_get(seq_scan_cursor_, read_own_statement_,
+                                        thd_ctx);
+    if (ret == db20xx::DB20XX_END_OF_TABLE) return HA_ERR_END_OF_FILE;
+
+    if (ret == db20xx::DB20XX_RETRY || ret == db20xx::DB20XX_FAIL
+        || ret == db20xx::DB20XX_ABORT) {
+      // db20xx::LOG_DEBUG("can not read a visible version, abort");
+      return HA_ERR_GENERIC;
+    }
+
+    // skip invisible/deleted versions and rows failing the pushed condition
+    if (ret == db20xx::DB20XX_SUCCESS &&
+        !pushed_cond_rejects(seq_scan_cursor_.record_, thd_ctx))
+      break;
     seq_scan_cursor_.inc_cursor();
-    return rnd_next(sl_record);
   }
 
-  assert(ret == db20xx::DB20XX_SUCCESS);
-
   // At this point, we've got a visible record version
-  seq_scan_cursor_.record_->load_data_to_mysql((char *)sl_record,
-                                               db20xx_table_->get_schema());
+  load_row(seq_scan_cursor_.record_, sl_record);
   table->set_found_row();
   seq_scan_cursor_.inc_cursor();
   current_record_ = seq_scan_cursor_.record_;
@@ -607,7 +1303,19 @@ int ha_db20xx::rnd_next(uchar *sl_record) {
   @see
   filesort.cc, sql_select.cc, sql_delete.cc and sql_update.cc
 */
-void ha_db20xx::position(const uchar *) { DBUG_TRACE; }
+void ha_db20xx::position(const uchar *) {
+  DBUG_TRACE;
+  uint32_t block_id = 0;
+  uint32_t idx_in_block = 0;
+  if (current_record_ != nullptr)
+    db20xx::Table::get_record_location(current_record_, block_id,
+                                       idx_in_block);
+  else
+    db20xx::Table::get_vchain_head_location(current_vchain_head_, block_id,
+                                            idx_in_block);
+  int4store(ref, block_id);
+  int4store(ref + sizeof(uint32_t), idx_in_block);
+}
 
 /**
   @brief
@@ -623,11 +1331,25 @@ void ha_db20xx::position(const uchar *) { DBUG_TRACE; }
   @see
   filesort.cc, records.cc, sql_insert.cc, sql_select.cc and sql_update.cc
 */
-int ha_db20xx::rnd_pos(uchar *, uchar *) {
-  int rc;
+int ha_db20xx::rnd_pos(uchar *sl_record, uchar *pos) {
   DBUG_TRACE;
-  rc = HA_ERR_WRONG_COMMAND;
-  return rc;
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  uint32_t block_id = uint4korr(pos);
+  uint32_t idx_in_block = uint4korr(pos + sizeof(uint32_t));
+  db20xx::Record *record = nullptr;
+
+  int ret = db20xx_table_->get_record_by_location(
+      block_id, idx_in_block, record, thd_ctx, read_own_statement_);
+  if (ret == db20xx::DB20XX_RETRY || ret == db20xx::DB20XX_FAIL ||
+      ret == db20xx::DB20XX_ABORT)
+    return HA_ERR_GENERIC;
+  // the row has been deleted, or is not visible to us
+  if (ret != db20xx::DB20XX_SUCCESS) return HA_ERR_KEY_NOT_FOUND;
+
+  load_row(record, sl_record);
+  table->set_found_row();
+  current_record_ = record;
+  return 0;
 }
 
 /**
@@ -668,8 +1390,70 @@ int ha_db20xx::rnd_pos(uchar *, uchar *) {
   sql_select.cc, sql_select.cc, sql_show.cc, sql_show.cc, sql_show.cc,
   sql_show.cc, sql_table.cc, sql_union.cc and sql_update.cc
 */
-int ha_db20xx::info(uint) {
+int ha_db20xx::info(uint flag) {
   DBUG_TRACE;
+  if (flag & HA_STATUS_VARIABLE) {
+    db20xx::TableStats table_stats;
+    db20xx_table_->get_table_stats(table_stats);
+    stats.records = table_stats.record_num_;
+    stats.deleted = table_stats.deleted_version_num_;
+    stats.data_file_length = table_stats.data_length_;
+    stats.index_file_length = table_stats.index_length_;
+    stats.mean_rec_length =
+        stats.records ? stats.data_file_length / stats.records : 0;
+  }
+
+  if (flag & HA_STATUS_CONST) {
+    db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+    db20xx::TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+    // sampling walks the indexes and reads the versions they lead to, which
+    // must be done inside a transaction and an index epoch
+    bool on_going = txn_ctx->on_going();
+    if (!on_going) {
+      if (!txn_ctx->begin_read_only_transaction(thd_ctx->get_thread_id()))
+        txn_ctx->begin_transaction(thd_ctx->get_thread_id());
+      thd_ctx->enter_index_epoch();
+    }
+
+    std::vector<double> rec_per_key;
+    for (uint i = 0; i < table->s->keys; i++) {
+      KEY *key = table->key_info + i;
+      key->set_in_memory_estimate(1.0);  // Index is in memory
+      if (!key->supports_records_per_key()) continue;
+
+      db20xx_table_->get_rec_per_key(i, rec_per_key, thd_ctx);
+      for (uint j = 0;
+           j < key->user_defined_key_parts && j < rec_per_key.size(); j++) {
+        if (rec_per_key[j] <= 0) continue;
+        key->rec_per_key[j] = static_cast<ulong>(rec_per_key[j] + 0.5);
+        key->set_records_per_key(j, static_cast<rec_per_key_t>(rec_per_key[j]));
+      }
+    }
+
+    if (!on_going) {
+      thd_ctx->exit_index_epoch();
+      // nothing is modified, so nothing is left to commit
+      txn_ctx->abort();
+    }
+  }
+  return 0;
+}
+
+/**
+  @brief
+  records() returns the exact number of rows visible to the running
+  transaction, used by SELECT COUNT(*) instead of a full table scan.
+*/
+int ha_db20xx::records(ha_rows *num_rows) {
+  DBUG_TRACE;
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  uint64_t count = 0;
+  int ret = db20xx_table_->count_records(count, read_own_statement_, thd_ctx);
+  if (ret != db20xx::DB20XX_SUCCESS) {
+    *num_rows = HA_POS_ERROR;
+    return HA_ERR_GENERIC;
+  }
+  *num_rows = count;
   return 0;
 }
 
@@ -682,11 +1466,79 @@ int ha_db20xx::info(uint) {
     @see
   ha_innodb.cc
 */
-int ha_db20xx::extra(enum ha_extra_function) {
+int ha_db20xx::extra(enum ha_extra_function operation) {
   DBUG_TRACE;
+  switch (operation) {
+    case HA_EXTRA_KEYREAD:
+      keyread_ = true;
+      break;
+    case HA_EXTRA_NO_KEYREAD:
+      keyread_ = false;
+      break;
+    case HA_EXTRA_IGNORE_DUP_KEY:
+    case HA_EXTRA_WRITE_CAN_REPLACE:
+    case HA_EXTRA_INSERT_WITH_UPDATE:
+      handle_dup_key_ = true;
+      break;
+    case HA_EXTRA_NO_IGNORE_DUP_KEY:
+    case HA_EXTRA_WRITE_CANNOT_REPLACE:
+      handle_dup_key_ = false;
+      break;
+    default:
+      break;
+  }
   return 0;
 }
 
+/**
+  @brief
+  reset() is called at the end of a statement, undo what extra() did.
+*/
+int ha_db20xx::reset() {
+  DBUG_TRACE;
+  keyread_ = false;
+  handle_dup_key_ = false;
+  pushed_predicate_.clear();
+  return 0;
+}
+
+/**
+  @brief
+  Compile the comparisons of a pushed condition that can be checked on
+  db20xx records, scans skip rows failing them. Partly compiled conditions
+  are returned as a whole to be evaluated by the server again.
+*/
+const Item *ha_db20xx::cond_push(const Item *cond) {
+  DBUG_TRACE;
+  pushed_predicate_.clear();
+  bool all_compiled = compile_pushed_condition(
+      cond, table, db20xx_table_->get_schema(), pushed_predicate_);
+  if (pushed_predicate_.empty()) return cond;
+  pushed_cond = cond;
+  return all_compiled ? nullptr : cond;
+}
+
+/**
+  @brief
+  Index condition pushdown. The whole row is at hand when an index entry is
+  read, so the condition may refer to any column of the table.
+*/
+Item *ha_db20xx::idx_cond_push(uint keyno, Item *idx_cond) {
+  DBUG_TRACE;
+  pushed_idx_predicate_.clear();
+  bool all_compiled = compile_pushed_condition(
+      idx_cond, table, db20xx_table_->get_schema(), pushed_idx_predicate_);
+  if (pushed_idx_predicate_.empty()) return idx_cond;
+  pushed_idx_cond = idx_cond;
+  pushed_idx_cond_keyno = keyno;
+  return all_compiled ? nullptr : idx_cond;
+}
+
+void ha_db20xx::cancel_pushed_idx_cond() {
+  handler::cancel_pushed_idx_cond();
+  pushed_idx_predicate_.clear();
+}
+
 /**
   @brief
   Used to delete all rows in a table, including cases of truncate and cases
@@ -740,26 +1592,48 @@ int ha_db20xx::external_lock(THD *thd, int lock_type) {
         (sql_command == SQLCOM_UPDATE || sql_command == SQLCOM_DELETE ||
          sql_command == SQLCOM_UPDATE_MULTI ||
          sql_command == SQLCOM_DELETE_MULTI);
+    write_locked_ = lock_type == F_WRLCK;
 
-    db20xx::ThreadContext *thd_ctx = get_thread_ctx();
-    db20xx::TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
-    if (!txn_ctx->on_going()) {
-      uint64_t thread_id = thd_ctx->get_thread_id();
-      txn_ctx->begin_transaction(thread_id);
-      // register in statement level
-      // FIXME: set 4th arg correctly (pointer to transaction id)
-      trans_register_ha(thd, false, ht, nullptr);
-
-      if ((thd->in_multi_stmt_transaction_mode())) {
-        // register in session level
-        trans_register_ha(thd, true, ht, nullptr);
-      }
-    }
+    begin_transaction_if_needed(thd);
   }
 
   return 0;
 }
 
+/**
+  @brief
+  START TRANSACTION READ ONLY, or an autocommit SELECT that calls no stored
+  routine (which may write), runs as a read-only snapshot transaction.
+*/
+static bool is_read_only_transaction(THD *thd) {
+  if (thd_tx_is_read_only(thd)) return true;
+  return thd_sql_command(thd) == SQLCOM_SELECT &&
+         !thd->in_multi_stmt_transaction_mode() &&
+         !thd->lex->uses_stored_routines();
+}
+
+void ha_db20xx::begin_transaction_if_needed(THD *thd) {
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  db20xx::TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  if (!txn_ctx->on_going()) {
+    uint64_t thread_id = thd_ctx->get_thread_id();
+    // a snapshot missing our last commit can not serve us, a regular
+    // transaction reads the latest versions
+    if (!is_read_only_transaction(thd) ||
+        !txn_ctx->begin_read_only_transaction(thread_id))
+      txn_ctx->begin_transaction(thread_id);
+    thd_ctx->enter_index_epoch();
+    // register in statement level
+    // FIXME: set 4th arg correctly (pointer to transaction id)
+    trans_register_ha(thd, false, ht, nullptr);
+
+    if ((thd->in_multi_stmt_transaction_mode())) {
+      // register in session level
+      trans_register_ha(thd, true, ht, nullptr);
+    }
+  }
+}
+
 /**
   @brief
   The idea with handler::store_lock() is: The statement decides which locks
@@ -861,11 +1735,173 @@ int ha_db20xx::rename_table(const char *, const char *, const dd::Table *,
   @see
   check_quick_keys() in opt_range.cc
 */
-ha_rows ha_db20xx::records_in_range(uint, key_range *, key_range *) {
+ha_rows ha_db20xx::records_in_range(uint inx, key_range *min_key,
+                                     key_range *max_key) {
+  DBUG_TRACE;
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  bool full_key_search = true;
+
+  // both keys are built in the key container of thd_ctx
+  std::string min_key_data;
+  db20xx::Key db20xx_min_key;
+  if (min_key != nullptr) {
+    build_key_from_mysql_key(inx, min_key->key, min_key->keypart_map,
+                             db20xx_min_key, full_key_search);
+    min_key_data.assign(db20xx_min_key.s, db20xx_min_key.len);
+    db20xx_min_key.assign(min_key_data.data(), min_key_data.size());
+  }
+  db20xx::Key db20xx_max_key;
+  if (max_key != nullptr) {
+    build_key_from_mysql_key(inx, max_key->key, max_key->keypart_map,
+                             db20xx_max_key, full_key_search);
+  }
+
+  bool in_index_epoch = thd_ctx->get_transaction_context()->on_going();
+  if (!in_index_epoch) thd_ctx->enter_index_epoch();
+  double rows = db20xx_table_->records_in_range(
+      inx, min_key ? &db20xx_min_key : nullptr,
+      min_key == nullptr || min_key->flag != HA_READ_AFTER_KEY,
+      max_key ? &db20xx_max_key : nullptr,
+      max_key == nullptr || max_key->flag != HA_READ_BEFORE_KEY);
+  if (!in_index_epoch) thd_ctx->exit_index_epoch();
+
+  // 0 tells the optimizer that the range is empty, we are never sure
+  return std::max<ha_rows>(static_cast<ha_rows>(rows + 0.5), 1);
+}
+
+static MYSQL_THDVAR_ULONG(parallel_read_threads, PLUGIN_VAR_RQCMDARG,
+                          "Number of threads of a parallel table scan.",
+                          nullptr, nullptr, 4, 1, 256, 0);
+
+int ha_db20xx::parallel_scan_init(void *&scan_ctx, size_t *num_threads,
+                                  bool) {
+  DBUG_TRACE;
+  THD *thd = ha_thd();
+  begin_transaction_if_needed(thd);
+  db20xx::ThreadContext *thd_ctx = get_thread_ctx();
+  size_t thread_num = THDVAR(thd, parallel_read_threads);
+
+  // workers read as of the snapshot of the running transaction
+  db20xx::TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  scan_ctx = new ParallelScanContext(
+      db20xx_table_->get_vchain_head_block_num(), thread_num,
+      txn_ctx->get_transaction_id(), txn_ctx->is_read_only(),
+      thd_ctx->get_thread_id());
+  *num_threads = thread_num;
+  return 0;
+}
+
+/**
+  @brief
+  Run the parallel scan, every worker thread claims ranges of version
+  chain head blocks and hands the visible rows to load_fn in batches.
+*/
+int ha_db20xx::parallel_scan(void *scan_ctx, void **thread_ctxs,
+                             Load_init_cbk init_fn, Load_cbk load_fn,
+                             Load_end_cbk end_fn) {
+  DBUG_TRACE;
+  ParallelScanContext *ctx = static_cast<ParallelScanContext *>(scan_ctx);
+  // layout of the mysql rows handed to load_fn
+  for (uint i = 0; i < table->s->fields; i++) {
+    Field *field = table->field[i];
+    ctx->col_offsets_.push_back(field->offset(table->record[0]));
+    ctx->null_byte_offsets_.push_back(
+        field->is_nullable() ? field->null_offset(table->record[0]) : 0);
+    ctx->null_bitmasks_.push_back(field->is_nullable() ? field->null_bit : 0);
+  }
+  ctx->row_len_ = table->s->reclength;
+
+  std::atomic<int> error(0);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < ctx->thread_num_; i++) {
+    workers.emplace_back([&, i]() {
+      int ret = parallel_scan_worker(ctx, thread_ctxs[i], init_fn, load_fn,
+                                     end_fn, error);
+      int expected = 0;
+      if (ret != 0) error.compare_exchange_strong(expected, ret);
+    });
+  }
+  for (auto &worker : workers) worker.join();
+  return error.load();
+}
+
+int ha_db20xx::parallel_scan_worker(ParallelScanContext *ctx, void *thread_ctx,
+                                    Load_init_cbk &init_fn, Load_cbk &load_fn,
+                                    Load_end_cbk &end_fn,
+                                    std::atomic<int> &error) {
+  if (init_fn(thread_ctx, ctx->col_offsets_.size(), ctx->row_len_,
+              ctx->col_offsets_.data(), ctx->null_byte_offsets_.data(),
+              ctx->null_bitmasks_.data()))
+    return HA_ERR_QUERY_INTERRUPTED;
+
+  db20xx::ThreadContext worker_ctx(ctx->thread_id_);
+  db20xx::TransactionContext *txn_ctx = worker_ctx.get_transaction_context();
+  txn_ctx->begin_snapshot_read(ctx->snapshot_transaction_id_, ctx->thread_id_,
+                               ctx->read_only_);
+
+  const db20xx::Schema &schema = db20xx_table_->get_schema();
+  uint32_t batch_size = std::min<uint32_t>(
+      db20xx::VersionChainHeadBlock::ENTRY_CAPACITY,
+      std::max<ulong>(PARALLEL_SCAN_BUFFER_SIZE / ctx->row_len_, 1));
+  std::vector<db20xx::Record *> records(batch_size);
+  std::vector<uchar> rows(batch_size * ctx->row_len_);
+
+  int ret = 0;
+  uint32_t begin_block_id = 0;
+  uint32_t end_block_id = 0;
+  while (ret == 0 && error.load() == 0 &&
+         ctx->table_scan_.claim_blocks(begin_block_id, end_block_id)) {
+    db20xx::TableScanCursor cursor;
+    cursor.reset(begin_block_id, end_block_id);
+    uint32_t num = 0;
+    int status = db20xx::DB20XX_SUCCESS;
+    while (error.load() == 0 &&
+           (status = db20xx_table_->table_scan_get_batch(
+                cursor, false, &worker_ctx, records.data(), batch_size,
+                num)) == db20xx::DB20XX_SUCCESS) {
+      for (uint32_t i = 0; i < num; i++)
+        records[i]->load_data_to_mysql((char *)&rows[i * ctx->row_len_],
+                                       schema);
+      if (load_fn(thread_ctx, num, rows.data(),
+                  std::numeric_limits<uint64_t>::max())) {
+        ret = HA_ERR_QUERY_INTERRUPTED;
+        break;
+      }
+    }
+    if (status == db20xx::DB20XX_ABORT || status == db20xx::DB20XX_RETRY)
+      ret = HA_ERR_GENERIC;
+  }
+
+  txn_ctx->end_snapshot_read();
+  end_fn(thread_ctx);
+  return ret;
+}
+
+void ha_db20xx::parallel_scan_end(void *scan_ctx) {
   DBUG_TRACE;
-  return 10;  // low number to force index usage
+  delete static_cast<ParallelScanContext *>(scan_ctx);
 }
 
+static MYSQL_THDVAR_UINT(
+    records_per_block, PLUGIN_VAR_RQCMDARG,
+    "Number of record slots in a record block of tables created by the "
+    "session, a writing thread takes a whole block at a time.",
+    nullptr, nullptr, db20xx::Table::DEFAULT_RECORDS_PER_BLOCK, 16,
+    1024 * 1024, 0);
+
+static const char *storage_layout_names[] = {"ROW", "COLUMNAR", NullS};
+
+static TYPELIB storage_layout_typelib = {
+    array_elements(storage_layout_names) - 1, "storage_layout_typelib",
+    storage_layout_names, nullptr};
+
+static MYSQL_THDVAR_ENUM(
+    storage_layout, PLUGIN_VAR_RQCMDARG,
+    "Layout of tables created by the session. COLUMNAR tables also keep "
+    "their fixed-size columns column-major, for scans of read-only "
+    "transactions.",
+    nullptr, nullptr, db20xx::STORAGE_LAYOUT_ROW, &storage_layout_typelib);
+
 static MYSQL_THDVAR_STR(last_create_thdvar, PLUGIN_VAR_MEMALLOC, nullptr,
                         nullptr, nullptr, nullptr);
 
@@ -911,17 +1947,11 @@ int ha_db20xx::create(const char *name, TABLE *form,
   schema.set_null_byte_length(sl_row_null_bytes);
   generate_db20xx_schema(form, schema);
 
-  auto fgdb_table = db->create_table(fgdb_table_name, schema);
-  if (fgdb_table == nullptr) {
-    ret = HA_ERR_GENERIC;
-    return ret;
-  }
-
-  db20xx::threadinfo_type *ti = get_threadinfo();
   // TABLE_SHARE::keys表示索引的个数
   // TABLE::key_info[]中保存了索引键的信息
+  std::vector<db20xx::KeyInfo> keyinfos(table->s->keys);
   for (size_t i = 0; i < table->s->keys; i++) {
-    db20xx::KeyInfo keyinfo;
+    db20xx::KeyInfo &keyinfo = keyinfos[i];
     keyinfo.schema = schema;
 
     KEY &mysql_key_info = table->key_info[i];
@@ -929,13 +1959,35 @@ int ha_db20xx::create(const char *name, TABLE *form,
         mysql_key_info.key_part + mysql_key_info.user_defined_key_parts;
     for (KEY_PART_INFO *keypart = mysql_key_info.key_part;
          keypart != keypart_end; keypart++) {
-      keyinfo.add_key_part(keypart->fieldnr);
+      keyinfo.add_key_part(keypart->fieldnr, keypart->length);
       keyinfo.key_len += keypart->length;
     }
+    // rows with null in a unique key must not collide, the others are
+    // still checked for duplicates
+    bool nosame = (mysql_key_info.flags & HA_NOSAME) != 0;
+    bool null_part = (mysql_key_info.flags & HA_NULL_PART_KEY) != 0;
+    keyinfo.unique = nosame && !null_part;
+    keyinfo.nullable_unique = nosame && null_part;
+
+    // sort keys of collated strings may not fit in the key containers
+    db20xx::KeyEncodePlan key_plan;
+    key_plan.build(schema, keyinfo.key_parts, keyinfo.key_part_lengths);
+    if (key_plan.get_max_length() > db20xx::DB20XX_MAX_ENCODED_KEY_LENGTH)
+      return HA_ERR_INDEX_COL_TOO_LONG;
+  }
 
-    fgdb_table->build_index(keyinfo, *ti);
+  auto fgdb_table = db->create_table(
+      fgdb_table_name, schema, THDVAR(ha_thd(), records_per_block),
+      static_cast<db20xx::StorageLayout>(THDVAR(ha_thd(), storage_layout)));
+  if (fgdb_table == nullptr) {
+    ret = HA_ERR_GENERIC;
+    return ret;
   }
 
+  db20xx::threadinfo_type *ti = get_threadinfo();
+  for (auto &keyinfo : keyinfos) fgdb_table->build_index(keyinfo, *ti);
+
+  db20xx::LogManager::log_create_table(fgdb_dbname, fgdb_table);
   return ret;
 }
 
@@ -953,12 +2005,17 @@ int db20xx_commit(handlerton *hton, THD *thd, bool all) {
 
   if (txn_ctx->get_transaction_status() == db20xx::DB20XX_TRANSACTION_ABORT) {
     txn_ctx->abort();
+    thd_ctx->exit_index_epoch();
     return HA_ERR_LOCK_DEADLOCK;  // DB_FORCE_ABORT: same as innodb
   }
 
   bool real_commit = all || !thd->in_multi_stmt_transaction_mode();
   if (real_commit) {
     txn_ctx->commit();
+    thd_ctx->exit_index_epoch();
+  } else {
+    // end of statement, no index node is referenced anymore
+    thd_ctx->refresh_index_epoch();
   }
 
   return 0;
@@ -973,10 +2030,44 @@ int db20xx_rollback(handlerton *hton, THD *thd, bool all) {
   bool real_commit = all || thd->in_active_multi_stmt_transaction();
   if (real_commit) {
     txn_ctx->abort();
+    thd_ctx->exit_index_epoch();
+  } else {
+    thd_ctx->refresh_index_epoch();
   }
   return 0;
 }
 
+/**
+  The connection is going away, return its threadinfo to the pool.
+*/
+static int db20xx_close_connection(handlerton *hton, THD *thd) {
+  db20xx::ThreadContext *thd_ctx = reinterpret_cast<db20xx::ThreadContext *>(
+      thd->get_ha_data(hton->slot)->ha_ptr);
+  if (thd_ctx == nullptr) return 0;
+
+  db20xx::TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  if (txn_ctx->on_going()) txn_ctx->abort();
+  delete thd_ctx;
+  thd->get_ha_data(hton->slot)->ha_ptr = nullptr;
+  return 0;
+}
+
+static ulong srv_flush_log_at_commit = 1;
+
+static void update_flush_log_at_commit(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                       const void *save) {
+  *static_cast<ulong *>(var_ptr) = *static_cast<const ulong *>(save);
+  db20xx::LogManager::set_flush_log_at_commit(srv_flush_log_at_commit);
+}
+
+static MYSQL_SYSVAR_ULONG(
+    flush_log_at_commit, srv_flush_log_at_commit, PLUGIN_VAR_OPCMDARG,
+    "Controls the durability of committed transactions. "
+    "0: write and sync the redo log once per second, "
+    "1: write and sync the redo log at each commit, "
+    "2: write the redo log at each commit and sync it once per second.",
+    nullptr, update_flush_log_at_commit, 1, 0, 2, 0);
+
 static int db20xx_init_func(void *p) {
   DBUG_TRACE;
 
@@ -985,10 +2076,21 @@ static int db20xx_init_func(void *p) {
   db20xx_hton->create = db20xx_create_handler;
   db20xx_hton->commit = db20xx_commit;
   db20xx_hton->rollback = db20xx_rollback;
+  db20xx_hton->close_connection = db20xx_close_connection;
   db20xx_hton->flags = HTON_CAN_RECREATE;
   db20xx_hton->is_supported_system_table = db20xx_is_supported_system_table;
 
-  db20xx::Engine::init();
+  db20xx::LogManager::set_flush_log_at_commit(srv_flush_log_at_commit);
+  // recovery rebuilds indexes
+  set_collation_hooks();
+  db20xx::Engine::init(mysql_real_data_home);
+  return 0;
+}
+
+static int db20xx_deinit_func(void *) {
+  DBUG_TRACE;
+
+  db20xx::Engine::deinit();
   return 0;
 }
 
@@ -1053,6 +2155,10 @@ static MYSQL_THDVAR_LONGLONG(signed_longlong_thdvar, PLUGIN_VAR_RQCMDARG,
                              LLONG_MIN, LLONG_MAX, 0);
 
 static SYS_VAR *db20xx_system_variables[] = {
+    MYSQL_SYSVAR(flush_log_at_commit),
+    MYSQL_SYSVAR(parallel_read_threads),
+    MYSQL_SYSVAR(records_per_block),
+    MYSQL_SYSVAR(storage_layout),
     MYSQL_SYSVAR(enum_var),
     MYSQL_SYSVAR(ulong_var),
     MYSQL_SYSVAR(double_var),
@@ -1125,7 +2231,7 @@ mysql_declare_plugin(db20xx){
     PLUGIN_LICENSE_GPL,
     db20xx_init_func, /* Plugin Init */
     nullptr,            /* Plugin check uninstall */
-    nullptr,            /* Plugin Deinit */
+    db20xx_deinit_func, /* Plugin Deinit */
     0x0001 /* 0.1 */,
     func_status,               /* status variables */
     db20xx_system_variables, /* system variables */
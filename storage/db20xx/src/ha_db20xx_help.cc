@@ -1,18 +1,40 @@
 #include "ha_db20xx_help.h"
 #include <sys/types.h>
+#include <algorithm>
 #include <cstdint>
 #include <iterator>
+#include "key_encode_plan.h"
+#include "m_ctype.h"
+#include "my_sys.h"
+#include "sql/field.h"
+#include "sql/item.h"
+#include "sql/item_cmpfunc.h"
+#include "sql/item_func.h"
+#include "sql/table.h"
 #include "thread_context.h"
 
+/**
+@brief
+  attributes of a column that order its values in index keys
+*/
+static void set_key_attributes(db20xx::Field &se_field, Field *sl_fieldp) {
+  se_field.set_unsigned(sl_fieldp->is_unsigned());
+  if (sl_fieldp->is_nullable())
+    se_field.set_null_bit(sl_fieldp->null_offset(), sl_fieldp->null_bit);
+  if (sl_fieldp->has_charset() && sl_fieldp->charset() != &my_charset_bin)
+    se_field.set_collation_id(sl_fieldp->charset()->number);
+}
+
 static void schema_add_inline_field(db20xx::Schema &schema,
                                     db20xx::TYPE_ID type_id,
-                                    const std::string &field_name,
+                                    Field *sl_fieldp,
                                     uint32_t data_bytes,
                                     uint32_t &offset_in_db20xx_rec,
                                     uint32_t &offset_in_mysql_rec) {
-  db20xx::Field se_field(type_id, field_name, data_bytes,
+  db20xx::Field se_field(type_id, sl_fieldp->field_name, data_bytes,
                            offset_in_db20xx_rec, db20xx::Field::STORE_INLINE,
                            data_bytes, offset_in_mysql_rec);
+  set_key_attributes(se_field, sl_fieldp);
   offset_in_db20xx_rec += data_bytes;
   offset_in_mysql_rec += data_bytes;
 
@@ -21,17 +43,19 @@ static void schema_add_inline_field(db20xx::Schema &schema,
 
 static void schema_add_non_inline_field(db20xx::Schema &schema,
                                         db20xx::TYPE_ID type_id,
-                                        const std::string &field_name,
+                                        Field *sl_fieldp,
                                         uint32_t length_bytes,
                                         uint32_t &offset_in_db20xx_rec,
                                         uint32_t &offset_in_mysql_rec,
                                         uint32_t mysql_pack_length) {
   // non-inline方式存储的数据, field中的内容为(length_bytes + external data ptr)
-  db20xx::Field se_field(type_id, field_name, length_bytes + sizeof(uint64_t),
+  db20xx::Field se_field(type_id, sl_fieldp->field_name,
+                           length_bytes + sizeof(uint64_t),
                            offset_in_db20xx_rec,
                            db20xx::Field::STORE_NON_INLINE, mysql_pack_length,
                            offset_in_mysql_rec);
   se_field.set_mysql_length_bytes(length_bytes);
+  set_key_attributes(se_field, sl_fieldp);
   offset_in_db20xx_rec += (length_bytes + sizeof(uint64_t));
   offset_in_mysql_rec += mysql_pack_length;
 
@@ -41,95 +65,95 @@ static void schema_add_non_inline_field(db20xx::Schema &schema,
  */
 void generate_db20xx_schema(TABLE *form, db20xx::Schema &schema) {
   uint32_t field_num = form->s->fields;
-  Field **sl_fieldp_array = form->s->field;
+  // fields of the opened table, their null offsets are known
+  Field **sl_fieldp_array = form->field;
   uint32_t offset_in_db20xx_rec = form->s->null_bytes;
   uint32_t offset_in_mysql_rec = form->s->null_bytes;
   for (uint32_t i = 0; i < field_num; i++) {
     Field *sl_fieldp = sl_fieldp_array[i];
-    std::string field_name(sl_fieldp->field_name);
     uint32_t data_bytes = sl_fieldp->pack_length();
     // see {project_root}/include/field_types.h
     switch (sl_fieldp->type()) {
       case MYSQL_TYPE_TINY:
-        schema_add_inline_field(schema, db20xx::TINYINT_ID, field_name,
+        schema_add_inline_field(schema, db20xx::TINYINT_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_SHORT:
-        schema_add_inline_field(schema, db20xx::SMALLINT_ID, field_name,
+        schema_add_inline_field(schema, db20xx::SMALLINT_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_INT24:
-        schema_add_inline_field(schema, db20xx::MEDIUMINT_ID, field_name,
+        schema_add_inline_field(schema, db20xx::MEDIUMINT_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_LONG:
-        schema_add_inline_field(schema, db20xx::INT_ID, field_name,
+        schema_add_inline_field(schema, db20xx::INT_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_LONGLONG:
-        schema_add_inline_field(schema, db20xx::BIGINT_ID, field_name,
+        schema_add_inline_field(schema, db20xx::BIGINT_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_FLOAT:
-        schema_add_inline_field(schema, db20xx::FLOAT_ID, field_name,
+        schema_add_inline_field(schema, db20xx::FLOAT_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_DOUBLE:
-        schema_add_inline_field(schema, db20xx::DOUBLE_ID, field_name,
+        schema_add_inline_field(schema, db20xx::DOUBLE_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_STRING:
-        schema_add_inline_field(schema, db20xx::CHAR_ID, field_name,
+        schema_add_inline_field(schema, db20xx::CHAR_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_VARCHAR:
-        schema_add_non_inline_field(schema, db20xx::VARCHAR_ID, field_name,
+        schema_add_non_inline_field(schema, db20xx::VARCHAR_ID, sl_fieldp,
                                     sl_fieldp->get_length_bytes(),
                                     offset_in_db20xx_rec, offset_in_mysql_rec,
                                     data_bytes);
         break;
       case MYSQL_TYPE_DECIMAL:
       case MYSQL_TYPE_NEWDECIMAL:
-        schema_add_inline_field(schema, db20xx::DECIMAL_ID, field_name,
+        schema_add_inline_field(schema, db20xx::DECIMAL_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_YEAR:
-        schema_add_inline_field(schema, db20xx::YEAR_ID, field_name,
+        schema_add_inline_field(schema, db20xx::YEAR_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_DATE:
-        schema_add_inline_field(schema, db20xx::DATE_ID, field_name,
+        schema_add_inline_field(schema, db20xx::DATE_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_TIME:
-        schema_add_inline_field(schema, db20xx::TIME_ID, field_name,
+        schema_add_inline_field(schema, db20xx::TIME_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_DATETIME:
-        schema_add_inline_field(schema, db20xx::DATETIME_ID, field_name,
+        schema_add_inline_field(schema, db20xx::DATETIME_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_TIMESTAMP:
-        schema_add_inline_field(schema, db20xx::TIMESTAMP_ID, field_name,
+        schema_add_inline_field(schema, db20xx::TIMESTAMP_ID, sl_fieldp,
                                 data_bytes, offset_in_db20xx_rec,
                                 offset_in_mysql_rec);
         break;
       case MYSQL_TYPE_BLOB:
         // Field_blob's format: [length_bytes | ptr]
-        schema_add_non_inline_field(schema, db20xx::BLOB_ID, field_name,
+        schema_add_non_inline_field(schema, db20xx::BLOB_ID, sl_fieldp,
                                     sl_fieldp->pack_length() - sizeof(void *),
                                     offset_in_db20xx_rec, offset_in_mysql_rec,
                                     data_bytes);
@@ -157,6 +181,224 @@ void generate_db20xx_schema(TABLE *form, db20xx::Schema &schema) {
   }
 }
 
+/**
+@brief
+  convert a constant to the storage format of field, fail if the value does
+  not convert exactly (e.g. out of range or truncated), then comparing the
+  stored values would differ from comparing the values.
+  save_in_field_no_warnings() may round a fraction and still report
+  TYPE_OK, so a decimal is read back and compared with the constant.
+*/
+static bool store_constant(Item *value, Field *field, std::string &bytes) {
+  if (!value->const_item() || value->has_subquery() || value->is_expensive())
+    return false;
+  // a comparison with NULL is never true
+  if (value->is_null()) return false;
+
+  TABLE *table = field->table;
+  Field *tmp_field = field->clone(table->in_use->mem_root);
+  if (tmp_field == nullptr) return false;
+  bytes.assign(field->pack_length(), '\0');
+  tmp_field->move_field(reinterpret_cast<uchar *>(&bytes[0]), nullptr, 0);
+
+  my_bitmap_map *old_map = dbug_tmp_use_all_columns(table, table->write_set);
+  type_conversion_status status =
+      value->save_in_field_no_warnings(tmp_field, true);
+  dbug_tmp_restore_column_map(table->write_set, old_map);
+  if (status != TYPE_OK) return false;
+
+  if (field->real_type() == MYSQL_TYPE_NEWDECIMAL) {
+    my_decimal stored_buf, value_buf;
+    const my_decimal *stored = tmp_field->val_decimal(&stored_buf);
+    const my_decimal *original = value->val_decimal(&value_buf);
+    if (stored == nullptr || original == nullptr ||
+        my_decimal_cmp(stored, original) != 0)
+      return false;
+  }
+  return true;
+}
+
+/**
+@brief
+  how field is compared in the payload, false if it is not supported, then
+  the condition is left to the server.
+  Only EQ/NE is supported on CHAR, the pad characters make its bytes
+  unordered under the collation. Equal CHAR values have equal bytes only
+  under binary collations which ignore trailing spaces.
+*/
+static bool get_compare_type(Field *field, Item *value,
+                             db20xx::Predicate::CompareOp op,
+                             db20xx::Predicate::ValueType &value_type) {
+  Item_result result_type = value->result_type();
+  switch (field->real_type()) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+      value_type = field->is_unsigned() ? db20xx::Predicate::UNSIGNED_INT
+                                        : db20xx::Predicate::SIGNED_INT;
+      // a decimal, real or string constant may carry a fraction, which is
+      // rounded when stored to an integer field
+      return result_type == INT_RESULT;
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_NEWDATE:
+      value_type = db20xx::Predicate::UNSIGNED_INT;
+      return result_type == INT_RESULT || result_type == STRING_RESULT;
+    case MYSQL_TYPE_DATETIME2:
+    case MYSQL_TYPE_TIMESTAMP2:
+    case MYSQL_TYPE_TIME2:
+      value_type = db20xx::Predicate::BYTES;
+      return result_type == INT_RESULT || result_type == STRING_RESULT;
+    case MYSQL_TYPE_NEWDECIMAL:
+      value_type = db20xx::Predicate::BYTES;
+      return result_type == INT_RESULT || result_type == DECIMAL_RESULT;
+    case MYSQL_TYPE_STRING: {
+      const CHARSET_INFO *cs = field->charset();
+      value_type = db20xx::Predicate::BYTES;
+      return (op == db20xx::Predicate::EQ || op == db20xx::Predicate::NE) &&
+             result_type == STRING_RESULT && value->collation.collation == cs &&
+             (cs->state & MY_CS_BINSORT) && cs->pad_attribute == PAD_SPACE &&
+             cs != &my_charset_bin;
+    }
+    default:
+      return false;
+  }
+}
+
+static bool compile_comparison(const Item *cond, TABLE *table,
+                               const db20xx::Schema &schema,
+                               db20xx::Predicate &predicate) {
+  if (cond->type() != Item::FUNC_ITEM) return false;
+  const Item_func *func = down_cast<const Item_func *>(cond);
+  db20xx::Predicate::Term term;
+  switch (func->functype()) {
+    case Item_func::EQ_FUNC:
+      term.op_ = db20xx::Predicate::EQ;
+      break;
+    case Item_func::NE_FUNC:
+      term.op_ = db20xx::Predicate::NE;
+      break;
+    case Item_func::LT_FUNC:
+      term.op_ = db20xx::Predicate::LT;
+      break;
+    case Item_func::LE_FUNC:
+      term.op_ = db20xx::Predicate::LE;
+      break;
+    case Item_func::GT_FUNC:
+      term.op_ = db20xx::Predicate::GT;
+      break;
+    case Item_func::GE_FUNC:
+      term.op_ = db20xx::Predicate::GE;
+      break;
+    case Item_func::ISNULL_FUNC:
+      term.op_ = db20xx::Predicate::IS_NULL;
+      break;
+    case Item_func::ISNOTNULL_FUNC:
+      term.op_ = db20xx::Predicate::IS_NOT_NULL;
+      break;
+    default:
+      return false;
+  }
+
+  Item **args = func->arguments();
+  Item *field_arg = args[0];
+  Item *value = func->argument_count() == 2 ? args[1] : nullptr;
+  if (value != nullptr && field_arg->real_item()->type() != Item::FIELD_ITEM) {
+    // constant op field
+    std::swap(field_arg, value);
+    switch (term.op_) {
+      case db20xx::Predicate::LT:
+        term.op_ = db20xx::Predicate::GT;
+        break;
+      case db20xx::Predicate::LE:
+        term.op_ = db20xx::Predicate::GE;
+        break;
+      case db20xx::Predicate::GT:
+        term.op_ = db20xx::Predicate::LT;
+        break;
+      case db20xx::Predicate::GE:
+        term.op_ = db20xx::Predicate::LE;
+        break;
+      default:
+        break;
+    }
+  }
+  if (field_arg->real_item()->type() != Item::FIELD_ITEM) return false;
+  Field *field = down_cast<Item_field *>(field_arg->real_item())->field;
+  if (field->table != table) return false;
+
+  const db20xx::Field &se_field = schema.get_field(field->field_index());
+  if (!se_field.store_inline()) return false;
+  // IS [NOT] NULL only checks the null bit
+  if (value != nullptr &&
+      (!get_compare_type(field, value, term.op_, term.value_type_) ||
+       !store_constant(value, field, term.bytes_)))
+    return false;
+
+  term.offset_ = se_field.get_offset_in_record();
+  term.length_ = se_field.get_data_bytes();
+  if (field->is_nullable()) {
+    term.null_offset_ = field->null_offset();
+    term.null_mask_ = field->null_bit;
+  }
+  predicate.add_term(term);
+  return true;
+}
+
+bool compile_pushed_condition(const Item *cond, TABLE *table,
+                              const db20xx::Schema &schema,
+                              db20xx::Predicate &predicate) {
+  if (cond->type() == Item::COND_ITEM &&
+      down_cast<const Item_cond *>(cond)->functype() ==
+          Item_func::COND_AND_FUNC) {
+    bool all_compiled = true;
+    List_iterator<Item> iter(
+        *const_cast<Item_cond *>(down_cast<const Item_cond *>(cond))
+             ->argument_list());
+    for (Item *item = iter++; item != nullptr; item = iter++) {
+      if (!compile_comparison(item, table, schema, predicate))
+        all_compiled = false;
+    }
+    return all_compiled;
+  }
+  return compile_comparison(cond, table, schema, predicate);
+}
+
+/**
+@brief
+  sort keys of collated strings in index keys, made like
+  Field_varstring::make_sort_key(): weights of a PAD SPACE collation are
+  padded to the max length, so trailing spaces do not count.
+*/
+static uint32_t collation_sort_key_length(uint32_t collation_id,
+                                          uint32_t length, bool &padded) {
+  const CHARSET_INFO *cs = get_charset(collation_id, MYF(0));
+  padded = cs->pad_attribute != NO_PAD;
+  return cs->coll->strnxfrmlen(cs, length);
+}
+
+static uint32_t collation_make_sort_key(uint32_t collation_id,
+                                        const char *data, uint32_t data_len,
+                                        uint32_t length, char *sort_key) {
+  const CHARSET_INFO *cs = get_charset(collation_id, MYF(0));
+  // a key part of length bytes holds the first characters of a string,
+  // see Field_varstring::get_key_image()
+  uint32_t char_num = length / cs->mbmaxlen;
+  data_len = std::min<size_t>(
+      data_len, my_charpos(cs, data, data + data_len, char_num));
+  uint flags = cs->pad_attribute == NO_PAD ? 0 : MY_STRXFRM_PAD_TO_MAXLEN;
+  return cs->coll->strnxfrm(cs, reinterpret_cast<uchar *>(sort_key),
+                            cs->coll->strnxfrmlen(cs, length), char_num,
+                            reinterpret_cast<const uchar *>(data), data_len,
+                            flags);
+}
+
+void set_collation_hooks() {
+  db20xx::KeyEncodePlan::set_collation_hooks(collation_sort_key_length,
+                                             collation_make_sort_key);
+}
+
 extern handlerton *db20xx_hton;
 db20xx::threadinfo_type *get_threadinfo() {
   // ha_data is thread local data for storage engine
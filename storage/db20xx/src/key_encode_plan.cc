@@ -0,0 +1,284 @@
+#include "key_encode_plan.h"
+#include <algorithm>
+#include <cstring>
+#include "schema.h"
+#include "varlen_arena.h"
+
+namespace db20xx {
+
+// a var-length value in mysql key format is led by 2 length bytes
+static const uint32_t KEY_TUPLE_LENGTH_BYTES = 2;
+
+KeyEncodePlan::SortKeyLengthFunc KeyEncodePlan::sort_key_length_ = nullptr;
+KeyEncodePlan::SortKeyFunc KeyEncodePlan::make_sort_key_ = nullptr;
+
+void KeyEncodePlan::set_collation_hooks(SortKeyLengthFunc sort_key_length,
+                                        SortKeyFunc make_sort_key) {
+  sort_key_length_ = sort_key_length;
+  make_sort_key_ = make_sort_key;
+}
+
+void KeyEncodePlan::build(const Schema &schema,
+                          const std::vector<int> &key_parts,
+                          const std::vector<uint32_t> &lengths) {
+  part_ops_.clear();
+  ops_.clear();
+  max_length_ = 0;
+  for (size_t i = 0; i < key_parts.size(); i++) {
+    const Field &field = schema.get_field(key_parts[i]);
+    Op op;
+    memset(&op, 0, sizeof(op));
+    op.store_inline_ = field.store_inline();
+    op.mysql_pointer_ = field.get_field_type() == BLOB_ID;
+    op.null_mask_ = field.get_null_mask();
+    op.null_offset_ = field.get_null_offset();
+    op.offset_in_record_ = field.get_offset_in_record();
+    op.offset_in_mysql_record_ = field.get_offset_in_mysql_record();
+    op.length_bytes_ = field.get_mysql_length_bytes();
+    op.collation_id_ = field.get_collation_id();
+
+    uint32_t length = i < lengths.size() ? lengths[i] : 0;
+    if (field.store_inline()) {
+      op.length_ = length == 0 ? field.get_data_bytes()
+                               : std::min(length, field.get_data_bytes());
+    } else {
+      op.length_ = length == 0 ? DB20XX_MAX_KEY_LENGTH : length;
+    }
+
+    switch (field.get_field_type()) {
+      case TINYINT_ID:
+      case SMALLINT_ID:
+      case MEDIUMINT_ID:
+      case INT_ID:
+      case BIGINT_ID:
+        op.kind_ = INT;
+        op.is_signed_ = !field.is_unsigned();
+        break;
+      case DATE_ID:
+        // 3 bytes little-endian day number
+        op.kind_ = INT;
+        op.is_signed_ = false;
+        break;
+      case FLOAT_ID:
+        op.kind_ = FLOAT;
+        break;
+      case DOUBLE_ID:
+        op.kind_ = DOUBLE;
+        break;
+      case CHAR_ID:
+        // binary CHAR is padded by 0x00
+        op.kind_ = op.collation_id_ == 0 ? COPY : STRING;
+        break;
+      case VARCHAR_ID:
+      case MEDIUMTEXT_ID:
+      case BLOB_ID:
+        op.kind_ = STRING;
+        break;
+      default:
+        op.kind_ = COPY;
+        break;
+    }
+
+    max_length_ += op.null_mask_ != 0 ? 1 : 0;
+    if (op.kind_ != STRING) {
+      max_length_ += op.length_;
+    } else if (op.collation_id_ != 0 && sort_key_length_ != nullptr) {
+      op.sort_key_length_ =
+          sort_key_length_(op.collation_id_, op.length_, op.padded_sort_key_);
+      max_length_ += op.padded_sort_key_ ? op.sort_key_length_
+                                         : 2 * op.sort_key_length_ + 2;
+    } else {
+      op.sort_key_length_ = op.length_;
+      max_length_ += 2 * op.length_ + 2;
+    }
+    part_ops_.push_back(op);
+
+    if (op.kind_ == COPY && op.null_mask_ == 0 && !ops_.empty()) {
+      Op &last = ops_.back();
+      if (last.kind_ == COPY && last.null_mask_ == 0 &&
+          last.offset_in_record_ + last.length_ == op.offset_in_record_ &&
+          last.offset_in_mysql_record_ + last.length_ ==
+              op.offset_in_mysql_record_) {
+        last.length_ += op.length_;
+        continue;
+      }
+    }
+    ops_.push_back(op);
+  }
+}
+
+uint32_t KeyEncodePlan::get_fixed_part_length(uint32_t part) const {
+  const Op &op = part_ops_[part];
+  // NULL takes only the null marker
+  if (op.null_mask_ != 0) return 0;
+  if (op.kind_ != STRING) return op.length_;
+  return op.padded_sort_key_ ? op.sort_key_length_ : 0;
+}
+
+uint32_t KeyEncodePlan::encode(const char *payload, char *key) const {
+  return encode_record<false>(payload, key);
+}
+
+uint32_t KeyEncodePlan::encode_mysql_record(const char *mysql_record,
+                                            char *key) const {
+  return encode_record<true>(mysql_record, key);
+}
+
+template <bool FROM_MYSQL>
+uint32_t KeyEncodePlan::encode_record(const char *record, char *key) const {
+  char *cursor = key;
+  for (const Op &op : ops_) {
+    if (op.null_mask_ != 0) {
+      if ((record[op.null_offset_] & op.null_mask_) != 0) {
+        *cursor++ = 0x00;
+        continue;
+      }
+      *cursor++ = 0x01;
+    }
+
+    const char *field = record + (FROM_MYSQL ? op.offset_in_mysql_record_
+                                             : op.offset_in_record_);
+    if (op.store_inline_) {
+      cursor += encode_value(op, field, op.length_, cursor);
+      continue;
+    }
+
+    uint32_t data_len = 0;
+    memcpy(&data_len, field, op.length_bytes_);
+    const char *slot = field + op.length_bytes_;
+    const char *data = nullptr;
+    if (!FROM_MYSQL)
+      data = VarlenArena::get_data(slot, data_len);
+    else if (op.mysql_pointer_)
+      data = *reinterpret_cast<const char *const *>(slot);
+    else
+      data = slot;
+    cursor += encode_value(op, data, data_len, cursor);
+  }
+  return cursor - key;
+}
+
+uint32_t KeyEncodePlan::encode_key_tuple(const char *tuple, uint32_t part_num,
+                                         char *key) const {
+  char *cursor = key;
+  part_num = std::min<uint32_t>(part_num, part_ops_.size());
+  for (uint32_t i = 0; i < part_num; i++) {
+    const Op &op = part_ops_[i];
+    uint32_t value_bytes =
+        op.store_inline_ ? op.length_ : KEY_TUPLE_LENGTH_BYTES + op.length_;
+    if (op.null_mask_ != 0) {
+      bool is_null = *tuple != 0;
+      tuple++;
+      *cursor++ = is_null ? 0x00 : 0x01;
+      if (is_null) {
+        tuple += value_bytes;
+        continue;
+      }
+    }
+
+    if (op.store_inline_) {
+      cursor += encode_value(op, tuple, op.length_, cursor);
+    } else {
+      uint16_t data_len = 0;
+      memcpy(&data_len, tuple, KEY_TUPLE_LENGTH_BYTES);
+      cursor += encode_value(op, tuple + KEY_TUPLE_LENGTH_BYTES,
+                             std::min<uint32_t>(data_len, op.length_), cursor);
+    }
+    tuple += value_bytes;
+  }
+  return cursor - key;
+}
+
+/**
+ *@brief
+ *  encode a not null value, integers and floats of mysql are stored
+ *  little-endian
+ */
+uint32_t KeyEncodePlan::encode_value(const Op &op, const char *data,
+                                     uint32_t data_len, char *key) {
+  switch (op.kind_) {
+    case COPY:
+      memcpy(key, data, op.length_);
+      return op.length_;
+    case INT: {
+      uint32_t bits = op.length_ * 8;
+      uint64_t value = 0;
+      memcpy(&value, data, op.length_);
+      if (op.is_signed_) value ^= uint64_t(1) << (bits - 1);
+      value = __builtin_bswap64(value << (64 - bits));
+      memcpy(key, &value, op.length_);
+      return op.length_;
+    }
+    case FLOAT: {
+      float number = 0;
+      uint32_t value = 0;
+      memcpy(&number, data, sizeof(number));
+      // -0.0 equals 0.0
+      if (number != 0) memcpy(&value, &number, sizeof(value));
+      value = (value & 0x80000000u) != 0 ? ~value : value | 0x80000000u;
+      value = __builtin_bswap32(value);
+      memcpy(key, &value, sizeof(value));
+      return sizeof(value);
+    }
+    case DOUBLE: {
+      double number = 0;
+      uint64_t value = 0;
+      memcpy(&number, data, sizeof(number));
+      if (number != 0) memcpy(&value, &number, sizeof(value));
+      const uint64_t sign = uint64_t(1) << 63;
+      value = (value & sign) != 0 ? ~value : value | sign;
+      value = __builtin_bswap64(value);
+      memcpy(key, &value, sizeof(value));
+      return sizeof(value);
+    }
+    case STRING:
+      break;
+  }
+
+  return encode_string(op, data, data_len, key);
+}
+
+uint32_t KeyEncodePlan::encode_string(const Op &op, const char *data,
+                                      uint32_t data_len, char *key) {
+  if (op.collation_id_ != 0 && make_sort_key_ != nullptr) {
+    if (op.padded_sort_key_) {
+      uint32_t length =
+          make_sort_key_(op.collation_id_, data, data_len, op.length_, key);
+      memset(key + length, 0, op.sort_key_length_ - length);
+      return op.sort_key_length_;
+    }
+    char sort_key[DB20XX_MAX_ENCODED_KEY_LENGTH];
+    data_len =
+        make_sort_key_(op.collation_id_, data, data_len, op.length_, sort_key);
+    return escape_string(sort_key, data_len, key);
+  }
+  return escape_string(data, std::min(data_len, op.length_), key);
+}
+
+/**
+ *@brief
+ *  store a variable length string which stays ordered when followed by
+ *  more key parts
+ */
+uint32_t KeyEncodePlan::escape_string(const char *data, uint32_t data_len,
+                                      char *key) {
+  // copy the runs between 0x00 bytes, memchr scans a word at a time
+  char *cursor = key;
+  const char *end = data + data_len;
+  while (data < end) {
+    const char *zero =
+        static_cast<const char *>(memchr(data, 0, end - data));
+    const char *run_end = zero != nullptr ? zero : end;
+    memcpy(cursor, data, run_end - data);
+    cursor += run_end - data;
+    if (zero == nullptr) break;
+    *cursor++ = 0x00;
+    *cursor++ = static_cast<char>(0xff);
+    data = zero + 1;
+  }
+  *cursor++ = 0x00;
+  *cursor++ = 0x01;
+  return cursor - key;
+}
+
+}  // namespace db20xx
@@ -0,0 +1,472 @@
+#include "log_manager.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include "checkpoint.h"
+#include "database.h"
+#include "engine.h"
+#include "message_logger.h"
+#include "record.h"
+#include "table.h"
+#include "thread_context.h"
+#include "transaction.h"
+#include "version_chain.h"
+
+namespace db20xx {
+
+bool LogManager::enabled_ = false;
+int LogManager::log_fd_ = -1;
+std::atomic<uint32_t> LogManager::flush_log_at_commit_ = 1;
+std::atomic<uint32_t> LogManager::next_table_id_ = 1;
+std::mutex LogManager::tables_lock_;
+std::unordered_map<uint32_t, LoggedTable> LogManager::tables_;
+std::mutex LogManager::log_lock_;
+std::string LogManager::log_buffer_;
+uint64_t LogManager::buffered_lsn_ = 0;
+uint64_t LogManager::written_lsn_ = 0;
+uint64_t LogManager::synced_lsn_ = 0;
+uint32_t LogManager::write_waiters_ = 0;
+uint32_t LogManager::sync_waiters_ = 0;
+std::condition_variable LogManager::flusher_cv_;
+std::condition_variable LogManager::waiter_cv_;
+std::thread LogManager::flusher_thread_;
+bool LogManager::flusher_running_ = false;
+
+void write_fully(int fd, const char *data, uint64_t len) {
+  while (len > 0) {
+    ssize_t written = ::write(fd, data, len);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      LOG_ERROR("write fd:%d failed, errno:%d", fd, errno);
+      exit(1);
+    }
+    data += written;
+    len -= written;
+  }
+}
+
+//======================log writing==================================
+void LogManager::start(const std::string &log_dir) {
+  std::string log_path = log_dir + "/" + LOG_FILE_NAME;
+  log_fd_ = ::open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0640);
+  if (log_fd_ < 0) {
+    LOG_ERROR("open redo log %s failed, errno:%d, logging is disabled",
+              log_path.c_str(), errno);
+    return;
+  }
+
+  uint64_t log_size = ::lseek(log_fd_, 0, SEEK_END);
+  std::lock_guard<std::mutex> guard(log_lock_);
+  buffered_lsn_ = written_lsn_ = synced_lsn_ = log_size;
+  flusher_running_ = true;
+  flusher_thread_ = std::thread(flush_loop);
+  enabled_ = true;
+}
+
+void LogManager::stop() {
+  if (!enabled_) return;
+  {
+    std::lock_guard<std::mutex> guard(log_lock_);
+    flusher_running_ = false;
+  }
+  flusher_cv_.notify_all();
+  flusher_thread_.join();
+  enabled_ = false;
+  ::close(log_fd_);
+  log_fd_ = -1;
+}
+
+void LogManager::log_create_table(const std::string &db_name, Table *table) {
+  table->set_table_id(next_table_id_.fetch_add(1));
+  if (!enabled_) return;
+  {
+    std::lock_guard<std::mutex> guard(tables_lock_);
+    tables_[table->get_table_id()] = LoggedTable{db_name, table};
+  }
+
+  std::string body;
+  serialize_table_definition(db_name, table, body);
+  uint64_t lsn = append(LOG_RECORD_CREATE_TABLE, body);
+  wait_for_flush(lsn, true);
+}
+
+/**
+ *@brief
+ *  body of a commit record:
+ *    [txn id | entry num | entry ...]
+ *  entry:
+ *    [table id | block id | idx in block | entry type | payload(upsert only)]
+ */
+void LogManager::log_commit(TransactionContext *txn_ctx) {
+  std::string &buf = txn_ctx->log_buffer_;
+  buf.clear();
+  LogWriter writer(buf);
+  writer.put_u64(txn_ctx->transaction_id_);
+  size_t entry_num_offset = buf.size();
+  writer.put_u32(0);
+
+  uint32_t entry_num = 0;
+  for (auto &modified : txn_ctx->txn_modify_set_) {
+    Record *record = modified.first;
+    Table *table = modified.second;
+    Record *latest_version = record->get_newer_version();
+    if (latest_version == nullptr) {
+      // owned by read_own but not modified
+      if (record->get_begin_timestamp() != MAX_TIMESTAMP) continue;
+      // inserted and then deleted by ourselves, nothing to recover
+      if (record->get_end_timestamp() == MIN_TIMESTAMP) continue;
+      latest_version = record;
+    }
+
+    VersionChainHead *vchain_head = record->get_vchain_head();
+    VersionChainHeadBlock *block = VersionChainHeadBlock::get_block(vchain_head);
+    writer.put_u32(table->get_table_id());
+    writer.put_u32(block->get_block_id());
+    writer.put_u32(VersionChainHeadBlock::get_idx_in_block(vchain_head));
+    if (latest_version->get_end_timestamp() == MIN_TIMESTAMP) {
+      writer.put_u8(LOG_ENTRY_DELETE);
+    } else {
+      writer.put_u8(LOG_ENTRY_UPSERT);
+      latest_version->serialize_payload(table->get_schema(), buf);
+    }
+    entry_num++;
+  }
+
+  // read-only transaction
+  if (entry_num == 0) return;
+  memcpy(&buf[entry_num_offset], &entry_num, sizeof(entry_num));
+
+  uint64_t lsn = append(LOG_RECORD_COMMIT, buf);
+  uint32_t flush_log_at_commit = flush_log_at_commit_.load();
+  if (flush_log_at_commit == 1)
+    wait_for_flush(lsn, true);
+  else if (flush_log_at_commit == 2)
+    wait_for_flush(lsn, false);
+}
+
+void LogManager::serialize_table_definition(const std::string &db_name,
+                                            Table *table, std::string &buf) {
+  LogWriter writer(buf);
+  writer.put_u32(table->get_table_id());
+  writer.put_string(db_name);
+  writer.put_string(table->get_table_name());
+  writer.put_u32(table->get_records_per_block());
+  writer.put_u8(table->get_storage_layout());
+
+  const Schema &schema = table->get_schema();
+  writer.put_u32(schema.get_null_byte_length());
+  writer.put_u32(schema.field_num());
+  for (uint32_t i = 0; i < schema.field_num(); i++) {
+    const Field &field = schema.get_field(i);
+    writer.put_u32(field.get_field_type());
+    writer.put_string(field.get_field_name());
+    writer.put_u32(field.get_data_bytes());
+    writer.put_u32(field.get_offset_in_record());
+    writer.put_u8(field.store_inline());
+    writer.put_u32(field.get_mysql_pack_length());
+    writer.put_u32(field.get_offset_in_mysql_record());
+    writer.put_u32(field.get_mysql_length_bytes());
+    writer.put_u8(field.is_unsigned());
+    writer.put_u32(field.get_null_offset());
+    writer.put_u8(field.get_null_mask());
+    writer.put_u32(field.get_collation_id());
+  }
+
+  writer.put_u32(table->get_index_num());
+  for (uint32_t i = 0; i < table->get_index_num(); i++) {
+    const KeyInfo &keyinfo = table->get_key_info(i);
+    writer.put_u32(keyinfo.key_len);
+    writer.put_u8(keyinfo.unique);
+    writer.put_u8(keyinfo.nullable_unique);
+    writer.put_u32(keyinfo.key_parts.size());
+    for (size_t j = 0; j < keyinfo.key_parts.size(); j++) {
+      writer.put_u32(keyinfo.key_parts[j]);
+      writer.put_u32(keyinfo.key_part_lengths[j]);
+    }
+  }
+}
+
+void LogManager::discard_log_before(uint64_t lsn) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+  if (!enabled_ || lsn == 0) return;
+  if (::fallocate(log_fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0,
+                  lsn) != 0) {
+    LOG_WARN("discard redo log before %lu failed, errno:%d", lsn, errno);
+  }
+#endif
+}
+
+uint32_t LogManager::compute_checksum(const char *data, uint64_t len,
+                                      uint32_t hash) {
+  for (uint64_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ *@return lsn of the end of the appended record
+ */
+uint64_t LogManager::append(LogRecordType type, const std::string &body) {
+  LogRecordHeader header;
+  header.type_ = type;
+  header.length_ = body.size();
+  header.checksum_ = compute_checksum(body.data(), body.size());
+
+  std::lock_guard<std::mutex> guard(log_lock_);
+  log_buffer_.append((const char *)&header, sizeof(header));
+  log_buffer_.append(body);
+  buffered_lsn_ += sizeof(header) + body.size();
+  return buffered_lsn_;
+}
+
+void LogManager::wait_for_flush(uint64_t lsn, bool sync) {
+  std::unique_lock<std::mutex> lock(log_lock_);
+  uint32_t &waiters = sync ? sync_waiters_ : write_waiters_;
+  uint64_t &flushed_lsn = sync ? synced_lsn_ : written_lsn_;
+  if (flushed_lsn >= lsn) return;
+
+  waiters++;
+  flusher_cv_.notify_one();
+  waiter_cv_.wait(lock,
+                  [&] { return flushed_lsn >= lsn || !flusher_running_; });
+  waiters--;
+}
+
+/**
+ *@brief
+ *  Commits that arrive while the flusher is writing or syncing accumulate
+ *  in log_buffer_, and are flushed together in the next round.
+ */
+void LogManager::flush_loop() {
+  std::string flush_buffer;
+  auto last_sync_time = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(log_lock_);
+  while (true) {
+    flusher_cv_.wait_for(
+        lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [] {
+          return !flusher_running_ ||
+                 (write_waiters_ + sync_waiters_ > 0 &&
+                  buffered_lsn_ > written_lsn_) ||
+                 (sync_waiters_ > 0 && written_lsn_ > synced_lsn_);
+        });
+    bool stopping = !flusher_running_;
+
+    flush_buffer.clear();
+    flush_buffer.swap(log_buffer_);
+    uint64_t flush_lsn = buffered_lsn_;
+    auto now = std::chrono::steady_clock::now();
+    bool need_sync =
+        stopping || sync_waiters_ > 0 ||
+        now - last_sync_time >= std::chrono::milliseconds(FLUSH_INTERVAL_MS);
+    need_sync = need_sync && flush_lsn > synced_lsn_;
+    lock.unlock();
+
+    write_fully(log_fd_, flush_buffer.data(), flush_buffer.size());
+    if (need_sync && ::fdatasync(log_fd_) != 0) {
+      LOG_ERROR("sync redo log failed, errno:%d", errno);
+      exit(1);
+    }
+
+    lock.lock();
+    written_lsn_ = flush_lsn;
+    if (need_sync) {
+      synced_lsn_ = flush_lsn;
+      last_sync_time = now;
+    }
+    waiter_cv_.notify_all();
+    if (stopping) break;
+  }
+}
+
+//======================recovery=====================================
+void LogManager::recover(const std::string &log_dir) {
+  ThreadContext thd_ctx(0);
+  uint64_t checkpoint_lsn = 0;
+  Checkpointer::load(log_dir, checkpoint_lsn, &thd_ctx);
+
+  std::string log_path = log_dir + "/" + LOG_FILE_NAME;
+  int fd = ::open(log_path.c_str(), O_RDONLY);
+  if (fd < 0) return;  // a fresh instance
+
+  // the log before checkpoint_lsn may have been discarded, only read the
+  // tail written after the checkpoint
+  struct stat log_stat;
+  ::fstat(fd, &log_stat);
+  uint64_t log_size = log_stat.st_size;
+  uint64_t tail_size =
+      log_size > checkpoint_lsn ? log_size - checkpoint_lsn : 0;
+  std::string log_data(tail_size, '\0');
+  uint64_t read_bytes = 0;
+  while (read_bytes < tail_size) {
+    ssize_t ret = ::pread(fd, &log_data[read_bytes], tail_size - read_bytes,
+                          checkpoint_lsn + read_bytes);
+    if (ret <= 0) break;
+    read_bytes += ret;
+  }
+  ::close(fd);
+  tail_size = read_bytes;
+
+  uint64_t offset = 0;
+  uint64_t record_num = 0;
+  while (offset + sizeof(LogRecordHeader) <= tail_size) {
+    LogRecordHeader header;
+    memcpy(&header, &log_data[offset], sizeof(header));
+    const char *body = &log_data[offset + sizeof(header)];
+    if (offset + sizeof(header) + header.length_ > tail_size ||
+        compute_checksum(body, header.length_) != header.checksum_)
+      break;
+
+    LogReader reader(body, header.length_);
+    bool ok = false;
+    if (header.type_ == LOG_RECORD_CREATE_TABLE)
+      ok = replay_create_table(reader, &thd_ctx);
+    else if (header.type_ == LOG_RECORD_COMMIT)
+      ok = replay_commit(reader, &thd_ctx);
+    if (!ok) {
+      LOG_ERROR("invalid redo log record at offset:%lu",
+                checkpoint_lsn + offset);
+      break;
+    }
+
+    offset += sizeof(header) + header.length_;
+    record_num++;
+  }
+
+  if (offset < tail_size) {
+    // a torn write at the tail, later records must follow a valid one
+    LOG_WARN("truncate redo log from %lu to %lu", log_size,
+             checkpoint_lsn + offset);
+    if (::truncate(log_path.c_str(), checkpoint_lsn + offset) != 0) {
+      LOG_ERROR("truncate redo log failed, errno:%d", errno);
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(tables_lock_);
+  LOG_INFO("redo log recovered from lsn:%lu, tables:%lu, records:%lu",
+           checkpoint_lsn, tables_.size(), record_num);
+}
+
+Table *LogManager::get_logged_table(uint32_t table_id) {
+  std::lock_guard<std::mutex> guard(tables_lock_);
+  auto iter = tables_.find(table_id);
+  return iter == tables_.end() ? nullptr : iter->second.table_;
+}
+
+bool LogManager::replay_create_table(LogReader &reader,
+                                     ThreadContext *thd_ctx) {
+  uint32_t table_id = 0;
+  std::string db_name;
+  std::string table_name;
+  uint32_t records_per_block = 0;
+  uint8_t storage_layout = STORAGE_LAYOUT_ROW;
+  uint32_t null_byte_length = 0;
+  uint32_t field_num = 0;
+  if (!reader.get_u32(table_id) || !reader.get_string(db_name) ||
+      !reader.get_string(table_name) || !reader.get_u32(records_per_block) ||
+      !reader.get_u8(storage_layout) || !reader.get_u32(null_byte_length) ||
+      !reader.get_u32(field_num))
+    return false;
+  // created after the checkpoint started, but already in the checkpoint
+  if (get_logged_table(table_id) != nullptr) return true;
+
+  Schema schema;
+  schema.set_null_byte_length(null_byte_length);
+  for (uint32_t i = 0; i < field_num; i++) {
+    uint32_t type_id = 0, data_bytes = 0, off_in_record = 0;
+    uint32_t mysql_pack_length = 0, off_in_mysql_record = 0;
+    uint32_t mysql_length_bytes = 0, null_offset = 0, collation_id = 0;
+    uint8_t store_inline = 0, is_unsigned = 0, null_mask = 0;
+    std::string field_name;
+    if (!reader.get_u32(type_id) || !reader.get_string(field_name) ||
+        !reader.get_u32(data_bytes) || !reader.get_u32(off_in_record) ||
+        !reader.get_u8(store_inline) || !reader.get_u32(mysql_pack_length) ||
+        !reader.get_u32(off_in_mysql_record) ||
+        !reader.get_u32(mysql_length_bytes) || !reader.get_u8(is_unsigned) ||
+        !reader.get_u32(null_offset) || !reader.get_u8(null_mask) ||
+        !reader.get_u32(collation_id))
+      return false;
+
+    Field field((TYPE_ID)type_id, field_name, data_bytes, off_in_record,
+                store_inline, mysql_pack_length, off_in_mysql_record);
+    field.set_mysql_length_bytes(mysql_length_bytes);
+    field.set_unsigned(is_unsigned != 0);
+    field.set_null_bit(null_offset, null_mask);
+    field.set_collation_id(collation_id);
+    schema.add_field(field);
+  }
+
+  uint32_t index_num = 0;
+  if (!reader.get_u32(index_num)) return false;
+  std::vector<KeyInfo> keyinfos(index_num);
+  for (auto &keyinfo : keyinfos) {
+    uint32_t key_part_num = 0;
+    uint8_t unique = 0;
+    uint8_t nullable_unique = 0;
+    keyinfo.schema = schema;
+    if (!reader.get_u32(keyinfo.key_len) || !reader.get_u8(unique) ||
+        !reader.get_u8(nullable_unique) || !reader.get_u32(key_part_num))
+      return false;
+    keyinfo.unique = unique != 0;
+    keyinfo.nullable_unique = nullable_unique != 0;
+    for (uint32_t i = 0; i < key_part_num; i++) {
+      uint32_t key_part = 0, key_part_length = 0;
+      if (!reader.get_u32(key_part) || !reader.get_u32(key_part_length))
+        return false;
+      keyinfo.key_parts.push_back(key_part);
+      keyinfo.key_part_lengths.push_back(key_part_length);
+    }
+  }
+
+  Database *db = Engine::get_database(db_name);
+  if (db == nullptr) db = Engine::create_new_database(db_name);
+  Table *table = db->create_table(table_name, schema, records_per_block,
+                                  (StorageLayout)storage_layout);
+  if (table == nullptr) return false;
+  for (auto &keyinfo : keyinfos)
+    table->build_index(keyinfo, *thd_ctx->get_threadinfo());
+
+  table->set_table_id(table_id);
+  {
+    std::lock_guard<std::mutex> guard(tables_lock_);
+    tables_[table_id] = LoggedTable{db_name, table};
+  }
+  if (next_table_id_.load() <= table_id) next_table_id_.store(table_id + 1);
+  return true;
+}
+
+bool LogManager::replay_commit(LogReader &reader, ThreadContext *thd_ctx) {
+  uint64_t txn_id = 0;
+  uint32_t entry_num = 0;
+  if (!reader.get_u64(txn_id) || !reader.get_u32(entry_num)) return false;
+
+  for (uint32_t i = 0; i < entry_num; i++) {
+    uint32_t table_id = 0, block_id = 0, idx_in_block = 0;
+    uint8_t entry_type = 0;
+    if (!reader.get_u32(table_id) || !reader.get_u32(block_id) ||
+        !reader.get_u32(idx_in_block) || !reader.get_u8(entry_type))
+      return false;
+    if (idx_in_block >= VersionChainHeadBlock::ENTRY_CAPACITY) return false;
+
+    Table *table = get_logged_table(table_id);
+    if (table == nullptr) return false;
+
+    if (entry_type == LOG_ENTRY_UPSERT) {
+      // the record checksum has been verified, payload is complete
+      VersionChainHead *vchain_head = table->recover_version(
+          block_id, idx_in_block, reader.cursor(), thd_ctx);
+      table->insert_record_to_index(vchain_head, thd_ctx);
+    } else if (entry_type == LOG_ENTRY_DELETE) {
+      table->recover_delete(block_id, idx_in_block, thd_ctx);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace db20xx
@@ -0,0 +1,70 @@
+#include "predicate.h"
+#include <cstring>
+
+namespace db20xx {
+
+static int64_t load_signed_int(const char *data, uint32_t length) {
+  uint64_t value = 0;
+  memcpy(&value, data, length);
+  // sign extend from the highest stored byte
+  uint32_t shift = 64 - length * 8;
+  return static_cast<int64_t>(value << shift) >> shift;
+}
+
+static uint64_t load_unsigned_int(const char *data, uint32_t length) {
+  uint64_t value = 0;
+  memcpy(&value, data, length);
+  return value;
+}
+
+template <typename T>
+static bool compare_values(Predicate::CompareOp op, T lhs, T rhs) {
+  switch (op) {
+    case Predicate::EQ:
+      return lhs == rhs;
+    case Predicate::NE:
+      return lhs != rhs;
+    case Predicate::LT:
+      return lhs < rhs;
+    case Predicate::LE:
+      return lhs <= rhs;
+    case Predicate::GT:
+      return lhs > rhs;
+    case Predicate::GE:
+      return lhs >= rhs;
+    default:
+      return false;
+  }
+}
+
+void Predicate::add_term(const Term &term) {
+  terms_.push_back(term);
+  Term &added = terms_.back();
+  if (added.value_type_ == SIGNED_INT && !added.bytes_.empty())
+    added.int_value_ = load_signed_int(added.bytes_.data(), added.length_);
+  else if (added.value_type_ == UNSIGNED_INT && !added.bytes_.empty())
+    added.int_value_ = static_cast<int64_t>(
+        load_unsigned_int(added.bytes_.data(), added.length_));
+}
+
+bool Predicate::evaluate_value(const Term &term, const char *data,
+                               bool is_null) {
+  if (term.op_ == IS_NULL) return is_null;
+  if (term.op_ == IS_NOT_NULL) return !is_null;
+  if (is_null) return false;
+
+  switch (term.value_type_) {
+    case SIGNED_INT:
+      return compare_values(term.op_, load_signed_int(data, term.length_),
+                            term.int_value_);
+    case UNSIGNED_INT:
+      return compare_values(term.op_, load_unsigned_int(data, term.length_),
+                            static_cast<uint64_t>(term.int_value_));
+    case BYTES:
+      return compare_values(term.op_,
+                            memcmp(data, term.bytes_.data(), term.length_), 0);
+  }
+  return false;
+}
+
+}  // namespace db20xx
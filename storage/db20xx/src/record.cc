@@ -1,4 +1,5 @@
 #include "record.h"
+#include <cassert>
 #include <cstdint>
 #include <cstring>
 #include "data_types.h"
@@ -6,6 +7,9 @@ namespace db20xx {
 //======================manipulate record header===============================
 void Record::init() {
   header_.latch_.init();
+  header_.delete_marker_ = false;
+  header_.delta_ = false;
+  header_.delta_num_.store(0, std::memory_order_relaxed);
   header_.txn_id_ = INVALID_TRANSACTION_ID;
   header_.last_read_ts_ = INVALID_READ_TIMESTAMP;
   header_.begin_ts_ = MAX_TIMESTAMP;
@@ -47,137 +51,294 @@ void Record::set_vchain_head(VersionChainHead *vchain_head) {
 }
 VersionChainHead *Record::get_vchain_head() { return header_.vchain_head_; }
 
+void Record::set_delete_marker() { header_.delete_marker_ = true; }
+bool Record::is_delete_marker() const { return header_.delete_marker_; }
+bool Record::is_delta() const { return header_.delta_; }
+uint32_t Record::get_delta_num() const {
+  return header_.delta_num_.load(std::memory_order_relaxed);
+}
+
 //===========================load data======================================
 char *Record::get_payload() { return payload_; }
 RecordHeader *Record::get_header() { return &header_; }
 
-void Record::load_data_from_mysql(char *mysql_record, const Schema &schema) {
-  char *db20xx_row_data = payload_;
+void Record::load_data_from_mysql(char *mysql_record, const Schema &schema,
+                                  VarlenArena &arena,
+                                  const char *old_payload) {
+  assert(!schema.get_copy_plan().empty());
+  schema.get_copy_plan().load_from_mysql(mysql_record, payload_, arena,
+                                         old_payload);
+}
 
-  // store null bytes
-  uint32_t null_bytes = schema.get_null_byte_length();
-  memcpy(db20xx_row_data, mysql_record, null_bytes);
-  db20xx_row_data += null_bytes;
-  mysql_record += null_bytes;
+void Record::load_data_to_mysql(char *mysql_record, const Schema &schema) {
+  if (header_.delta_) {
+    header_.older_version_->load_data_to_mysql(mysql_record, schema);
+    load_delta_to_mysql(mysql_record, schema);
+    return;
+  }
+  assert(!schema.get_copy_plan().empty());
+  schema.get_copy_plan().load_to_mysql(payload_, mysql_record);
+}
+
+/**
+ *@brief
+ *  copy a VARCHAR field: [length bytes | data or pointer to data] to
+ *  [length bytes | data]
+ */
+static void load_varchar_to_mysql(const Field &field, const char *field_meta,
+                                  char *mysql_field) {
+  assert(field.get_field_type() == VARCHAR_ID);
+  uint32_t length_bytes = field.get_mysql_length_bytes();
+  uint32_t actual_data_length = 0;
+  memcpy(&actual_data_length, field_meta, length_bytes);
+  memcpy(mysql_field, field_meta, length_bytes);
+
+  const char *actual_data =
+      VarlenArena::get_data(field_meta + length_bytes, actual_data_length);
+  memcpy(mysql_field + length_bytes, actual_data, actual_data_length);
+}
 
-  // store fields
+/**
+ *@brief
+ *  copy a field of payload format to mysql format
+ */
+static void load_field_to_mysql(const Field &field, const char *field_meta,
+                                char *mysql_field) {
+  if (field.store_inline()) {
+    memcpy(mysql_field, field_meta, field.get_data_bytes());
+  } else if (field.get_field_type() == VARCHAR_ID) {
+    load_varchar_to_mysql(field, field_meta, mysql_field);
+  } else {
+    // BLOB: [length bytes | pointer to data] in both formats
+    uint32_t length_bytes = field.get_mysql_length_bytes();
+    uint32_t actual_data_length = 0;
+    memcpy(&actual_data_length, field_meta, length_bytes);
+    memcpy(mysql_field, field_meta, length_bytes);
+    *reinterpret_cast<const char **>(mysql_field + length_bytes) =
+        VarlenArena::get_data(field_meta + length_bytes, actual_data_length);
+  }
+}
+
+void Record::load_fields_to_mysql(char *mysql_record, const Schema &schema,
+                                  const std::vector<int> &field_ids) {
+  if (header_.delta_) {
+    header_.older_version_->load_fields_to_mysql(mysql_record, schema,
+                                                 field_ids);
+    load_delta_to_mysql(mysql_record, schema);
+    return;
+  }
+
+  memcpy(mysql_record, payload_, schema.get_null_byte_length());
+
+  for (auto i : field_ids) {
+    const Field &field = schema.get_field(i);
+    load_field_to_mysql(field, payload_ + field.get_offset_in_record(),
+                        mysql_record + field.get_offset_in_mysql_record());
+  }
+}
+
+void Record::load_projection_to_mysql(char *mysql_record, const Schema &schema,
+                                      const RowCopyPlan &projection) {
+  if (header_.delta_) {
+    header_.older_version_->load_projection_to_mysql(mysql_record, schema,
+                                                     projection);
+    load_delta_to_mysql(mysql_record, schema);
+    return;
+  }
+  projection.load_to_mysql(payload_, mysql_record);
+}
+
+//===========================delta version==================================
+static uint32_t get_delta_bitmap_length(const Schema &schema) {
+  return (schema.field_num() + 7) / 8;
+}
+
+/**
+ *@brief
+ *  call fn(field, field_meta) for every field stored by a delta payload,
+ *  field_meta is the field in payload format.
+ */
+template <typename Fn>
+static void for_each_delta_field(const char *delta, const Schema &schema,
+                                 Fn fn) {
+  const char *field_meta = delta + get_delta_bitmap_length(schema) +
+                           schema.get_null_byte_length();
+  for (uint32_t i = 0; i < schema.field_num(); i++) {
+    if ((delta[i / 8] & (1 << (i % 8))) == 0) continue;
+    const Field &field = schema.get_field(i);
+    fn(field, field_meta);
+    field_meta += field.get_data_bytes();
+  }
+}
+
+/**
+ *@brief
+ *  data of a non-inline field in mysql format
+ */
+static const char *get_mysql_varlen_data(const Field &field,
+                                         const char *mysql_field) {
+  const char *data = mysql_field + field.get_mysql_length_bytes();
+  if (field.get_field_type() == BLOB_ID)
+    data = *reinterpret_cast<const char *const *>(data);
+  return data;
+}
+
+uint32_t Record::diff_from_mysql(const char *mysql_record,
+                                 const Schema &schema,
+                                 std::vector<uint32_t> &changed_fields) const {
+  assert(!header_.delta_);
+  changed_fields.clear();
+  uint32_t delta_length =
+      get_delta_bitmap_length(schema) + schema.get_null_byte_length();
   for (uint32_t i = 0; i < schema.field_num(); i++) {
     const Field &field = schema.get_field(i);
-    // 以inline方式存储在db20xx中的field，在mysql中一定是定长的。
-    // create_table时，schema中就存储了field长度的信息。
-    // insert时，来自mysql的row data中，该field一定是符合定长约定的。
+    const char *field_meta = payload_ + field.get_offset_in_record();
+    const char *mysql_field =
+        mysql_record + field.get_offset_in_mysql_record();
+    bool changed = false;
     if (field.store_inline()) {
-      uint32_t data_bytes = field.get_data_bytes();
-      memcpy(db20xx_row_data, mysql_record, data_bytes);
-      db20xx_row_data += data_bytes;
-      mysql_record += data_bytes;
-    } else if (field.get_field_type() == VARCHAR_ID) {
-      uint32_t length_bytes = field.get_mysql_length_bytes();
-      // length_bytes的取值只可能是1或者2,见mysql官方文档
-      uint32_t actual_data_length = 0;
-      if (length_bytes == 1) {
-        actual_data_length = *(uint8_t *)(mysql_record);
-        *reinterpret_cast<uint8_t *>(db20xx_row_data) =
-            *reinterpret_cast<uint8_t *>(mysql_record);
-      } else if (length_bytes == 2) {
-        actual_data_length = *(uint16_t *)(mysql_record);
-        *reinterpret_cast<uint16_t *>(db20xx_row_data) =
-            *reinterpret_cast<uint16_t *>(mysql_record);
-      } else {
-        db20xx::LOG_ERROR("invalid mysql length bytes");
-      }
-      db20xx_row_data += length_bytes;
-      mysql_record += length_bytes;
-      char *actual_data = (char *)malloc(actual_data_length);
-      memcpy(actual_data, mysql_record, actual_data_length);
-      // non-inline存储的field中，只存储真实数据的指针
-      *reinterpret_cast<char **>(db20xx_row_data) = actual_data;
-
-      db20xx_row_data += 8;
-      mysql_record += field.mysql_pack_length_ - length_bytes;
-    } else if (field.get_field_type() == BLOB_ID) {
+      changed = memcmp(field_meta, mysql_field, field.get_data_bytes()) != 0;
+    } else {
       uint32_t length_bytes = field.get_mysql_length_bytes();
-      // blob's length_bytes的取值可能是{1,2,3,4},见mysql官方文档
-      if (length_bytes < 1 || 4 < length_bytes){
-        db20xx::LOG_ERROR("invalid mysql length bytes");
-      }
-      uint32_t actual_data_length = 0;
-      memcpy(db20xx_row_data, mysql_record, length_bytes);
-      memcpy(&actual_data_length, mysql_record, length_bytes);
-
-      db20xx_row_data += length_bytes;
-      mysql_record += length_bytes;
-      char *mysql_blob_ptr = *reinterpret_cast<char **>(mysql_record);
-      char *actual_data = (char *)malloc(actual_data_length);
-      memcpy(actual_data, mysql_blob_ptr, actual_data_length);
-      // non-inline存储的field中，只存储真实数据的指针
-      *reinterpret_cast<char **>(db20xx_row_data) = actual_data;
-
-      db20xx_row_data += sizeof(char *);
-      mysql_record += sizeof(char *);
+      uint32_t length = 0;
+      uint32_t mysql_length = 0;
+      memcpy(&length, field_meta, length_bytes);
+      memcpy(&mysql_length, mysql_field, length_bytes);
+      const char *data = VarlenArena::get_data(field_meta + length_bytes, length);
+      const char *mysql_data = get_mysql_varlen_data(field, mysql_field);
+      changed = length != mysql_length ||
+                (data != mysql_data && memcmp(data, mysql_data, length) != 0);
+    }
+    if (changed) {
+      changed_fields.push_back(i);
+      delta_length += field.get_data_bytes();
     }
   }
+  return delta_length;
 }
 
-void Record::load_data_to_mysql(char *mysql_record, const Schema &schema) {
-  char *db20xx_row_data = payload_;
-  // restore null bytes
-  uint32_t null_bytes = schema.get_null_byte_length();
-  memcpy(mysql_record, db20xx_row_data, null_bytes);
-  db20xx_row_data += null_bytes;
-  mysql_record += null_bytes;
-
-  // restore fields
-  for (uint32_t i = 0; i < schema.field_num(); i++) {
+void Record::load_delta_from_mysql(const char *mysql_record,
+                                   const Schema &schema, Record *base,
+                                   const std::vector<uint32_t> &changed_fields,
+                                   VarlenArena &arena) {
+  assert(!base->header_.delta_);
+  header_.delta_ = true;
+  header_.older_version_ = base;
+  base->header_.delta_num_.fetch_add(1, std::memory_order_relaxed);
+
+  uint32_t bitmap_length = get_delta_bitmap_length(schema);
+  memset(payload_, 0, bitmap_length);
+  char *field_meta = payload_ + bitmap_length;
+  memcpy(field_meta, mysql_record, schema.get_null_byte_length());
+  field_meta += schema.get_null_byte_length();
+
+  for (uint32_t i : changed_fields) {
+    payload_[i / 8] |= 1 << (i % 8);
     const Field &field = schema.get_field(i);
+    const char *mysql_field =
+        mysql_record + field.get_offset_in_mysql_record();
     if (field.store_inline()) {
-      uint32_t data_bytes = field.get_data_bytes();
-      memcpy(mysql_record, db20xx_row_data, data_bytes);
-      db20xx_row_data += data_bytes;
-      mysql_record += data_bytes;
+      memcpy(field_meta, mysql_field, field.get_data_bytes());
     } else {
-      if (field.get_field_type() == VARCHAR_ID) {
-        uint32_t length_bytes = field.get_mysql_length_bytes();
-        // length_bytes的取值只可能是1或者2,见mysql官方文档
-        uint32_t actual_data_length = 0;
-        if (length_bytes == 1) {
-          actual_data_length = *(uint8_t *)(db20xx_row_data);
-          *reinterpret_cast<uint8_t *>(mysql_record) =
-              *reinterpret_cast<uint8_t *>(db20xx_row_data);
-        } else if (length_bytes == 2) {
-          actual_data_length = *(uint16_t *)(db20xx_row_data);
-          *reinterpret_cast<uint16_t *>(mysql_record) =
-              *reinterpret_cast<uint16_t *>(db20xx_row_data);
-        } else {
-          db20xx::LOG_ERROR("invalid mysql length bytes");
-        }
-        db20xx_row_data += length_bytes;
-        mysql_record += length_bytes;
-
-        char *actual_data = *reinterpret_cast<char **>(db20xx_row_data);
-        memcpy(mysql_record, actual_data, actual_data_length);
-
-        db20xx_row_data += 8;
-        mysql_record += field.mysql_pack_length_ - length_bytes;
-      } else if (field.get_field_type() == BLOB_ID) {
-        uint32_t length_bytes = field.get_mysql_length_bytes();
-        // blob's length_bytes的取值可能是{1,2,3,4},见mysql官方文档
-        uint32_t actual_data_length = 0;
-        if (length_bytes < 1 || 4 < length_bytes) {
-          db20xx::LOG_ERROR("invalid mysql length bytes");
-        }
-        memcpy(&actual_data_length, db20xx_row_data, actual_data_length);
-        db20xx_row_data += length_bytes;
-        mysql_record += length_bytes;
-
-        char *mysql_blob_ptr = *reinterpret_cast<char **>(mysql_record);
-        char *actual_data = *reinterpret_cast<char **>(db20xx_row_data);
-        memcpy(mysql_blob_ptr, actual_data, actual_data_length);
-
-        db20xx_row_data += sizeof(char *);
-        mysql_record += sizeof(char *);
-      }
+      uint32_t length_bytes = field.get_mysql_length_bytes();
+      uint32_t actual_data_length = 0;
+      memcpy(&actual_data_length, mysql_field, length_bytes);
+      memcpy(field_meta, mysql_field, length_bytes);
+      arena.store(field_meta + length_bytes,
+                  get_mysql_varlen_data(field, mysql_field),
+                  actual_data_length);
     }
+    field_meta += field.get_data_bytes();
+  }
+}
+
+void Record::apply_delta(char *payload, const Schema &schema) {
+  memcpy(payload, payload_ + get_delta_bitmap_length(schema),
+         schema.get_null_byte_length());
+  for_each_delta_field(payload_, schema,
+                       [payload](const Field &field, const char *field_meta) {
+                         memcpy(payload + field.get_offset_in_record(),
+                                field_meta, field.get_data_bytes());
+                       });
+}
+
+const char *Record::get_full_payload(const Schema &schema, char *buf) {
+  if (!header_.delta_) return payload_;
+  memcpy(buf, header_.older_version_->payload_,
+         schema.get_record_data_length());
+  apply_delta(buf, schema);
+  return buf;
+}
+
+void Record::load_delta_to_mysql(char *mysql_record, const Schema &schema) {
+  memcpy(mysql_record, payload_ + get_delta_bitmap_length(schema),
+         schema.get_null_byte_length());
+  for_each_delta_field(
+      payload_, schema,
+      [mysql_record](const Field &field, const char *field_meta) {
+        load_field_to_mysql(field, field_meta,
+                            mysql_record + field.get_offset_in_mysql_record());
+      });
+}
+
+void Record::serialize_payload(const Schema &schema, std::string &buf) {
+  uint32_t payload_length = schema.get_record_data_length();
+  const char *payload = payload_;
+  std::string full_payload;
+  if (header_.delta_) {
+    full_payload.assign(header_.older_version_->payload_, payload_length);
+    apply_delta(&full_payload[0], schema);
+    payload = full_payload.data();
+  }
+  buf.append(payload, payload_length);
+
+  // non-inline field: [length bytes | data or pointer to actual data]
+  for (uint32_t i = 0; i < schema.field_num(); i++) {
+    const Field &field = schema.get_field(i);
+    if (field.store_inline()) continue;
+
+    const char *field_meta = payload + field.get_offset_in_record();
+    uint32_t length_bytes = field.get_mysql_length_bytes();
+    uint32_t actual_data_length = 0;
+    memcpy(&actual_data_length, field_meta, length_bytes);
+    const char *actual_data =
+        VarlenArena::get_data(field_meta + length_bytes, actual_data_length);
+    buf.append(actual_data, actual_data_length);
+  }
+}
+
+void Record::deserialize_payload(const char *&data, const Schema &schema,
+                                 VarlenArena &arena) {
+  uint32_t payload_length = schema.get_record_data_length();
+  memcpy(payload_, data, payload_length);
+  data += payload_length;
+
+  for (uint32_t i = 0; i < schema.field_num(); i++) {
+    const Field &field = schema.get_field(i);
+    if (field.store_inline()) continue;
+
+    char *field_meta = payload_ + field.get_offset_in_record();
+    uint32_t length_bytes = field.get_mysql_length_bytes();
+    uint32_t actual_data_length = 0;
+    memcpy(&actual_data_length, field_meta, length_bytes);
+    arena.store(field_meta + length_bytes, data, actual_data_length);
+    data += actual_data_length;
+  }
+}
+
+void Record::release_out_of_line_data(const Schema &schema) {
+  if (header_.delete_marker_) return;
+  if (header_.delta_) {
+    for_each_delta_field(
+        payload_, schema, [](const Field &field, const char *field_meta) {
+          if (field.store_inline()) return;
+          uint32_t length_bytes = field.get_mysql_length_bytes();
+          uint32_t actual_data_length = 0;
+          memcpy(&actual_data_length, field_meta, length_bytes);
+          VarlenArena::release(field_meta + length_bytes, actual_data_length);
+        });
+    return;
   }
+  schema.get_copy_plan().release_out_of_line_data(payload_);
 }
 }  // namespace db20xx
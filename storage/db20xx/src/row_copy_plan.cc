@@ -0,0 +1,237 @@
+#include "row_copy_plan.h"
+#include <cassert>
+#include <cstring>
+#include "schema.h"
+
+namespace db20xx {
+
+template <uint32_t LENGTH_BYTES>
+static inline uint32_t load_length(const char *data) {
+  uint32_t length = 0;
+  memcpy(&length, data, LENGTH_BYTES);
+  return length;
+}
+
+/**
+ *@brief
+ *  [length bytes | data] or [length bytes | pointer to data] of mysql to
+ *  [length bytes | data or pointer to arena copy of data]. A BLOB value
+ *  the new row still points to is shared with old_payload instead.
+ */
+template <uint32_t LENGTH_BYTES, bool MYSQL_INLINE_DATA>
+static inline void copy_out_of_line_from_mysql(const char *mysql_field,
+                                               char *field_meta,
+                                               VarlenArena &arena,
+                                               const char *old_field_meta) {
+  uint32_t actual_data_length = load_length<LENGTH_BYTES>(mysql_field);
+  memcpy(field_meta, mysql_field, LENGTH_BYTES);
+
+  const char *mysql_data =
+      MYSQL_INLINE_DATA
+          ? mysql_field + LENGTH_BYTES
+          : *reinterpret_cast<char *const *>(mysql_field + LENGTH_BYTES);
+  if (!MYSQL_INLINE_DATA && old_field_meta != nullptr &&
+      actual_data_length > VarlenArena::INLINE_LENGTH &&
+      load_length<LENGTH_BYTES>(old_field_meta) == actual_data_length &&
+      VarlenArena::get_data(old_field_meta + LENGTH_BYTES,
+                            actual_data_length) == mysql_data) {
+    VarlenArena::share(old_field_meta + LENGTH_BYTES, actual_data_length);
+    *reinterpret_cast<const char **>(field_meta + LENGTH_BYTES) = mysql_data;
+    return;
+  }
+  arena.store(field_meta + LENGTH_BYTES, mysql_data, actual_data_length);
+}
+
+/**
+ *@brief
+ *  [length bytes | data or pointer to data] to [length bytes | data] of
+ *  mysql
+ */
+template <uint32_t LENGTH_BYTES>
+static inline void copy_varchar_to_mysql(const char *field_meta,
+                                         char *mysql_field) {
+  uint32_t actual_data_length = load_length<LENGTH_BYTES>(field_meta);
+  memcpy(mysql_field, field_meta, LENGTH_BYTES);
+  memcpy(mysql_field + LENGTH_BYTES,
+         VarlenArena::get_data(field_meta + LENGTH_BYTES, actual_data_length),
+         actual_data_length);
+}
+
+/**
+ *@brief
+ *  [length bytes | data or pointer to data] to
+ *  [length bytes | pointer to data] of mysql
+ */
+template <uint32_t LENGTH_BYTES>
+static inline void copy_blob_to_mysql(const char *field_meta,
+                                      char *mysql_field) {
+  uint32_t actual_data_length = load_length<LENGTH_BYTES>(field_meta);
+  memcpy(mysql_field, field_meta, LENGTH_BYTES);
+  const char *actual_data =
+      VarlenArena::get_data(field_meta + LENGTH_BYTES, actual_data_length);
+  *reinterpret_cast<const char **>(mysql_field + LENGTH_BYTES) = actual_data;
+}
+
+template <uint32_t LENGTH_BYTES, bool SHARE>
+static inline void reference_out_of_line(const char *field_meta) {
+  if (SHARE) {
+    VarlenArena::share(field_meta + LENGTH_BYTES,
+                       load_length<LENGTH_BYTES>(field_meta));
+  } else {
+    VarlenArena::release(field_meta + LENGTH_BYTES,
+                         load_length<LENGTH_BYTES>(field_meta));
+  }
+}
+
+void RowCopyPlan::build(const Schema &schema,
+                        const std::vector<uint32_t> &field_ids) {
+  ops_.clear();
+  add_inline(0, 0, schema.get_null_byte_length());
+  for (uint32_t i : field_ids) {
+    const Field &field = schema.get_field(i);
+    if (field.store_inline()) {
+      add_inline(field.get_offset_in_record(),
+                 field.get_offset_in_mysql_record(), field.get_data_bytes());
+      continue;
+    }
+
+    uint32_t length_bytes = field.get_mysql_length_bytes();
+    OpKind kind;
+    if (field.get_field_type() == VARCHAR_ID) {
+      // length_bytes的取值只可能是1或者2,见mysql官方文档
+      assert(length_bytes == 1 || length_bytes == 2);
+      kind = length_bytes == 1 ? VARCHAR_1 : VARCHAR_2;
+    } else {
+      // blob's length_bytes的取值可能是{1,2,3,4},见mysql官方文档
+      assert(field.get_field_type() == BLOB_ID);
+      assert(1 <= length_bytes && length_bytes <= 4);
+      kind = static_cast<OpKind>(BLOB_1 + length_bytes - 1);
+    }
+    ops_.push_back({kind, field.get_offset_in_record(),
+                    field.get_offset_in_mysql_record(), 0});
+  }
+}
+
+void RowCopyPlan::build(const Schema &schema) {
+  std::vector<uint32_t> field_ids(schema.field_num());
+  for (uint32_t i = 0; i < schema.field_num(); i++) field_ids[i] = i;
+  build(schema, field_ids);
+}
+
+void RowCopyPlan::add_inline(uint32_t offset_in_record,
+                             uint32_t offset_in_mysql_record,
+                             uint32_t length) {
+  if (length == 0) return;
+  if (!ops_.empty()) {
+    Op &last = ops_.back();
+    if (last.kind_ == COPY_INLINE &&
+        last.offset_in_record_ + last.length_ == offset_in_record &&
+        last.offset_in_mysql_record_ + last.length_ == offset_in_mysql_record) {
+      last.length_ += length;
+      return;
+    }
+  }
+  ops_.push_back({COPY_INLINE, offset_in_record, offset_in_mysql_record,
+                  length});
+}
+
+void RowCopyPlan::load_from_mysql(const char *mysql_record, char *payload,
+                                  VarlenArena &arena,
+                                  const char *old_payload) const {
+  for (const Op &op : ops_) {
+    const char *src = mysql_record + op.offset_in_mysql_record_;
+    char *dst = payload + op.offset_in_record_;
+    const char *old = old_payload == nullptr
+                          ? nullptr
+                          : old_payload + op.offset_in_record_;
+    switch (op.kind_) {
+      case COPY_INLINE:
+        memcpy(dst, src, op.length_);
+        break;
+      case VARCHAR_1:
+        copy_out_of_line_from_mysql<1, true>(src, dst, arena, old);
+        break;
+      case VARCHAR_2:
+        copy_out_of_line_from_mysql<2, true>(src, dst, arena, old);
+        break;
+      case BLOB_1:
+        copy_out_of_line_from_mysql<1, false>(src, dst, arena, old);
+        break;
+      case BLOB_2:
+        copy_out_of_line_from_mysql<2, false>(src, dst, arena, old);
+        break;
+      case BLOB_3:
+        copy_out_of_line_from_mysql<3, false>(src, dst, arena, old);
+        break;
+      case BLOB_4:
+        copy_out_of_line_from_mysql<4, false>(src, dst, arena, old);
+        break;
+    }
+  }
+}
+
+void RowCopyPlan::load_to_mysql(const char *payload,
+                                char *mysql_record) const {
+  for (const Op &op : ops_) {
+    const char *src = payload + op.offset_in_record_;
+    char *dst = mysql_record + op.offset_in_mysql_record_;
+    switch (op.kind_) {
+      case COPY_INLINE:
+        memcpy(dst, src, op.length_);
+        break;
+      case VARCHAR_1:
+        copy_varchar_to_mysql<1>(src, dst);
+        break;
+      case VARCHAR_2:
+        copy_varchar_to_mysql<2>(src, dst);
+        break;
+      case BLOB_1:
+        copy_blob_to_mysql<1>(src, dst);
+        break;
+      case BLOB_2:
+        copy_blob_to_mysql<2>(src, dst);
+        break;
+      case BLOB_3:
+        copy_blob_to_mysql<3>(src, dst);
+        break;
+      case BLOB_4:
+        copy_blob_to_mysql<4>(src, dst);
+        break;
+    }
+  }
+}
+
+template <bool SHARE>
+void RowCopyPlan::reference_out_of_line_data(const char *payload) const {
+  for (const Op &op : ops_) {
+    const char *field_meta = payload + op.offset_in_record_;
+    switch (op.kind_) {
+      case COPY_INLINE:
+        break;
+      case VARCHAR_1:
+      case BLOB_1:
+        reference_out_of_line<1, SHARE>(field_meta);
+        break;
+      case VARCHAR_2:
+      case BLOB_2:
+        reference_out_of_line<2, SHARE>(field_meta);
+        break;
+      case BLOB_3:
+        reference_out_of_line<3, SHARE>(field_meta);
+        break;
+      case BLOB_4:
+        reference_out_of_line<4, SHARE>(field_meta);
+        break;
+    }
+  }
+}
+
+void RowCopyPlan::share_out_of_line_data(const char *payload) const {
+  reference_out_of_line_data<true>(payload);
+}
+
+void RowCopyPlan::release_out_of_line_data(const char *payload) const {
+  reference_out_of_line_data<false>(payload);
+}
+
+}  // namespace db20xx
@@ -1,8 +1,15 @@
 #include "table.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <new>
+#include <random>
+#include <string>
 #include "data_types.h"
+#include "gc.h"
 #include "index.h"
 #include "message_logger.h"
 #include "return_status.h"
@@ -10,10 +17,15 @@
 #include "version_chain.h"
 
 namespace db20xx {
-Table::Table(const std::string &table_name, Schema &schema)
-    : table_name_(table_name), schema_(schema) {
-  init_record_allocators();
-  init_vchain_head_allocators();
+Table::Table(const std::string &table_name, Schema &schema,
+             uint32_t records_per_block, StorageLayout storage_layout)
+    : table_name_(table_name),
+      schema_(schema),
+      records_in_block_(records_per_block),
+      storage_layout_(storage_layout) {
+  assert(records_per_block > 0);
+  schema_.compile_copy_plan();
+  if (is_columnar()) column_layout_.build(schema_);
 }
 
 /**
@@ -36,7 +48,7 @@ int Table::insert_record_from_mysql(char *mysql_record,
   VersionChainHead *vchain_head = nullptr;
 
   // check primary key existance
-  if (indexes_.size() > 0) {
+  if (indexes_.size() > 0 && indexes_[0]->is_unique()) {
     Key key;
     indexes_[0]->build_key_from_mysql_record(mysql_record, key, thd_ctx);
     int ret = get_record_from_index(0, key, record, *thd_ctx, false);
@@ -47,11 +59,16 @@ int Table::insert_record_from_mysql(char *mysql_record,
       // The only condition that we can do insertion on an exist version chain
       // Insert a new version after a newest deleted version
       record->lock_header();
-      if (record->get_transaction_id() == INVALID_TRANSACTION_ID &&
-          record->get_newer_version() == nullptr) {
+      if (record->get_transaction_id() == DEAD_TRANSACTION_ID ||
+          !record->is_delete_marker()) {
+        // the chain is sealed by gc, or ends with an aborted or deleted
+        // insertion which is already retired, start a new chain
+        record->unlock_header();
+      } else if (record->get_transaction_id() == INVALID_TRANSACTION_ID &&
+                 record->get_newer_version() == nullptr) {
         record->set_transaction_id(txn_ctx->transaction_id_);
         vchain_head = record->get_vchain_head();
-        txn_ctx->add_to_modify_set(record);
+        txn_ctx->add_to_modify_set(record, this);
         record->unlock_header();
       } else {
         record->unlock_header();
@@ -63,27 +80,153 @@ int Table::insert_record_from_mysql(char *mysql_record,
     }
   }
 
+  // other unique keys must not be carried by a live row
+  for (uint32_t i = 1; i < indexes_.size(); i++) {
+    if (indexes_[i]->is_nullable_unique()) {
+      int ret = check_nullable_unique_key(i, mysql_record, nullptr, thd_ctx);
+      if (ret != DB20XX_SUCCESS) return ret;
+      continue;
+    }
+    if (!indexes_[i]->is_unique()) continue;
+    Key key;
+    Record *other = nullptr;
+    indexes_[i]->build_key_from_mysql_record(mysql_record, key, thd_ctx);
+    int ret = get_record_from_index(i, key, other, *thd_ctx, false);
+    if (ret == DB20XX_ABORT) return ret;
+    if (ret == DB20XX_SUCCESS || ret == DB20XX_INVISIBLE_VERSION)
+      return DB20XX_KEY_EXIST;
+  }
+
   status = alloc_record(record, thd_ctx);
   if (status != DB20XX_SUCCESS) {
     LOG_DEBUG("alloc_record failed");
     return status;
   }
 
-  record->load_data_from_mysql(mysql_record, schema_);
+  record->load_data_from_mysql(mysql_record, schema_,
+                               get_varlen_arena(thd_ctx));
   txn_ctx->mvto_insert(record, vchain_head, this, thd_ctx);
 
   return status;
 }
 //=====================Update operation==============================
+/**
+@brief
+  update a version owned by current transaction.
+  Entries of the old keys stay in the indexes, readers skip them as stale
+  and gc removes them once the old version is reclaimed.
+@return values
+  @retval DB20XX_KEY_EXIST: a new unique key belongs to another row
+*/
 int Table::update_record_from_mysql(Record *old_record, char *new_mysql_record,
                                     ThreadContext *thd_ctx) {
   TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  VersionChainHead *vchain_head = old_record->get_vchain_head();
+
+  // find indexes whose key is changed by the update
+  std::vector<uint32_t> changed_indexes;
+  for (uint32_t i = 0; i < indexes_.size(); i++) {
+    Key new_key;
+    indexes_[i]->build_key_from_mysql_record(new_mysql_record, new_key,
+                                             thd_ctx);
+    if (!version_has_key(i, old_record, new_key, thd_ctx))
+      changed_indexes.push_back(i);
+  }
+
+  for (auto i : changed_indexes) {
+    if (indexes_[i]->is_nullable_unique()) {
+      int ret = check_nullable_unique_key(i, new_mysql_record, vchain_head,
+                                          thd_ctx);
+      if (ret != DB20XX_SUCCESS) return ret;
+      continue;
+    }
+    if (!indexes_[i]->is_unique()) continue;
+    Key new_key;
+    Record *record = nullptr;
+    indexes_[i]->build_key_from_mysql_record(new_mysql_record, new_key,
+                                             thd_ctx);
+    int ret = get_record_from_index(i, new_key, record, *thd_ctx, false);
+    if (ret == DB20XX_ABORT) return ret;
+    if ((ret == DB20XX_SUCCESS && record->get_vchain_head() != vchain_head) ||
+        ret == DB20XX_INVISIBLE_VERSION)
+      return DB20XX_KEY_EXIST;
+  }
+
+  // an uncommitted version is updated in place, its old keys are gone
+  // unless the committed version before it carries them
+  if (old_record->get_begin_timestamp() == MAX_TIMESTAMP) {
+    Record *older_version = old_record->get_older_version();
+    if (older_version != nullptr &&
+        older_version->get_end_timestamp() == MIN_TIMESTAMP)
+      older_version = nullptr;
+    for (auto i : changed_indexes) {
+      Key old_key;
+      indexes_[i]->build_key(get_full_payload(old_record, thd_ctx), old_key,
+                             thd_ctx);
+      if (older_version == nullptr ||
+          !version_has_key(i, older_version, old_key, thd_ctx))
+        indexes_[i]->remove(old_key, vchain_head, *thd_ctx->ti_);
+    }
+  }
+
   int ret = txn_ctx->mvto_update(old_record, new_mysql_record, this, thd_ctx);
   assert(ret == DB20XX_SUCCESS);
 
+  // like insertion, put uncommitted keys so that subsequent queries in the
+  // same transaction can find the new version
+  for (auto i : changed_indexes) {
+    Key new_key;
+    indexes_[i]->build_key_from_mysql_record(new_mysql_record, new_key,
+                                             thd_ctx);
+    indexes_[i]->put(new_key, vchain_head, *thd_ctx->ti_);
+  }
+
   return ret;
 }
 
+/**
+@brief
+  a row without a NULL key part must not share its key of the nullable
+  unique index [idx] with another live row, the rows carrying the key are
+  found by a prefix search. Rows with a NULL key part never collide.
+@args
+  vchain_head is the chain of the row itself for an update, nullptr for an
+  insert
+@return values
+  @retval DB20XX_KEY_EXIST: a visible or uncommitted row carries the key
+*/
+int Table::check_nullable_unique_key(uint32_t idx, const char *mysql_record,
+                                     VersionChainHead *vchain_head,
+                                     ThreadContext *thd_ctx) {
+  MasstreeIndex *index = indexes_[idx];
+  if (index->has_null_key_part(mysql_record)) return DB20XX_SUCCESS;
+  Key key;
+  index->build_key_from_mysql_record(mysql_record, key, thd_ctx);
+
+  scan_stack_type scan_stack;
+  VersionChainHead *entry_vchain_head = nullptr;
+  bool found = index->scan_range_first(key, entry_vchain_head, true,
+                                       scan_stack, *thd_ctx->ti_);
+  while (found) {
+    Key entry_key = scan_stack.get_current_key().full_string();
+    if (!entry_key.less_than(key)) {
+      if (!entry_key.has_prefix(key)) break;
+      if (entry_vchain_head != vchain_head &&
+          entry_has_key(idx, entry_key, key, true)) {
+        Record *record = nullptr;
+        int ret = read_indexed_vchain(idx, entry_key, entry_vchain_head,
+                                      record, *thd_ctx, false);
+        if (ret == DB20XX_ABORT) return ret;
+        if (ret == DB20XX_SUCCESS || ret == DB20XX_INVISIBLE_VERSION)
+          return DB20XX_KEY_EXIST;
+      }
+    }
+    found = index->scan_range_next(entry_vchain_head, scan_stack,
+                                   *thd_ctx->ti_);
+  }
+  return DB20XX_SUCCESS;
+}
+
 //=====================Delete operation==============================
 int Table::delete_record(Record *record, ThreadContext *thd_ctx) {
   TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
@@ -96,14 +239,14 @@ int Table::delete_record(Record *record, ThreadContext *thd_ctx) {
 //=====================Table scan=====================================
 /**
 @brief
-  Table scan without index
-  User should advance scan_cursor mannually before call this function.
-  This function will correct scan_cursor if idx_in_block_ exceed limit 
+  move scan_cursor to a valid entry, jumping to the next block if it has
+  passed the end of current block.
+@return
+  false if the end of table is reached
 */
-int Table::table_scan_get(TableScanCursor &scan_cursor, bool read_own,
-                          ThreadContext *thd_ctx) {
-  TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+bool Table::position_scan_cursor(TableScanCursor &scan_cursor) {
   if (scan_cursor.current_block_ == nullptr) {
+    if (scan_cursor.block_id_ >= scan_cursor.end_block_id_) return false;
     scan_cursor.current_block_ = get_vchain_head_block(scan_cursor.block_id_);
     /*
     LOG_DEBUG(
@@ -114,38 +257,61 @@ int Table::table_scan_get(TableScanCursor &scan_cursor, bool read_own,
         table_scan_cached_block_->block_id_);
     */
   }
-  assert(scan_cursor.current_block_ != nullptr);
 
-  // jump to next useful block
-  while (scan_cursor.idx_in_block_ >= VersionChainHeadBlock::ENTRY_CAPACITY ||
+  // jump to next useful block, the first block may not be published yet
+  while (scan_cursor.current_block_ == nullptr ||
+         scan_cursor.idx_in_block_ >= VersionChainHeadBlock::ENTRY_CAPACITY ||
          scan_cursor.idx_in_block_ ==
              scan_cursor.current_block_->valid_entry_num_.load()) {
-    // have reached the end of current block, jump to next
-    scan_cursor.block_id_ += 1;
-    scan_cursor.idx_in_block_ = 0;
-    /*
-    LOG_DEBUG("Transaction[%ld] Advance scan_cursor. block_id_=%d",
-              txn_ctx->transaction_id_, scan_cursor.block_id_);
-    */
-
-    if (scan_cursor.block_id_ >= next_vchain_head_block_id_) {
+    // have reached the end of current block, jump to next.
+    // the cursor stays at the end of table once it gets there
+    uint32_t block_id = scan_cursor.block_id_;
+    VersionChainHeadBlock *block = nullptr;
+    // skip blocks that are being allocated, they hold no committed version
+    do {
+      block_id += 1;
       /*
-      LOG_DEBUG(
-          "Transaction[%ld] Table scan end. scan_cursor.block_id_=%d, "
-          "next_vchain_head_block_id_=%d",
-          txn_ctx->transaction_id_, scan_cursor.block_id_,
-          next_vchain_head_block_id_.load());
+      LOG_DEBUG("Transaction[%ld] Advance scan_cursor. block_id_=%d",
+                txn_ctx->transaction_id_, block_id);
       */
-      return DB20XX_END_OF_TABLE;
-    }
-    scan_cursor.current_block_ = get_vchain_head_block(scan_cursor.block_id_);
-    assert(scan_cursor.current_block_ != nullptr);
+
+      if (block_id >= next_vchain_head_block_id_ ||
+          block_id >= scan_cursor.end_block_id_) {
+        /*
+        LOG_DEBUG(
+            "Transaction[%ld] Table scan end. block_id=%d, "
+            "next_vchain_head_block_id_=%d",
+            txn_ctx->transaction_id_, block_id,
+            next_vchain_head_block_id_.load());
+        */
+        return false;
+      }
+      block = get_vchain_head_block(block_id);
+    } while (block == nullptr);
+    scan_cursor.current_block_ = block;
+    scan_cursor.block_id_ = block_id;
+    scan_cursor.idx_in_block_ = 0;
+    vchain_head_blocks_.prefetch(block_id + 1);
     /*
     LOG_DEBUG("Transaction[%ld] Advance vchain_head_block. block_id_=%d",
               txn_ctx->transaction_id_, table_scan_cached_block_->block_id_);
     */
   }
 
+  return true;
+}
+
+/**
+@brief
+  Table scan without index
+  User should advance scan_cursor mannually before call this function.
+  This function will correct scan_cursor if idx_in_block_ exceed limit 
+*/
+int Table::table_scan_get(TableScanCursor &scan_cursor, bool read_own,
+                          ThreadContext *thd_ctx) {
+  TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  if (!position_scan_cursor(scan_cursor)) return DB20XX_END_OF_TABLE;
+
   /*
   LOG_DEBUG(
       "Transaction[%ld] scan_cursor.block_id_=%d, cached_block.block_id_=%d",
@@ -155,8 +321,18 @@ int Table::table_scan_get(TableScanCursor &scan_cursor, bool read_own,
 
   VersionChainHead *vchain_head =
       scan_cursor.current_block_->get_vchain_head(&scan_cursor);
+  // entries beyond valid_entry_num_ may not be published yet
+  uint32_t entry_num =
+      std::min(scan_cursor.current_block_->valid_entry_num_.load(),
+               VersionChainHeadBlock::ENTRY_CAPACITY);
+  uint32_t prefetch_idx = scan_cursor.idx_in_block_ + SCAN_PREFETCH_DISTANCE;
+  if (prefetch_idx < entry_num) {
+    Record *prefetch_record =
+        scan_cursor.current_block_->entries_[prefetch_idx].latest_record_;
+    if (prefetch_record != nullptr) __builtin_prefetch(prefetch_record, 0, 1);
+  }
 
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own,
+  int ret = txn_ctx->mvto_read_version_chain(this, *vchain_head, read_own,
                                              scan_cursor.record_);
   if (ret == DB20XX_ABORT || ret == DB20XX_RETRY) {
     txn_ctx->set_abort();
@@ -170,6 +346,237 @@ int Table::table_scan_get(TableScanCursor &scan_cursor, bool read_own,
   return ret;
 }
 
+/**
+@brief
+  read visible versions of a whole block in one loop, until max_num
+  records are found or the end of table is reached. scan_cursor is left
+  behind the last entry read.
+*/
+int Table::table_scan_get_batch(TableScanCursor &scan_cursor, bool read_own,
+                                ThreadContext *thd_ctx, Record **records,
+                                uint32_t max_num, uint32_t &num) {
+  TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  num = 0;
+  while (num < max_num && position_scan_cursor(scan_cursor)) {
+    VersionChainHeadBlock *block = scan_cursor.current_block_;
+    uint32_t entry_num = std::min(block->valid_entry_num_.load(),
+                                  VersionChainHeadBlock::ENTRY_CAPACITY);
+    uint32_t &idx = scan_cursor.idx_in_block_;
+    for (; idx < entry_num && num < max_num; idx++) {
+      uint32_t prefetch_idx = idx + SCAN_PREFETCH_DISTANCE;
+      if (prefetch_idx < entry_num) {
+        Record *prefetch_record = block->entries_[prefetch_idx].latest_record_;
+        if (prefetch_record != nullptr)
+          __builtin_prefetch(prefetch_record, 0, 1);
+      }
+
+      Record *record = nullptr;
+      int ret = txn_ctx->mvto_read_version_chain(this, block->entries_[idx],
+                                                 read_own, record);
+      if (ret == DB20XX_SUCCESS) {
+        records[num++] = record;
+      } else if (ret == DB20XX_ABORT || ret == DB20XX_RETRY) {
+        txn_ctx->set_abort();
+        return ret;
+      }
+    }
+  }
+
+  return num > 0 ? DB20XX_SUCCESS : DB20XX_END_OF_TABLE;
+}
+
+/**
+@brief
+  a block range is read in four steps: the stamps split entries into those
+  whose stored version is visible and those read from their chains, the
+  former are filtered column by column and copied, then their stamps are
+  checked again, entries stored meanwhile are read from their chains too.
+*/
+int Table::column_scan_get_batch(TableScanCursor &scan_cursor,
+                                 const ColumnScanPlan &plan,
+                                 ThreadContext *thd_ctx, char *rows,
+                                 uint32_t row_length, Record **records,
+                                 VersionChainHead **vchain_heads,
+                                 uint32_t max_num, uint32_t &num) {
+  TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  assert(is_columnar() && txn_ctx->is_read_only());
+  uint64_t snapshot = txn_ctx->get_transaction_id();
+  const std::vector<ColumnLayout::Column> &columns =
+      column_layout_.get_columns();
+  uint32_t null_byte_length = column_layout_.get_null_byte_length();
+  uint32_t stored_entries[ColumnBlock::ENTRY_CAPACITY];
+  uint64_t stored_stamps[ColumnBlock::ENTRY_CAPACITY];
+  bool selected[ColumnBlock::ENTRY_CAPACITY];
+  uint32_t chain_entries[ColumnBlock::ENTRY_CAPACITY];
+
+  num = 0;
+  while (num < max_num && position_scan_cursor(scan_cursor)) {
+    VersionChainHeadBlock *block = scan_cursor.current_block_;
+    const ColumnBlock *column_block = get_column_block(scan_cursor.block_id_);
+    uint32_t begin = scan_cursor.idx_in_block_;
+    uint32_t end = std::min(block->valid_entry_num_.load(),
+                            VersionChainHeadBlock::ENTRY_CAPACITY);
+    if (end - begin > max_num - num) end = begin + (max_num - num);
+    scan_cursor.idx_in_block_ = end;
+
+    uint32_t stored_num = 0;
+    uint32_t chain_num = 0;
+    for (uint32_t idx = begin; idx < end; idx++) {
+      uint64_t stamp = column_block->load_stamp(idx);
+      if (!(stamp & ColumnBlock::STAMP_VALID) ||
+          (stamp & ColumnBlock::STAMP_LOCKED) ||
+          (stamp & ColumnBlock::STAMP_TIMESTAMP_MASK) > snapshot) {
+        chain_entries[chain_num++] = idx;
+      } else if (!(stamp & ColumnBlock::STAMP_DELETED)) {
+        stored_entries[stored_num] = idx;
+        stored_stamps[stored_num] = stamp;
+        selected[stored_num++] = true;
+      }
+    }
+
+    // the zone maps cover every stored version, the stamps are loaded
+    if (stored_num > 0 && column_block->zone_excludes(column_layout_, plan))
+      memset(selected, 0, stored_num);
+    const char *null_bytes = column_block->get_null_bytes(column_layout_);
+    for (const ColumnScanPlan::Term &term : plan.get_terms()) {
+      const ColumnLayout::Column &column = columns[term.column_];
+      const char *values = column_block->get_column(column);
+      for (uint32_t i = 0; i < stored_num; i++) {
+        if (!selected[i]) continue;
+        uint32_t idx = stored_entries[i];
+        bool is_null = (null_bytes[idx * null_byte_length +
+                                   term.term_.null_offset_] &
+                        term.term_.null_mask_) != 0;
+        selected[i] = Predicate::evaluate_value(
+            term.term_, values + idx * column.length_, is_null);
+      }
+    }
+
+    uint32_t copied_num = 0;
+    for (uint32_t i = 0; i < stored_num; i++) {
+      if (!selected[i]) continue;
+      uint32_t idx = stored_entries[i];
+      char *row = rows + (num + copied_num) * row_length;
+      memcpy(row, null_bytes + idx * null_byte_length, null_byte_length);
+      for (uint32_t column_id : plan.get_columns()) {
+        const ColumnLayout::Column &column = columns[column_id];
+        memcpy(row + column.offset_in_mysql_record_,
+               column_block->get_column(column) + idx * column.length_,
+               column.length_);
+      }
+      records[num + copied_num] = nullptr;
+      vchain_heads[num + copied_num] = &block->entries_[idx];
+      copied_num++;
+    }
+
+    // values read while a writer stored the entry are dropped
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t kept_num = 0;
+    for (uint32_t i = 0, copied = 0; i < stored_num; i++) {
+      uint32_t idx = stored_entries[i];
+      bool stale = column_block->load_stamp(idx) != stored_stamps[i];
+      if (stale) chain_entries[chain_num++] = idx;
+      if (!selected[i]) continue;
+      if (!stale) {
+        if (kept_num != copied) {
+          memcpy(rows + (num + kept_num) * row_length,
+                 rows + (num + copied) * row_length, row_length);
+          vchain_heads[num + kept_num] = vchain_heads[num + copied];
+        }
+        kept_num++;
+      }
+      copied++;
+    }
+    assert(kept_num <= copied_num);
+    num += kept_num;
+
+    for (uint32_t i = 0; i < chain_num; i++) {
+      VersionChainHead *vchain_head = &block->entries_[chain_entries[i]];
+      Record *record = nullptr;
+      int ret = txn_ctx->mvto_read_version_chain(this, *vchain_head, false,
+                                                 record);
+      if (ret != DB20XX_SUCCESS && ret != DB20XX_DELETED_VERSION) continue;
+      if (record == vchain_head->latest_record_)
+        fill_columns(vchain_head, record, ret == DB20XX_DELETED_VERSION,
+                     thd_ctx);
+      if (ret == DB20XX_DELETED_VERSION) continue;
+
+      const char *payload = get_full_payload(record, thd_ctx);
+      bool satisfied = true;
+      for (const ColumnScanPlan::Term &term : plan.get_terms()) {
+        const Predicate::Term &predicate_term = term.term_;
+        bool is_null = (payload[predicate_term.null_offset_] &
+                        predicate_term.null_mask_) != 0;
+        if (!Predicate::evaluate_value(
+                predicate_term, payload + predicate_term.offset_, is_null)) {
+          satisfied = false;
+          break;
+        }
+      }
+      if (!satisfied) continue;
+      records[num] = record;
+      vchain_heads[num] = vchain_head;
+      num++;
+    }
+  }
+
+  return num > 0 ? DB20XX_SUCCESS : DB20XX_END_OF_TABLE;
+}
+
+void Table::store_columns(Record *record, std::string &payload_container) {
+  VersionChainHead *vchain_head = record->get_vchain_head();
+  uint32_t block_id = 0;
+  uint32_t idx_in_block = 0;
+  get_vchain_head_location(vchain_head, block_id, idx_in_block);
+  bool deleted = record->get_end_timestamp() == MIN_TIMESTAMP;
+  const char *payload = nullptr;
+  if (!deleted) {
+    payload_container.resize(schema_.get_record_data_length());
+    payload = record->get_full_payload(schema_, &payload_container[0]);
+  }
+  get_column_block(block_id)->store(
+      column_layout_, idx_in_block, payload,
+      ColumnBlock::make_stamp(record->get_begin_timestamp(), deleted), true);
+}
+
+void Table::fill_columns(VersionChainHead *vchain_head, Record *record,
+                         bool deleted, ThreadContext *thd_ctx) {
+  uint32_t block_id = 0;
+  uint32_t idx_in_block = 0;
+  get_vchain_head_location(vchain_head, block_id, idx_in_block);
+  const char *payload = deleted ? nullptr : get_full_payload(record, thd_ctx);
+  get_column_block(block_id)->store(
+      column_layout_, idx_in_block, payload,
+      ColumnBlock::make_stamp(record->get_begin_timestamp(), deleted), false);
+}
+
+void Table::get_vchain_head_location(VersionChainHead *vchain_head,
+                                     uint32_t &block_id,
+                                     uint32_t &idx_in_block) {
+  block_id = VersionChainHeadBlock::get_block(vchain_head)->get_block_id();
+  idx_in_block = VersionChainHeadBlock::get_idx_in_block(vchain_head);
+}
+
+int Table::get_record_by_location(uint32_t block_id, uint32_t idx_in_block,
+                                  Record *&record, ThreadContext *thd_ctx,
+                                  bool read_own) {
+  if (block_id >= next_vchain_head_block_id_.load() ||
+      idx_in_block >= VersionChainHeadBlock::ENTRY_CAPACITY)
+    return DB20XX_KEY_NOT_EXIST;
+
+  VersionChainHeadBlock *block = get_vchain_head_block(block_id);
+  if (block == nullptr || idx_in_block >= block->valid_entry_num_.load())
+    return DB20XX_KEY_NOT_EXIST;
+
+  TransactionContext *txn_ctx = thd_ctx->get_transaction_context();
+  int ret = txn_ctx->mvto_read_version_chain(
+      this, block->entries_[idx_in_block], read_own, record);
+  if (ret == DB20XX_ABORT || ret == DB20XX_RETRY) {
+    txn_ctx->set_abort();
+  }
+  return ret;
+}
+
 //===================Index Operations===========================
 
 /**
@@ -193,15 +600,44 @@ void Table::build_index(const KeyInfo &keyinfo, threadinfo &ti) {
 void Table::insert_record_to_index(uint32_t idx, VersionChainHead *vchain_head,
                                    ThreadContext *thd_ctx) {
   Key key;
-  indexes_[idx]->build_key(vchain_head->get_latest_record_payload(), key,
-                           thd_ctx);
+  indexes_[idx]->build_key(
+      get_full_payload(vchain_head->latest_record_, thd_ctx), key, thd_ctx);
   indexes_[idx]->put(key, vchain_head, *thd_ctx->ti_);
 }
 
 void Table::insert_record_to_index(VersionChainHead *vchain_head,
                                    ThreadContext *thd_ctx) {
+  BulkInsertBuffer *buffer = thd_ctx->get_table_allocator(this).bulk_insert_;
+  if (buffer == nullptr) {
+    for (size_t i = 0; i < indexes_.size(); i++) {
+      insert_record_to_index(i, vchain_head, thd_ctx);
+    }
+    return;
+  }
+
+  const char *payload = get_full_payload(vchain_head->latest_record_, thd_ctx);
+  for (uint32_t i = 0; i < indexes_.size(); i++) {
+    Key key;
+    indexes_[i]->build_key(payload, key, thd_ctx);
+    if (buffer->is_deferred(i))
+      buffer->add(i, key, vchain_head);
+    else
+      indexes_[i]->put(key, vchain_head, *thd_ctx->ti_);
+  }
+  if (buffer->entry_num_ >= BULK_INSERT_BUFFER_ENTRIES)
+    flush_bulk_insert(*buffer, thd_ctx);
+}
+
+/**
+@brief
+  insert the keys of an uncommitted version, which is not the latest
+  version of its chain yet
+*/
+void Table::insert_version_to_index(Record *record, ThreadContext *thd_ctx) {
   for (size_t i = 0; i < indexes_.size(); i++) {
-    insert_record_to_index(i, vchain_head, thd_ctx);
+    Key key;
+    indexes_[i]->build_key(get_full_payload(record, thd_ctx), key, thd_ctx);
+    indexes_[i]->put(key, record->get_vchain_head(), *thd_ctx->ti_);
   }
 }
 
@@ -214,6 +650,15 @@ void Table::insert_record_to_index(VersionChainHead *vchain_head,
 */
 int Table::get_record_from_index(uint32_t idx, const Key &key, Record *&record,
                                  ThreadContext &thd_ctx, bool read_own) {
+  if (!indexes_[idx]->is_unique()) {
+    // rows sharing the key have entries of their own, read the first
+    // visible one
+    scan_stack_type scan_stack;
+    int ret = index_prefix_key_search(idx, key, record, scan_stack, thd_ctx,
+                                      read_own, true);
+    return ret == DB20XX_INDEX_RANGE_END ? DB20XX_KEY_NOT_EXIST : ret;
+  }
+
   VersionChainHead *vchain_head = nullptr;
   bool found = indexes_[idx]->get(key, vchain_head, *thd_ctx.ti_);
   if (!found) {
@@ -221,20 +666,58 @@ int Table::get_record_from_index(uint32_t idx, const Key &key, Record *&record,
     return DB20XX_KEY_NOT_EXIST;
   }
 
-  // Traverse the version chain to find a valid version
-  TransactionContext *txn_ctx = thd_ctx.get_transaction_context();
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own, record);
-  if (ret == DB20XX_ABORT) {
-    txn_ctx->set_abort();
+  return read_indexed_vchain(idx, key, vchain_head, record, thd_ctx, read_own);
+}
+
+void Table::multi_get_records_from_index(uint32_t idx, const Key *keys,
+                                         uint32_t num, Record **records,
+                                         int *results, ThreadContext &thd_ctx,
+                                         bool read_own) {
+  if (!indexes_[idx]->is_unique()) {
+    for (uint32_t i = 0; i < num; i++)
+      results[i] = get_record_from_index(idx, keys[i], records[i], thd_ctx,
+                                         read_own);
+    return;
   }
 
-  return ret;
+  VersionChainHead *vchain_heads[MULTI_GET_GROUP_SIZE];
+  for (uint32_t first = 0; first < num; first += MULTI_GET_GROUP_SIZE) {
+    uint32_t group_num = num - first;
+    if (group_num > MULTI_GET_GROUP_SIZE) group_num = MULTI_GET_GROUP_SIZE;
+    // stage 1: descend Masstree for every key, the chain heads found are
+    // prefetched while the following keys are looked up
+    for (uint32_t i = 0; i < group_num; i++) {
+      if (!indexes_[idx]->get(keys[first + i], vchain_heads[i],
+                              *thd_ctx.ti_)) {
+        vchain_heads[i] = nullptr;
+        continue;
+      }
+      __builtin_prefetch(vchain_heads[i], 0, 1);
+    }
+    // stage 2: prefetch the latest versions
+    for (uint32_t i = 0; i < group_num; i++) {
+      if (vchain_heads[i] == nullptr) continue;
+      Record *latest_record = vchain_heads[i]->latest_record_;
+      if (latest_record != nullptr) __builtin_prefetch(latest_record, 0, 1);
+    }
+    // stage 3: read the version chains
+    for (uint32_t i = 0; i < group_num; i++) {
+      records[first + i] = nullptr;
+      if (vchain_heads[i] == nullptr) {
+        results[first + i] = DB20XX_KEY_NOT_EXIST;
+        continue;
+      }
+      results[first + i] =
+          read_indexed_vchain(idx, keys[first + i], vchain_heads[i],
+                              records[first + i], thd_ctx, read_own);
+    }
+  }
 }
 
 int Table::index_scan_range_first(uint32_t idx, const Key &key, Record *&record,
                                   bool emit_firstkey,
                                   scan_stack_type &scan_stack,
-                                  ThreadContext &thd_ctx, bool read_own) const {
+                                  ThreadContext &thd_ctx, bool read_own) {
   VersionChainHead *vchain_head = nullptr;
   scan_stack.reset();
 
@@ -242,48 +725,30 @@ int Table::index_scan_range_first(uint32_t idx, const Key &key, Record *&record,
                                                scan_stack, *thd_ctx.ti_);
   if (!found) return DB20XX_KEY_NOT_EXIST;
 
-  // Traverse the version chain to find a valid version
-  TransactionContext *txn_ctx = thd_ctx.get_transaction_context();
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own, record);
-  if (ret == DB20XX_ABORT) {
-    txn_ctx->set_abort();
-    return ret;
-  }
-
-  if (ret == DB20XX_SUCCESS) {
-    return true;
-  } else if (emit_firstkey) {
-    return false;
-  } else {
-    return index_scan_range_next(idx, record, scan_stack, thd_ctx, read_own);
-  }
+  Key current_key = scan_stack.get_current_key().full_string();
+  int ret = read_indexed_vchain(idx, current_key, vchain_head, record, thd_ctx,
+                                read_own);
+  if (ret == DB20XX_ABORT || ret == DB20XX_SUCCESS) return ret;
+  // the first entry is deleted, invisible or stale
+  return index_scan_range_next(idx, record, scan_stack, thd_ctx, read_own);
 }
 
 int Table::index_scan_range_next(uint32_t idx, Record *&record,
                                  scan_stack_type &scan_stack,
-                                 ThreadContext &thd_ctx, bool read_own) const {
+                                 ThreadContext &thd_ctx, bool read_own) {
   VersionChainHead *vchain_head = nullptr;
-  bool found =
-      indexes_[idx]->scan_range_next(vchain_head, scan_stack, *thd_ctx.ti_);
-  if (!found) return DB20XX_INDEX_RANGE_END;
-
-  // Traverse the version chain to find a valid version
-  TransactionContext *txn_ctx = thd_ctx.get_transaction_context();
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own, record);
-  if (ret == DB20XX_ABORT) {
-    txn_ctx->set_abort();
-    return ret;
-  }
-  if (ret == DB20XX_SUCCESS) {
-    return ret;
-  }
-
-  else if (ret == DB20XX_DELETED_VERSION || ret == DB20XX_INVISIBLE_VERSION)
-    return index_scan_range_next(idx, record, scan_stack, thd_ctx, read_own);
-  else {
-    // panic
-    assert(false);
-    return ret;
+  while (true) {
+    bool found =
+        indexes_[idx]->scan_range_next(vchain_head, scan_stack, *thd_ctx.ti_);
+    if (!found) return DB20XX_INDEX_RANGE_END;
+
+    Key current_key = scan_stack.get_current_key().full_string();
+    int ret = read_indexed_vchain(idx, current_key, vchain_head, record,
+                                  thd_ctx, read_own);
+    if (ret == DB20XX_ABORT || ret == DB20XX_SUCCESS) return ret;
+    // skip deleted, invisible and stale entries
+    assert(ret == DB20XX_DELETED_VERSION || ret == DB20XX_INVISIBLE_VERSION ||
+           ret == DB20XX_KEY_NOT_EXIST);
   }
 }
 
@@ -291,7 +756,7 @@ int Table::index_rscan_range_first(uint32_t idx, const Key &key,
                                    Record *&record, bool emit_firstkey,
                                    scan_stack_type &scan_stack,
                                    ThreadContext &thd_ctx,
-                                   bool read_own) const {
+                                   bool read_own) {
   VersionChainHead *vchain_head = nullptr;
   scan_stack.reset();
 
@@ -299,57 +764,37 @@ int Table::index_rscan_range_first(uint32_t idx, const Key &key,
                                                 scan_stack, *thd_ctx.ti_);
   if (!found) return DB20XX_KEY_NOT_EXIST;
 
-  // Traverse the version chain to find a valid version
-  TransactionContext *txn_ctx = thd_ctx.get_transaction_context();
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own, record);
-  if (ret == DB20XX_ABORT) {
-    txn_ctx->set_abort();
-    return ret;
-  }
-
-  if (ret == DB20XX_SUCCESS) {
-    return ret;
-  } else if (emit_firstkey) {
-    return ret;
-  } else {
-    assert(emit_firstkey == false);
-    return index_scan_range_next(idx, record, scan_stack, thd_ctx, read_own);
-  }
+  Key current_key = scan_stack.get_current_key().full_string();
+  int ret = read_indexed_vchain(idx, current_key, vchain_head, record, thd_ctx,
+                                read_own);
+  if (ret == DB20XX_ABORT || ret == DB20XX_SUCCESS) return ret;
+  // the first entry is deleted, invisible or stale
+  return index_rscan_range_next(idx, record, scan_stack, thd_ctx, read_own);
 }
 
 int Table::index_rscan_range_next(uint32_t idx, Record *&record,
                                   scan_stack_type &scan_stack,
-                                  ThreadContext &thd_ctx, bool read_own) const {
+                                  ThreadContext &thd_ctx, bool read_own) {
   VersionChainHead *vchain_head = nullptr;
-  bool found =
-      indexes_[idx]->rscan_range_next(vchain_head, scan_stack, *thd_ctx.ti_);
-  if (!found) return DB20XX_INDEX_RANGE_END;
-
-  // Traverse the version chain to find a valid version
-  TransactionContext *txn_ctx = thd_ctx.get_transaction_context();
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own, record);
-  if (ret == DB20XX_ABORT) {
-    txn_ctx->set_abort();
-    return ret;
-  }
-
-  if (ret == DB20XX_SUCCESS) {
-    return ret;
-  }
-
-  else if (ret == DB20XX_DELETED_VERSION || ret == DB20XX_INVISIBLE_VERSION)
-    return index_scan_range_next(idx, record, scan_stack, thd_ctx, read_own);
-  else {
-    // panic
-    assert(false);
-    return ret;
+  while (true) {
+    bool found =
+        indexes_[idx]->rscan_range_next(vchain_head, scan_stack, *thd_ctx.ti_);
+    if (!found) return DB20XX_INDEX_RANGE_END;
+
+    Key current_key = scan_stack.get_current_key().full_string();
+    int ret = read_indexed_vchain(idx, current_key, vchain_head, record,
+                                  thd_ctx, read_own);
+    if (ret == DB20XX_ABORT || ret == DB20XX_SUCCESS) return ret;
+    // skip deleted, invisible and stale entries
+    assert(ret == DB20XX_DELETED_VERSION || ret == DB20XX_INVISIBLE_VERSION ||
+           ret == DB20XX_KEY_NOT_EXIST);
   }
 }
 
 int Table::index_prefix_key_search(uint32_t idx, const Key &key,
                                    Record *&record, scan_stack_type &scan_stack,
-                                   ThreadContext &thd_ctx,
-                                   bool read_own) const {
+                                   ThreadContext &thd_ctx, bool read_own,
+                                   bool full_key) {
   VersionChainHead *vchain_head = nullptr;
   scan_stack.reset();
 
@@ -362,69 +807,358 @@ int Table::index_prefix_key_search(uint32_t idx, const Key &key,
   Key current_key = scan_stack.get_current_key().full_string();
   if (current_key.less_than(key)) {
     return index_prefix_search_next(idx, key, record, scan_stack, thd_ctx,
-                                    read_own);
+                                    read_own, full_key);
   } else if (!current_key.has_prefix(key)) {
     return DB20XX_KEY_NOT_EXIST;
-  }
-
-  // Traverse the version chain to find a valid version
-  TransactionContext *txn_ctx = thd_ctx.get_transaction_context();
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own, record);
-  if (ret == DB20XX_ABORT) {
-    txn_ctx->set_abort();
-    return DB20XX_ABORT;
-  }
-
-  if (ret == DB20XX_SUCCESS) {
-    return DB20XX_SUCCESS;
-  } else if (ret == DB20XX_INVISIBLE_VERSION || ret == DB20XX_DELETED_VERSION) {
+  } else if (!entry_has_key(idx, current_key, key, full_key)) {
     return index_prefix_search_next(idx, key, record, scan_stack, thd_ctx,
-                                    read_own);
-  } else {
-    assert(false);
+                                    read_own, full_key);
   }
 
-  assert(false);
-  return DB20XX_ABORT;
+  int ret = read_indexed_vchain(idx, current_key, vchain_head, record, thd_ctx,
+                                read_own);
+  if (ret == DB20XX_ABORT || ret == DB20XX_SUCCESS) return ret;
+  return index_prefix_search_next(idx, key, record, scan_stack, thd_ctx,
+                                  read_own, full_key);
 }
 
 int Table::index_prefix_search_next(uint32_t idx, const Key &key,
                                     Record *&record,
                                     scan_stack_type &scan_stack,
-                                    ThreadContext &thd_ctx,
-                                    bool read_own) const {
+                                    ThreadContext &thd_ctx, bool read_own,
+                                    bool full_key) {
   VersionChainHead *vchain_head = nullptr;
+  while (true) {
+    // found=true means scan has not reached the end
+    bool found =
+        indexes_[idx]->scan_range_next(vchain_head, scan_stack, *thd_ctx.ti_);
 
-  // found=true means scan has not reached the end
-  bool found =
-      indexes_[idx]->scan_range_next(vchain_head, scan_stack, *thd_ctx.ti_);
+    if (!found) return DB20XX_INDEX_RANGE_END;
 
-  if (!found) return DB20XX_INDEX_RANGE_END;
+    Key current_key = scan_stack.get_current_key().full_string();
+    if (!current_key.has_prefix(key)) {
+      return DB20XX_INDEX_RANGE_END;
+    }
+    if (!entry_has_key(idx, current_key, key, full_key)) continue;
 
-  Key current_key = scan_stack.get_current_key().full_string();
-  if (!current_key.has_prefix(key)) {
-    return DB20XX_INDEX_RANGE_END;
+    int ret = read_indexed_vchain(idx, current_key, vchain_head, record,
+                                  thd_ctx, read_own);
+    if (ret == DB20XX_ABORT || ret == DB20XX_SUCCESS) return ret;
+    LOG_DEBUG("read version chain fail, vchain_head:%p, status:%d",
+              vchain_head, ret);
   }
+}
 
-  // Traverse the version chain to find a valid version
+/**
+@brief
+  read the version chain found under the entry [key] in index [idx].
+  An index entry is stale if the visible version does not carry the key
+  anymore: the key was changed by an update, or the entry was put by an
+  aborted transaction. gc removes such entries once nobody needs them.
+@return values
+  @retval DB20XX_KEY_NOT_EXIST: the entry is stale
+  others: same as mvto_read_version_chain
+*/
+int Table::read_indexed_vchain(uint32_t idx, const Key &key,
+                               VersionChainHead *vchain_head, Record *&record,
+                               ThreadContext &thd_ctx, bool read_own) {
   TransactionContext *txn_ctx = thd_ctx.get_transaction_context();
-  int ret = txn_ctx->mvto_read_version_chain(*vchain_head, read_own, record);
+  int ret =
+      txn_ctx->mvto_read_version_chain(this, *vchain_head, read_own, record);
   if (ret == DB20XX_ABORT) {
     txn_ctx->set_abort();
     return ret;
-  } else if (ret == DB20XX_SUCCESS) {
-    return ret;
-  } else if (ret == DB20XX_INVISIBLE_VERSION || ret == DB20XX_DELETED_VERSION) {
-    LOG_DEBUG("Transaction[%lu], read version chain fail, vchain_head:%p",
-              txn_ctx->transaction_id_, vchain_head);
-    return index_prefix_search_next(idx, key, record, scan_stack, thd_ctx,
-                                    read_own);
-  } else {
-    assert(false);
   }
+  if (ret == DB20XX_SUCCESS &&
+      !version_has_key(idx, record, indexes_[idx]->get_user_key(key),
+                       &thd_ctx))
+    return DB20XX_KEY_NOT_EXIST;
+  return ret;
+}
+
+bool Table::entry_has_key(uint32_t idx, const Key &entry_key, const Key &key,
+                          bool full_key) const {
+  Key user_key = indexes_[idx]->get_user_key(entry_key);
+  if (!user_key.has_prefix(key)) return false;
+  return !full_key || user_key.len == key.len;
+}
+
+bool Table::version_has_key(uint32_t idx, Record *record, const Key &key,
+                            ThreadContext *thd_ctx) {
+  Key version_key;
+  indexes_[idx]->build_key(get_full_payload(record, thd_ctx), version_key,
+                           thd_ctx->get_check_key_container());
+  return version_key.len == key.len &&
+         memcmp(version_key.s, key.s, key.len) == 0;
+}
 
-  // never reach here
-  return DB20XX_ABORT;
+//===================Statistics=================================
+void Table::unregister_writer(uint64_t commit_id) {
+  uint64_t last_commit_id = last_commit_id_.load();
+  while (commit_id > last_commit_id &&
+         !last_commit_id_.compare_exchange_weak(last_commit_id, commit_id)) {
+  }
+  active_writer_num_.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+int Table::count_records(uint64_t &count, bool read_own,
+                         ThreadContext *thd_ctx) {
+  uint64_t transaction_id =
+      thd_ctx->get_transaction_context()->get_transaction_id();
+  // a writer finishing between the two checks updates last_commit_id_
+  // before it leaves
+  if (active_writer_num_.load(std::memory_order_acquire) == 0) {
+    int64_t record_num = record_num_.load(std::memory_order_acquire);
+    if (last_commit_id_.load(std::memory_order_acquire) <= transaction_id &&
+        active_writer_num_.load(std::memory_order_acquire) == 0) {
+      count = std::max<int64_t>(record_num, 0);
+      return DB20XX_SUCCESS;
+    }
+  }
+
+  std::vector<Record *> records(VersionChainHeadBlock::ENTRY_CAPACITY);
+  TableScanCursor scan_cursor;
+  scan_cursor.reset();
+  uint32_t num = 0;
+  int ret = DB20XX_SUCCESS;
+  count = 0;
+  // only the stamps of column blocks are read, rows get the null bytes
+  if (is_columnar() && !read_own &&
+      thd_ctx->get_transaction_context()->is_read_only()) {
+    ColumnScanPlan plan;
+    uint32_t row_length = std::max<uint32_t>(schema_.get_null_byte_length(), 1);
+    std::vector<char> rows(records.size() * row_length);
+    std::vector<VersionChainHead *> vchain_heads(records.size());
+    while ((ret = column_scan_get_batch(scan_cursor, plan, thd_ctx,
+                                        rows.data(), row_length,
+                                        records.data(), vchain_heads.data(),
+                                        records.size(), num)) ==
+           DB20XX_SUCCESS)
+      count += num;
+    return ret == DB20XX_END_OF_TABLE ? DB20XX_SUCCESS : ret;
+  }
+  while ((ret = table_scan_get_batch(scan_cursor, read_own, thd_ctx,
+                                     records.data(), records.size(), num)) ==
+         DB20XX_SUCCESS)
+    count += num;
+  return ret == DB20XX_END_OF_TABLE ? DB20XX_SUCCESS : ret;
+}
+
+void Table::get_table_stats(TableStats &stats) const {
+  stats.record_num_ =
+      std::max<int64_t>(record_num_.load(std::memory_order_relaxed), 0);
+  stats.deleted_version_num_ = std::max<int64_t>(
+      deleted_version_num_.load(std::memory_order_relaxed), 0);
+
+  uint64_t record_block_size =
+      sizeof(RecordBlock) +
+      records_in_block_ *
+          (sizeof(RecordHeader) + schema_.get_record_data_length());
+  stats.data_length_ =
+      next_record_block_id_.load() * record_block_size +
+      next_vchain_head_block_id_.load() * sizeof(VersionChainHeadBlock);
+
+  stats.index_length_ = 0;
+  for (auto index : indexes_)
+    stats.index_length_ += index->estimate_memory_size();
+}
+
+double Table::records_in_range(uint32_t idx, const Key *min_key,
+                               bool include_min, const Key *max_key,
+                               bool include_max) const {
+  MasstreeIndex *index = indexes_[idx];
+  double entry_num = index->get_entry_num();
+  if (entry_num == 0) return 0;
+
+  double key_num =
+      index->estimate_range_keys(min_key, include_min, max_key, include_max);
+  // stale keys do not lead to rows
+  double record_num =
+      std::max<int64_t>(record_num_.load(std::memory_order_relaxed), 0);
+  return key_num * std::min(1.0, record_num / entry_num);
+}
+
+void Table::get_rec_per_key(uint32_t idx, std::vector<double> &rec_per_key,
+                            ThreadContext *thd_ctx) {
+  int64_t record_num = record_num_.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> guard(index_stats_lock_);
+  if (index_stats_.size() < indexes_.size())
+    index_stats_.resize(indexes_.size());
+
+  // resample once a tenth of the table has changed
+  IndexStats &index_stats = index_stats_[idx];
+  int64_t sampled_record_num = index_stats.sampled_record_num_;
+  if (sampled_record_num < 0 ||
+      std::abs(record_num - sampled_record_num) > sampled_record_num / 10) {
+    sample_rec_per_key(idx, index_stats.rec_per_key_, thd_ctx);
+    index_stats.sampled_record_num_ = record_num;
+  }
+  rec_per_key = index_stats.rec_per_key_;
+}
+
+//===================Recovery===================================
+VersionChainHead *Table::recover_version(uint32_t block_id,
+                                         uint32_t idx_in_block,
+                                         const char *&data,
+                                         ThreadContext *thd_ctx) {
+  VersionChainHead *vchain_head =
+      get_recovered_vchain_head(block_id, idx_in_block);
+  Record *record = nullptr;
+  alloc_record(record, thd_ctx);
+  record->deserialize_payload(data, schema_, get_varlen_arena(thd_ctx));
+  // a recovered version is visible to every transaction
+  record->set_begin_timestamp(MIN_TIMESTAMP);
+  record->set_vchain_head(vchain_head);
+
+  Record *replaced = vchain_head->latest_record_;
+  vchain_head->set_latest_record(record);
+  if (replaced == nullptr || replaced->is_delete_marker()) add_record_num(1);
+  if (replaced != nullptr) {
+    if (!replaced->is_delete_marker())
+      remove_replaced_keys(replaced, record, thd_ctx);
+    replaced->release_out_of_line_data(schema_);
+    free_record(replaced);
+  }
+  return vchain_head;
+}
+
+void Table::recover_delete(uint32_t block_id, uint32_t idx_in_block,
+                           ThreadContext *thd_ctx) {
+  VersionChainHead *vchain_head =
+      get_recovered_vchain_head(block_id, idx_in_block);
+  // keep a committed delete marker, so that a logged insert which reused
+  // the chain at runtime can be replayed on it. The keys are removed below,
+  // seal the chain like gc does.
+  Record *record = nullptr;
+  alloc_record(record, thd_ctx);
+  record->set_delete_marker();
+  record->set_begin_timestamp(MIN_TIMESTAMP);
+  record->set_end_timestamp(MIN_TIMESTAMP);
+  record->set_transaction_id(DEAD_TRANSACTION_ID);
+  record->set_vchain_head(vchain_head);
+
+  Record *replaced = vchain_head->latest_record_;
+  vchain_head->set_latest_record(record);
+  if (replaced != nullptr) {
+    if (!replaced->is_delete_marker()) {
+      remove_replaced_keys(replaced, nullptr, thd_ctx);
+      add_record_num(-1);
+    }
+    replaced->release_out_of_line_data(schema_);
+    free_record(replaced);
+  }
+}
+
+/**
+@brief
+  remove keys of [replaced] that [record] does not carry, [record] is
+  nullptr if the chain is deleted.
+*/
+void Table::remove_replaced_keys(Record *replaced, Record *record,
+                                 ThreadContext *thd_ctx) {
+  for (uint32_t i = 0; i < indexes_.size(); i++) {
+    Key key;
+    indexes_[i]->build_key(get_full_payload(replaced, thd_ctx), key, thd_ctx);
+    if (record == nullptr || !version_has_key(i, record, key, thd_ctx))
+      indexes_[i]->remove(key, replaced->get_vchain_head(), *thd_ctx->ti_);
+  }
+}
+
+void Table::reserve_recovered_vchain_head_blocks(uint32_t block_num) {
+  while (next_vchain_head_block_id_.load() < block_num)
+    alloc_vchain_head_block();
+}
+
+void Table::build_recovered_indexes(ThreadContext *thd_ctx) {
+  // the indexes start empty and recovered keys are unique, every entry is
+  // deferred and put in key order
+  BulkInsertBuffer buffer(std::vector<bool>(indexes_.size(), true));
+  TableAllocator &allocator = thd_ctx->get_table_allocator(this);
+  allocator.bulk_insert_ = &buffer;
+  uint32_t block_num = next_vchain_head_block_id_.load();
+  for (uint32_t block_id = 0; block_id < block_num; block_id++) {
+    VersionChainHeadBlock *block = get_vchain_head_block(block_id);
+    uint32_t entry_num = std::min(block->valid_entry_num_.load(),
+                                  VersionChainHeadBlock::ENTRY_CAPACITY);
+    for (uint32_t idx = 0; idx < entry_num; idx++) {
+      VersionChainHead *vchain_head = &block->entries_[idx];
+      Record *latest_record = vchain_head->latest_record_;
+      if (latest_record != nullptr && !latest_record->is_delete_marker())
+        insert_record_to_index(vchain_head, thd_ctx);
+    }
+  }
+  flush_bulk_insert(buffer, thd_ctx);
+  allocator.bulk_insert_ = nullptr;
+}
+
+//=====================Bulk insert====================================
+void Table::start_bulk_insert(uint64_t rows, ThreadContext *thd_ctx) {
+  TableAllocator &allocator = thd_ctx->get_table_allocator(this);
+  if (allocator.bulk_insert_ != nullptr) return;
+
+  std::vector<bool> deferred(indexes_.size());
+  for (uint32_t i = 0; i < indexes_.size(); i++)
+    deferred[i] = !indexes_[i]->is_unique() &&
+                  !indexes_[i]->is_nullable_unique();
+  allocator.bulk_insert_ = new BulkInsertBuffer(deferred);
+
+  // blocks are taken from the back of the reserved ones
+  uint64_t record_block_num = std::min<uint64_t>(
+      rows / records_in_block_, BULK_INSERT_MAX_RESERVED_BLOCKS);
+  uint64_t vchain_head_block_num =
+      std::min<uint64_t>(rows / VersionChainHeadBlock::ENTRY_CAPACITY,
+                         BULK_INSERT_MAX_RESERVED_BLOCKS);
+  for (uint64_t i = 0; i < record_block_num; i++)
+    allocator.reserved_record_blocks_.push_back(acquire_record_block());
+  for (uint64_t i = 0; i < vchain_head_block_num; i++)
+    allocator.reserved_vchain_head_blocks_.push_back(
+        acquire_vchain_head_block());
+  std::reverse(allocator.reserved_record_blocks_.begin(),
+               allocator.reserved_record_blocks_.end());
+  std::reverse(allocator.reserved_vchain_head_blocks_.begin(),
+               allocator.reserved_vchain_head_blocks_.end());
+}
+
+void Table::end_bulk_insert(ThreadContext *thd_ctx) {
+  TableAllocator &allocator = thd_ctx->get_table_allocator(this);
+  if (allocator.bulk_insert_ == nullptr) return;
+
+  flush_bulk_insert(*allocator.bulk_insert_, thd_ctx);
+  delete allocator.bulk_insert_;
+  allocator.bulk_insert_ = nullptr;
+  release_reserved_blocks(allocator);
+}
+
+void Table::flush_bulk_insert(BulkInsertBuffer &buffer,
+                              ThreadContext *thd_ctx) {
+  for (uint32_t i = 0; i < indexes_.size(); i++) {
+    std::vector<BulkInsertBuffer::Entry> &entries = buffer.entries_[i];
+    const char *keys = buffer.keys_[i].data();
+    // the order of entry keys, a non-unique key is followed by the row id
+    std::sort(entries.begin(), entries.end(),
+              [keys](const BulkInsertBuffer::Entry &a,
+                     const BulkInsertBuffer::Entry &b) {
+                if (a.key_prefix_ != b.key_prefix_)
+                  return a.key_prefix_ < b.key_prefix_;
+                uint32_t length = std::min(a.key_length_, b.key_length_);
+                if (length > sizeof(a.key_prefix_)) {
+                  int cmp = memcmp(keys + a.key_offset_ + sizeof(a.key_prefix_),
+                                   keys + b.key_offset_ + sizeof(b.key_prefix_),
+                                   length - sizeof(a.key_prefix_));
+                  if (cmp != 0) return cmp < 0;
+                }
+                if (a.key_length_ != b.key_length_)
+                  return a.key_length_ < b.key_length_;
+                return a.vchain_head_ < b.vchain_head_;
+              });
+    for (const BulkInsertBuffer::Entry &entry : entries) {
+      indexes_[i]->put(Key(keys + entry.key_offset_, entry.key_length_),
+                       entry.vchain_head_, *thd_ctx->ti_);
+    }
+    entries.clear();
+    buffer.keys_[i].clear();
+  }
+  buffer.entry_num_ = 0;
 }
 
 //========================private member
@@ -439,28 +1173,313 @@ int Table::index_prefix_search_next(uint32_t idx, const Key &key,
   location to the record
 */
 int Table::alloc_record(Record *&record, ThreadContext *thd_ctx) {
-  uint32_t writer_idx = thd_ctx->get_thread_id() % PARALLEL_WRITER_NUM;
-  RecordBlock *record_block = nullptr;
-  int status = DB20XX_SUCCESS;
+  TableAllocator &allocator = thd_ctx->get_table_allocator(this);
+
+  // Step0: Reuse a slot reclaimed by garbage collector
+  if (allocator.free_records_.empty() &&
+      free_record_num_.load(std::memory_order_relaxed) > 0)
+    take_free_records(allocator);
+  if (!allocator.free_records_.empty()) {
+    record = allocator.free_records_.back();
+    allocator.free_records_.pop_back();
+    record->init();
+    return DB20XX_SUCCESS;
+  }
+
+  // Step1: Alloc record from the block owned by the thread
+  if (allocator.record_block_ == nullptr || allocator.record_block_->is_full())
+    allocator.record_block_ = next_record_block(allocator);
+  return allocator.record_block_->alloc_record(record);
+}
 
-  // Step1: Alloc record
-  do {
-    record_block = record_allocators_[writer_idx];
-    status = record_block->alloc_record(record);
-  } while (status != DB20XX_SUCCESS);
+VersionChainHead *Table::alloc_vchain_head(ThreadContext *thd_ctx) {
+  TableAllocator &allocator = thd_ctx->get_table_allocator(this);
+  if (allocator.vchain_head_block_ == nullptr ||
+      allocator.vchain_head_block_->is_full())
+    allocator.vchain_head_block_ = next_vchain_head_block(allocator);
 
-  // 仅有一个线程获得了block的最后一条记录,
-  // 由该线程负责更新这个位置的record_writer,
-  // 这种方法确保了只有一个线程会负责替换writer,
-  // 避免了并发修改
-  if (record_block->is_last_record(record)) {
-    record_allocators_[writer_idx] = alloc_record_block();
+  VersionChainHead *vchain_head = nullptr;
+  int status = allocator.vchain_head_block_->alloc_vchain_head(vchain_head);
+  assert(status == DB20XX_SUCCESS);
+  (void)status;
+  return vchain_head;
+}
+
+bool Table::reclaim_record(Record *record, ThreadContext *thd_ctx) {
+  // delta versions still read their unchanged columns from the record. If
+  // the latest version is one of them, replace it by a full copy, the
+  // record is freed after the delta versions are gone.
+  if (record->get_delta_num() > 0) {
+    Record *newer_version = record->get_newer_version();
+    if (newer_version != nullptr && newer_version->is_delta() &&
+        newer_version->get_older_version() == record &&
+        newer_version->get_vchain_head()->latest_record_ == newer_version)
+      consolidate_delta_version(newer_version, thd_ctx);
+    return false;
   }
 
-  return status;
+  if (!record->is_delete_marker() && !remove_dead_keys(record, thd_ctx))
+    return false;
+
+  // a dead latest version stays as the tombstone of its chain
+  if (record->get_vchain_head()->latest_record_ == record) return true;
+
+  // No running transaction can reach the record through the version chain,
+  // cut the links so that walks of the chain stop at the newer version.
+  Record *newer_version = record->get_newer_version();
+  if (newer_version != nullptr &&
+      newer_version->get_older_version() == record)
+    newer_version->set_older_version(nullptr);
+
+  Record *older_version = record->get_older_version();
+  if (older_version != nullptr &&
+      older_version->get_newer_version() == record)
+    older_version->set_newer_version(nullptr);
+
+  if (record->is_delta()) {
+    free_delta_version(record);
+  } else {
+    record->release_out_of_line_data(schema_);
+    free_record(record);
+  }
+  add_deleted_version_num(-1);
+  return true;
+}
+
+bool Table::remove_dead_keys(Record *record, ThreadContext *thd_ctx) {
+  VersionChainHead *vchain_head = record->get_vchain_head();
+  Record *latest_record = vchain_head->latest_record_;
+  latest_record->lock_header();
+  // an owner may put keys of its new version meanwhile
+  uint64_t owner = latest_record->get_transaction_id();
+  if (vchain_head->latest_record_ != latest_record ||
+      (owner != INVALID_TRANSACTION_ID && owner != DEAD_TRANSACTION_ID)) {
+    latest_record->unlock_header();
+    return false;
+  }
+
+  for (uint32_t i = 0; i < indexes_.size(); i++) {
+    Key key;
+    indexes_[i]->build_key(get_full_payload(record, thd_ctx), key, thd_ctx);
+    bool carried = false;
+    for (Record *version = latest_record; version != nullptr;
+         version = version->get_older_version()) {
+      if (version == record || version->is_delete_marker() ||
+          version->get_end_timestamp() == MIN_TIMESTAMP)
+        continue;
+      if (version_has_key(i, version, key, thd_ctx)) {
+        carried = true;
+        break;
+      }
+    }
+    // the key may have been taken over by another chain
+    if (!carried) indexes_[i]->remove(key, vchain_head, *thd_ctx->ti_);
+  }
+
+  // the chain is dead, keep inserters from reusing it, they could not find
+  // it through the removed keys anyway
+  if (latest_record->get_end_timestamp() == MIN_TIMESTAMP)
+    latest_record->set_transaction_id(DEAD_TRANSACTION_ID);
+  latest_record->unlock_header();
+  return true;
+}
+
+void Table::free_record(Record *record) {
+  free_records_latch_.lock();
+  free_records_.push_back(record);
+  free_record_num_.fetch_add(1, std::memory_order_relaxed);
+  free_records_latch_.unlock();
+}
+
+void Table::take_free_records(TableAllocator &allocator) {
+  free_records_latch_.lock();
+  uint32_t num = std::min<size_t>(free_records_.size(), FREE_RECORD_BATCH);
+  allocator.free_records_.insert(allocator.free_records_.end(),
+                                 free_records_.end() - num,
+                                 free_records_.end());
+  free_records_.resize(free_records_.size() - num);
+  free_record_num_.fetch_sub(num, std::memory_order_relaxed);
+  free_records_latch_.unlock();
+}
+
+void Table::release_allocator(TableAllocator &allocator) {
+  // the transaction of an exiting thread is aborted, its deferred entries
+  // are dropped with it
+  delete allocator.bulk_insert_;
+  allocator.bulk_insert_ = nullptr;
+  release_reserved_blocks(allocator);
+
+  block_pool_latch_.lock();
+  if (allocator.record_block_ != nullptr &&
+      !allocator.record_block_->is_full()) {
+    record_block_pool_.push_back(allocator.record_block_);
+    pooled_block_num_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (allocator.vchain_head_block_ != nullptr &&
+      !allocator.vchain_head_block_->is_full()) {
+    vchain_head_block_pool_.push_back(allocator.vchain_head_block_);
+    pooled_block_num_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (allocator.varlen_arena_ != nullptr)
+    varlen_arena_pool_.push_back(allocator.varlen_arena_);
+  block_pool_latch_.unlock();
+  allocator.record_block_ = nullptr;
+  allocator.vchain_head_block_ = nullptr;
+  allocator.varlen_arena_ = nullptr;
+
+  if (allocator.free_records_.empty()) return;
+  free_records_latch_.lock();
+  free_records_.insert(free_records_.end(), allocator.free_records_.begin(),
+                       allocator.free_records_.end());
+  free_record_num_.fetch_add(allocator.free_records_.size(),
+                             std::memory_order_relaxed);
+  free_records_latch_.unlock();
+  allocator.free_records_.clear();
+}
+
+RecordBlock *Table::acquire_record_block() {
+  // new blocks only take an atomic block id, the latch is touched only
+  // when exited threads have left blocks behind
+  if (pooled_block_num_.load(std::memory_order_relaxed) > 0) {
+    RecordBlock *block = nullptr;
+    block_pool_latch_.lock();
+    if (!record_block_pool_.empty()) {
+      block = record_block_pool_.back();
+      record_block_pool_.pop_back();
+      pooled_block_num_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    block_pool_latch_.unlock();
+    if (block != nullptr) return block;
+  }
+  return alloc_record_block();
+}
+
+RecordBlock *Table::next_record_block(TableAllocator &allocator) {
+  if (allocator.reserved_record_blocks_.empty()) return acquire_record_block();
+  RecordBlock *block = allocator.reserved_record_blocks_.back();
+  allocator.reserved_record_blocks_.pop_back();
+  return block;
+}
+
+VersionChainHeadBlock *Table::next_vchain_head_block(
+    TableAllocator &allocator) {
+  if (allocator.reserved_vchain_head_blocks_.empty())
+    return acquire_vchain_head_block();
+  VersionChainHeadBlock *block = allocator.reserved_vchain_head_blocks_.back();
+  allocator.reserved_vchain_head_blocks_.pop_back();
+  return block;
+}
+
+void Table::release_reserved_blocks(TableAllocator &allocator) {
+  if (allocator.reserved_record_blocks_.empty() &&
+      allocator.reserved_vchain_head_blocks_.empty())
+    return;
+  block_pool_latch_.lock();
+  record_block_pool_.insert(record_block_pool_.end(),
+                            allocator.reserved_record_blocks_.begin(),
+                            allocator.reserved_record_blocks_.end());
+  vchain_head_block_pool_.insert(vchain_head_block_pool_.end(),
+                                 allocator.reserved_vchain_head_blocks_.begin(),
+                                 allocator.reserved_vchain_head_blocks_.end());
+  pooled_block_num_.fetch_add(allocator.reserved_record_blocks_.size() +
+                                  allocator.reserved_vchain_head_blocks_.size(),
+                              std::memory_order_relaxed);
+  block_pool_latch_.unlock();
+  allocator.reserved_record_blocks_.clear();
+  allocator.reserved_vchain_head_blocks_.clear();
+}
+
+VersionChainHeadBlock *Table::acquire_vchain_head_block() {
+  if (pooled_block_num_.load(std::memory_order_relaxed) > 0) {
+    VersionChainHeadBlock *block = nullptr;
+    block_pool_latch_.lock();
+    if (!vchain_head_block_pool_.empty()) {
+      block = vchain_head_block_pool_.back();
+      vchain_head_block_pool_.pop_back();
+      pooled_block_num_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    block_pool_latch_.unlock();
+    if (block != nullptr) return block;
+  }
+  return alloc_vchain_head_block();
+}
+
+VarlenArena *Table::acquire_varlen_arena() {
+  VarlenArena *arena = nullptr;
+  block_pool_latch_.lock();
+  if (!varlen_arena_pool_.empty()) {
+    arena = varlen_arena_pool_.back();
+    varlen_arena_pool_.pop_back();
+  } else {
+    varlen_arenas_.emplace_back(new VarlenArena());
+    arena = varlen_arenas_.back().get();
+  }
+  block_pool_latch_.unlock();
+  return arena;
+}
+
+//=====================Delta version==================================
+Record *Table::create_delta_version(Record *base, const char *mysql_record,
+                                    ThreadContext *thd_ctx) {
+  if (base->is_delta()) return nullptr;
+
+  std::vector<uint32_t> changed_fields;
+  uint32_t delta_length =
+      base->diff_from_mysql(mysql_record, schema_, changed_fields);
+  if (delta_length * 100 >
+      schema_.get_record_data_length() * DELTA_VERSION_MAX_PERCENT)
+    return nullptr;
+
+  VarlenArena &arena = get_varlen_arena(thd_ctx);
+  Record *record = reinterpret_cast<Record *>(
+      arena.alloc(sizeof(RecordHeader) + delta_length, alignof(Record)));
+  new (record->get_header()) RecordHeader();
+  record->init();
+  record->load_delta_from_mysql(mysql_record, schema_, base, changed_fields,
+                                arena);
+  return record;
+}
+
+void Table::free_delta_version(Record *record) {
+  record->release_out_of_line_data(schema_);
+  record->get_older_version()->get_header()->delta_num_.fetch_sub(
+      1, std::memory_order_relaxed);
+  VarlenArena::release_data(reinterpret_cast<char *>(record));
+}
+
+void Table::consolidate_delta_version(Record *record,
+                                      ThreadContext *thd_ctx) {
+  Record *full_record = nullptr;
+  if (alloc_record(full_record, thd_ctx) != DB20XX_SUCCESS) return;
+
+  VersionChainHead *vchain_head = record->get_vchain_head();
+  record->lock_header();
+  // an owner is going to replace the delta version anyway
+  uint64_t owner = record->get_transaction_id();
+  if (vchain_head->latest_record_ != record ||
+      (owner != INVALID_TRANSACTION_ID && owner != DEAD_TRANSACTION_ID)) {
+    record->unlock_header();
+    free_record(full_record);
+    return;
+  }
+
+  char *payload = full_record->get_payload();
+  record->get_full_payload(schema_, payload);
+  schema_.get_copy_plan().share_out_of_line_data(payload);
+  full_record->set_transaction_id(owner);
+  full_record->set_last_read_timestamp(record->get_last_read_timestamp());
+  full_record->set_begin_timestamp(record->get_begin_timestamp());
+  full_record->set_end_timestamp(record->get_end_timestamp());
+  full_record->set_vchain_head(vchain_head);
+  // versions older than the delta version are not visible to any running
+  // transaction, the copy ends the chain
+  vchain_head->set_latest_record(full_record);
+
+  record->set_transaction_id(REPLACED_TRANSACTION_ID);
+  record->unlock_header();
+  GarbageCollector::retire_record(this, record);
 }
 
-// FIXME: use per-thread allocator
 RecordBlock *Table::alloc_record_block() {
   uint32_t complete_record_length =
       sizeof(RecordHeader) + schema_.get_record_data_length();
@@ -478,9 +1497,10 @@ RecordBlock *Table::alloc_record_block() {
   return block;
 }
 
-// FIXME: use per-thread allocator
 VersionChainHeadBlock *Table::alloc_vchain_head_block() {
-  VersionChainHeadBlock *block = new VersionChainHeadBlock();
+  void *block_mem = aligned_alloc(VersionChainHeadBlock::BLOCK_SIZE,
+                                  sizeof(VersionChainHeadBlock));
+  VersionChainHeadBlock *block = new (block_mem) VersionChainHeadBlock();
   block->block_id_ =
       next_vchain_head_block_id_.fetch_add(1, std::memory_order_relaxed);
 
@@ -493,48 +1513,178 @@ VersionChainHeadBlock *Table::alloc_vchain_head_block() {
 */
 void Table::add_record_block(RecordBlock *block) {
   // LOG_TRACE("RecordBlock block_id_: %u", block->block_id_);
-  record_blocks_.Upsert(block->block_id_, block);
+  record_blocks_.set(block->block_id_, block);
 }
 
 void Table::add_vchain_head_block(VersionChainHeadBlock *block) {
   // LOG_TRACE("VchainHeadBlock block_id_: %u", block->block_id_);
-  vchain_head_blocks_.Upsert(block->block_id_, block);
+  // a scan finding the head block finds its column block
+  if (is_columnar())
+    column_blocks_.set(block->block_id_, ColumnBlock::create(column_layout_));
+  vchain_head_blocks_.set(block->block_id_, block);
 }
 
 /**
 @brief given a block id, get the block address of the table store
 */
 RecordBlock *Table::get_record_block(uint32_t block_id) {
-  RecordBlock *block = nullptr;
-  bool ret = record_blocks_.Find(block_id, block);
-  assert(ret == true);
-  assert(block->block_id_ == block_id);
-  (void)ret;
+  RecordBlock *block = record_blocks_.get(block_id);
+  assert(block == nullptr || block->block_id_ == block_id);
   return block;
 }
 
 VersionChainHeadBlock *Table::get_vchain_head_block(uint32_t block_id) {
-  VersionChainHeadBlock *block = nullptr;
-  bool ret = vchain_head_blocks_.Find(block_id, block);
-  assert(ret == true);
-  (void)ret;
-  return block;
+  return vchain_head_blocks_.get(block_id);
 }
 
 /**
 @brief
-  initialize block writers, each thread delegate its write operation
-  to a block writer with index = thread_id % PARALLEL_WRITER_NUM.
+  get the version chain head at the given location, allocate blocks up to
+  block_id if they do not exist yet. Only used in recovery.
 */
-void Table::init_record_allocators() {
-  for (size_t i = 0; i < PARALLEL_WRITER_NUM; i++) {
-    record_allocators_[i] = alloc_record_block();
+VersionChainHead *Table::get_recovered_vchain_head(uint32_t block_id,
+                                                   uint32_t idx_in_block) {
+  reserve_recovered_vchain_head_blocks(block_id + 1);
+
+  VersionChainHeadBlock *block = get_vchain_head_block(block_id);
+  if (block->valid_entry_num_.load() <= idx_in_block)
+    block->valid_entry_num_.store(idx_in_block + 1);
+  return &block->entries_[idx_in_block];
+}
+
+/**
+@brief
+  whether the entry of index [idx] leads to a row carrying its key, judged
+  by the latest version. An uncommitted insert counts as a row, the
+  payload of other versions does not change once committed. Caller must be
+  inside a transaction, so the versions read are not reclaimed.
+*/
+bool Table::sample_entry_is_live(uint32_t idx, const Key &entry_key,
+                                 VersionChainHead *vchain_head,
+                                 ThreadContext *thd_ctx) {
+  Record *latest_record = vchain_head->latest_record_;
+  if (latest_record == nullptr || latest_record->is_delete_marker() ||
+      latest_record->get_end_timestamp() == MIN_TIMESTAMP)
+    return false;
+  if (latest_record->get_begin_timestamp() == MAX_TIMESTAMP) return true;
+  return version_has_key(idx, latest_record,
+                         indexes_[idx]->get_user_key(entry_key), thd_ctx);
+}
+
+/**
+@brief
+  key of index [idx] of the first live row at or after the position-th
+  slot of the table store, the start of a sample run
+@return
+  false if no live row is found in the rest of the block
+*/
+bool Table::get_sample_start_key(uint32_t idx, uint64_t position, Key &key,
+                                 ThreadContext *thd_ctx) {
+  const uint32_t capacity = VersionChainHeadBlock::ENTRY_CAPACITY;
+  VersionChainHeadBlock *block = get_vchain_head_block(position / capacity);
+  if (block == nullptr) return false;
+  uint32_t valid_entry_num = block->valid_entry_num_.load();
+  for (uint32_t i = position % capacity; i < valid_entry_num; i++) {
+    Record *latest_record = block->entries_[i].latest_record_;
+    if (latest_record == nullptr || latest_record->is_delete_marker() ||
+        latest_record->get_end_timestamp() == MIN_TIMESTAMP ||
+        latest_record->get_begin_timestamp() == MAX_TIMESTAMP)
+      continue;
+    indexes_[idx]->build_key(get_full_payload(latest_record, thd_ctx), key,
+                             thd_ctx);
+    return true;
   }
+  return false;
 }
 
-void Table::init_vchain_head_allocators() {
-  for (size_t i = 0; i < PARALLEL_WRITER_NUM; i++) {
-    vchain_head_allocators_[i] = alloc_vchain_head_block();
+void Table::sample_rec_per_key(uint32_t idx, std::vector<double> &rec_per_key,
+                               ThreadContext *thd_ctx) {
+  const KeyInfo &keyinfo = indexes_[idx]->get_key_info();
+  size_t part_num = keyinfo.key_parts.size();
+  rec_per_key.assign(part_num, 0);
+  if (part_num == 0) return;
+  // a key of a unique index maps to one version chain
+  bool unique = indexes_[idx]->is_unique();
+  if (unique) rec_per_key[part_num - 1] = 1;
+
+  // prefix lengths are known up to the first variable length part
+  const KeyEncodePlan &key_plan = indexes_[idx]->get_key_plan();
+  std::vector<uint32_t> prefix_lengths;
+  uint32_t prefix_length = 0;
+  for (size_t i = 0; i < (unique ? part_num - 1 : part_num); i++) {
+    uint32_t part_length = key_plan.get_fixed_part_length(i);
+    if (part_length == 0) break;
+    prefix_length += part_length;
+    prefix_lengths.push_back(prefix_length);
+  }
+  if (prefix_lengths.empty()) return;
+
+  // a small index is read whole from its first key. Otherwise runs of
+  // adjacent keys are read from the keys of rows at random slots of the
+  // table store, which spreads them over the tree in proportion to rows
+  bool whole_index =
+      indexes_[idx]->get_entry_num() <= STATS_SAMPLE_KEY_NUM;
+  uint32_t run_num = whole_index ? 1 : STATS_SAMPLE_RUN_NUM;
+  uint32_t run_key_num = STATS_SAMPLE_KEY_NUM / run_num;
+  uint64_t slot_num = (uint64_t)get_vchain_head_block_num() *
+                      VersionChainHeadBlock::ENTRY_CAPACITY;
+  if (slot_num == 0) return;
+  std::minstd_rand random(std::random_device{}());
+  std::uniform_int_distribution<uint64_t> position;
+
+  // a prefix changes between adjacent live keys with the probability of
+  // distinct prefixes / keys, stale entries are skipped
+  std::vector<uint64_t> prefix_change_num(prefix_lengths.size(), 0);
+  uint64_t sampled_key_num = 0;
+  uint64_t pair_num = 0;
+  std::string last_key;
+  VersionChainHead *vchain_head = nullptr;
+  scan_stack_type scan_stack;
+  for (uint32_t run = 0; run < run_num; run++) {
+    Key start_key("", 0);
+    if (!whole_index &&
+        !get_sample_start_key(idx, position(random) % slot_num, start_key,
+                              thd_ctx))
+      continue;
+    scan_stack.reset();
+    bool found = indexes_[idx]->scan_range_first(start_key, vchain_head, true,
+                                                 scan_stack, *thd_ctx->ti_);
+    uint32_t live_key_num = 0;
+    // bound the stale entries read as well
+    for (uint32_t read_num = 0;
+         found && live_key_num < run_key_num && read_num < 4 * run_key_num;
+         read_num++) {
+      Key entry_key = scan_stack.get_current_key().full_string();
+      if (sample_entry_is_live(idx, entry_key, vchain_head, thd_ctx)) {
+        Key key = indexes_[idx]->get_user_key(entry_key);
+        for (size_t i = 0; live_key_num > 0 && i < prefix_lengths.size();
+             i++) {
+          uint32_t length = prefix_lengths[i];
+          if (key.len < (int)length || last_key.size() < length ||
+              memcmp(last_key.data(), key.s, length) != 0)
+            prefix_change_num[i]++;
+        }
+        if (live_key_num > 0) pair_num++;
+        last_key.assign(key.s, key.len);
+        live_key_num++;
+      }
+      found = indexes_[idx]->scan_range_next(vchain_head, scan_stack,
+                                             *thd_ctx->ti_);
+    }
+    sampled_key_num += live_key_num;
+  }
+  if (sampled_key_num == 0) return;
+
+  double record_num =
+      std::max<int64_t>(record_num_.load(std::memory_order_relaxed), 1);
+  for (size_t i = 0; i < prefix_lengths.size(); i++) {
+    if (whole_index)
+      rec_per_key[i] = (double)sampled_key_num / (prefix_change_num[i] + 1);
+    else if (prefix_change_num[i] > 0)
+      rec_per_key[i] = (double)pair_num / prefix_change_num[i];
+    else
+      // every sampled row shares the prefix
+      rec_per_key[i] = std::max<double>(pair_num, record_num);
   }
 }
 
@@ -0,0 +1,47 @@
+#include "thread_context.h"
+#include "table.h"
+
+namespace db20xx {
+
+std::mutex ThreadContext::threadinfo_pool_lock_;
+std::vector<threadinfo *> ThreadContext::threadinfo_pool_;
+
+ThreadContext::ThreadContext(uint64_t thread_id) : thread_id_(thread_id) {
+  ti_ = acquire_threadinfo(thread_id);
+  GlocalEpochManager::register_local_epoch(txn_ctx_.get_local_epoch());
+  GarbageCollector::register_transaction(&txn_ctx_);
+}
+
+ThreadContext::~ThreadContext() {
+  for (auto &entry : table_allocators_)
+    entry.first->release_allocator(entry.second);
+  GarbageCollector::unregister_transaction(&txn_ctx_);
+  GlocalEpochManager::unregister_local_epoch(txn_ctx_.get_local_epoch());
+  release_threadinfo(ti_);
+}
+
+threadinfo *ThreadContext::acquire_threadinfo(uint64_t thread_id) {
+  std::lock_guard<std::mutex> guard(threadinfo_pool_lock_);
+  if (threadinfo_pool_.empty())
+    return threadinfo::make(threadinfo::TI_PROCESS, thread_id);
+  threadinfo *ti = threadinfo_pool_.back();
+  threadinfo_pool_.pop_back();
+  return ti;
+}
+
+void ThreadContext::release_threadinfo(threadinfo *ti) {
+  // leave the epoch and free what can be freed, the rest stays in the
+  // limbo list of ti until it is reused
+  ti->rcu_stop();
+  std::lock_guard<std::mutex> guard(threadinfo_pool_lock_);
+  threadinfo_pool_.push_back(ti);
+}
+
+void ThreadContext::advance_index_epoch() {
+  std::lock_guard<std::mutex> guard(threadinfo_pool_lock_);
+  // masstree epochs stay odd, gc_epoch_ == 0 means not in any epoch
+  globalepoch += 2;
+  active_epoch = threadinfo::min_active_epoch();
+}
+
+}  // namespace db20xx
@@ -1,9 +1,11 @@
 #include "transaction.h"
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <exception>
 #include <thread>
 #include "data_types.h"
+#include "log_manager.h"
 #include "message_logger.h"
 #include "record.h"
 #include "return_status.h"
@@ -17,36 +19,61 @@ namespace db20xx {
 bool TransactionContext::on_going() { return started_; }
 
 void TransactionContext::begin_transaction(uint64_t thread_id) {
-  transaction_id_ = GlocalEpochManager::enter_epoch(thread_id);
+  transaction_id_ = GlocalEpochManager::enter_epoch(&local_epoch_);
   epoch_id_ = transaction_id_ >> 32;
   thread_id_ = thread_id;
   started_ = true;
 }
 
+bool TransactionContext::begin_read_only_transaction(uint64_t thread_id) {
+  uint64_t epoch_id = GlocalEpochManager::enter_snapshot_epoch(&local_epoch_);
+  if (epoch_id == INVALID_EPOCH_ID) return false;
+  epoch_id_ = epoch_id;
+  // sees exactly the transactions of epochs before epoch_id_
+  transaction_id_ = (epoch_id_ << 32) - 1;
+  if (transaction_id_ < last_commit_id_) {
+    GlocalEpochManager::exit_epoch(&local_epoch_);
+    transaction_id_ = INVALID_TRANSACTION_ID;
+    epoch_id_ = 0;
+    return false;
+  }
+  thread_id_ = thread_id;
+  read_only_ = true;
+  started_ = true;
+  return true;
+}
+
+void TransactionContext::begin_snapshot_read(uint64_t snapshot_transaction_id,
+                                             uint64_t thread_id,
+                                             bool read_only) {
+  transaction_id_ = snapshot_transaction_id;
+  epoch_id_ = transaction_id_ >> 32;
+  thread_id_ = thread_id;
+  read_only_ = read_only;
+  started_ = true;
+}
+
+void TransactionContext::end_snapshot_read() {
+  assert(txn_modify_set_.empty());
+  transaction_id_ = INVALID_TRANSACTION_ID;
+  epoch_id_ = 0;
+  thread_id_ = 0;
+  read_only_ = false;
+  started_ = false;
+  should_abort_ = false;
+}
+
 void TransactionContext::mvto_insert(Record *record, VersionChainHead *vchain_head, Table *table,
                                      ThreadContext *thd_ctx) {
   // Alloc version chain head & insert it to index
-  uint32_t writer_idx = thd_ctx->get_thread_id() % Table::PARALLEL_WRITER_NUM;
-  VersionChainHeadBlock *vchain_head_block = nullptr;
-  int status = DB20XX_SUCCESS;
-
   if (vchain_head == nullptr) {
-    do {
-      vchain_head_block = table->vchain_head_allocators_[writer_idx];
-      status = vchain_head_block->alloc_vchain_head(vchain_head);
-    } while (status != DB20XX_SUCCESS);
-
-    if (vchain_head_block->is_last_vchain_head(vchain_head)) {
-      table->vchain_head_allocators_[writer_idx] =
-          table->alloc_vchain_head_block();
-    }
-
+    vchain_head = table->alloc_vchain_head(thd_ctx);
     vchain_head->set_latest_record(record);
     record->set_vchain_head(vchain_head);
     record->set_transaction_id(transaction_id_);
     record->set_last_read_timestamp(transaction_id_);
     // add_to_insert_set(record);
-    add_to_modify_set(record);
+    add_to_modify_set(record, table);
 
     // We need to insert uncommited record to index,
     // so that subsequent queries in the same transaction
@@ -58,6 +85,9 @@ void TransactionContext::mvto_insert(Record *record, VersionChainHead *vchain_he
     record->set_older_version(deleted_version);
     record->set_transaction_id(transaction_id_);
     record->set_vchain_head(vchain_head);
+
+    // secondary keys of the new version may differ from the deleted one
+    table->insert_version_to_index(record, thd_ctx);
   }
 }
 
@@ -75,6 +105,8 @@ int TransactionContext::mvto_delete(Record *record, Table *table,
       if (status != DB20XX_SUCCESS) return status;
 
       new_record->set_end_timestamp(MIN_TIMESTAMP);
+      // the delete marker carries no payload
+      new_record->set_delete_marker();
 
       record->set_newer_version(new_record);
       new_record->set_older_version(record);
@@ -103,15 +135,54 @@ int TransactionContext::mvto_update(Record *old_record, char *new_mysql_record,
   // 2  ownership is got by last update operation in the same transaction
   if (old_record->get_transaction_id() == transaction_id_) {
     // current transaction have updated the record
-    if (old_record->get_begin_timestamp() == MAX_TIMESTAMP) {
-      old_record->load_data_from_mysql(new_mysql_record, table->schema_);
+    const Schema &schema = table->schema_;
+    if (old_record->get_begin_timestamp() == MAX_TIMESTAMP &&
+        old_record->is_delta()) {
+      // a delta version can not grow in place, replace it by a new delta
+      // version of the same base, or a full version
+      Record *base = old_record->get_older_version();
+      Record *new_record =
+          table->create_delta_version(base, new_mysql_record, thd_ctx);
+      if (new_record == nullptr) {
+        int status = table->alloc_record(new_record, thd_ctx);
+        if (status != DB20XX_SUCCESS) return status;
+        new_record->load_data_from_mysql(
+            new_mysql_record, schema, table->get_varlen_arena(thd_ctx),
+            table->get_full_payload(old_record, thd_ctx));
+      }
+
+      base->set_newer_version(new_record);
+      new_record->set_older_version(base);
+      new_record->set_vchain_head(old_record->get_vchain_head());
+      new_record->set_transaction_id(transaction_id_);
+      // nobody except us has ever seen the replaced version
+      old_record->set_end_timestamp(MIN_TIMESTAMP);
+      retire_record(table, old_record);
+      return DB20XX_SUCCESS;
+    } else if (old_record->get_begin_timestamp() == MAX_TIMESTAMP) {
+      // the uncommitted version is private to us. The new row may point to
+      // its BLOB values, drop the old values after loading the new ones.
+      char *old_payload =
+          thd_ctx->get_payload_container(schema.get_record_data_length());
+      memcpy(old_payload, old_record->get_payload(),
+             schema.get_record_data_length());
+      old_record->load_data_from_mysql(new_mysql_record, schema,
+                                       table->get_varlen_arena(thd_ctx),
+                                       old_payload);
+      schema.get_copy_plan().release_out_of_line_data(old_payload);
       return DB20XX_SUCCESS;
     } else {
-      Record *new_record = nullptr;
-      int status = table->alloc_record(new_record, thd_ctx);
-      if (status != DB20XX_SUCCESS) return status;
-
-      new_record->load_data_from_mysql(new_mysql_record, table->schema_);
+      // only the changed columns are stored if the old version is a full
+      // version and they are small enough
+      Record *new_record =
+          table->create_delta_version(old_record, new_mysql_record, thd_ctx);
+      if (new_record == nullptr) {
+        int status = table->alloc_record(new_record, thd_ctx);
+        if (status != DB20XX_SUCCESS) return status;
+        new_record->load_data_from_mysql(
+            new_mysql_record, schema, table->get_varlen_arena(thd_ctx),
+            table->get_full_payload(old_record, thd_ctx));
+      }
 
       old_record->set_newer_version(new_record);
       new_record->set_older_version(old_record);
@@ -128,16 +199,23 @@ int TransactionContext::mvto_update(Record *old_record, char *new_mysql_record,
   }
 }
 
-int TransactionContext::mvto_read_version_chain(VersionChainHead &vchain_head,
+int TransactionContext::mvto_read_version_chain(Table *table,
+                                                VersionChainHead &vchain_head,
                                                 bool read_own,
                                                 Record *&record) {
+  if (read_only_) {
+    // a read-only transaction can not own versions
+    if (read_own) return DB20XX_FAIL;
+    return mvto_read_vchain_snapshot(vchain_head, record);
+  }
+
   int retry_time = 0;
   int ret = DB20XX_RETRY;
   while (ret == DB20XX_RETRY) {
     if (retry_time != 0)
       std::this_thread::sleep_for(std::chrono::microseconds(10));
     if (read_own) {
-      ret = mvto_read_vchain_own(vchain_head, record);
+      ret = mvto_read_vchain_own(table, vchain_head, record);
     } else {
       ret = mvto_read_vchain_unown(vchain_head, record);
     }
@@ -156,11 +234,24 @@ int TransactionContext::get_transaction_status() {
 }
 
 int TransactionContext::commit() {
-  // TODO: Log Module should persist modify set at this time
+  // Log Module should persist modify set at this time
   // Because once we set begin_ts_, the record is visible to other transaction
-  for (auto record : txn_modify_set_) {
+  if (LogManager::is_enabled() && !read_only_) LogManager::log_commit(this);
+
+  for (auto &modified : txn_modify_set_) {
+    Record *record = modified.first;
     // Update & delete & insert(on exist vchain) operation
     Record *new_version = record->get_newer_version();
+    // a chain gains or loses a row
+    if (new_version != nullptr) {
+      modified.second->add_record_num(
+          (new_version->get_end_timestamp() != MIN_TIMESTAMP) -
+          (record->get_end_timestamp() != MIN_TIMESTAMP));
+    } else if (record->get_begin_timestamp() == MAX_TIMESTAMP &&
+               record->get_end_timestamp() != MIN_TIMESTAMP) {
+      modified.second->add_record_num(1);
+    }
+
     if (new_version != nullptr) {
       if (record->get_end_timestamp() != MIN_TIMESTAMP)
         record->set_end_timestamp(transaction_id_);
@@ -171,17 +262,32 @@ int TransactionContext::commit() {
       new_version->set_begin_timestamp(transaction_id_);
       // TODO: add memory fence (make sure versions in vchain are committed)
       vchain_head->set_latest_record(new_version);
+      // the replaced version is invisible to transactions newer than us
+      retire_record(modified.second, record);
     }
     // Insert(create vchain) operation
     if (record->get_begin_timestamp() == MAX_TIMESTAMP)
       record->set_begin_timestamp(transaction_id_);
 
+    // inserted or updated, then deleted by us: the chain ends with a dead
+    // version, gc removes its keys
+    Record *latest_version = new_version ? new_version : record;
+    if (latest_version->get_end_timestamp() == MIN_TIMESTAMP &&
+        !latest_version->is_delete_marker())
+      retire_record(modified.second, latest_version);
+    // read-only transactions newer than us read it from column blocks
+    if (modified.second->is_columnar())
+      modified.second->store_columns(latest_version, column_payload_);
+
     // TODO: add memory fence
     // release txn_id_ without lock is safe, because there is only one owner.
     record->set_transaction_id(INVALID_TRANSACTION_ID);
     if (new_version) new_version->set_transaction_id(INVALID_TRANSACTION_ID);
   }
 
+  for (Table *table : txn_tables_) table->unregister_writer(transaction_id_);
+  if (!txn_modify_set_.empty()) last_commit_id_ = transaction_id_;
+
   // then reset status
   LOG_TRACE("Transaction:%lu commit", transaction_id_);
   reset();
@@ -191,18 +297,22 @@ int TransactionContext::commit() {
 void TransactionContext::set_abort() { should_abort_ = true; }
 
 void TransactionContext::abort() {
-  for (auto record : txn_modify_set_) {
+  for (auto &modified : txn_modify_set_) {
+    Record *record = modified.first;
     Record *new_version = record->get_newer_version();
     if (new_version != nullptr) {
-      Record *new_version = record->get_newer_version();
       new_version->set_end_timestamp(MIN_TIMESTAMP);
       record->set_newer_version(nullptr);
+      // nobody except us has ever seen the aborted version
+      retire_record(modified.second, new_version);
     }
 
     // insert(create new vchain)
     if (record->get_begin_timestamp() == MAX_TIMESTAMP) {
       record->set_begin_timestamp(MIN_TIMESTAMP);
       record->set_end_timestamp(MIN_TIMESTAMP);
+      // the chain stays, gc removes its keys
+      retire_record(modified.second, record);
     }
 
     // TODO: add memory fence
@@ -210,6 +320,9 @@ void TransactionContext::abort() {
     if (new_version) new_version->set_transaction_id(INVALID_TRANSACTION_ID);
   }
 
+  for (Table *table : txn_tables_)
+    table->unregister_writer(INVALID_TRANSACTION_ID);
+
   LOG_TRACE("Transaction:%lu abort", transaction_id_);
   reset();
 }
@@ -295,10 +408,45 @@ int TransactionContext::mvto_read_vchain_unown(VersionChainHead &vchain_head,
   return DB20XX_INVISIBLE_VERSION;
 }
 
-int TransactionContext::mvto_read_vchain_own(VersionChainHead &vchain_head,
+/**
+ *@brief
+ *  Every transaction older than the snapshot has finished, and none of the
+ *  newer ones is visible, so a version can be checked without the latch:
+ *  skip versions which are uncommitted or committed after the snapshot, the
+ *  first older one is the visible version, its end_ts_ is either MAX or set
+ *  by a transaction newer than the snapshot.
+ */
+int TransactionContext::mvto_read_vchain_snapshot(
+    VersionChainHead &vchain_head, Record *&record) {
+  Record *version_iter = vchain_head.latest_record_;
+  while (version_iter != nullptr) {
+    if (transaction_id_ < version_iter->header_.begin_ts_) {
+      version_iter = version_iter->header_.older_version_;
+      continue;
+    }
+
+    record = version_iter;
+    if (version_iter->header_.end_ts_ == MIN_TIMESTAMP)
+      return DB20XX_DELETED_VERSION;
+    return DB20XX_SUCCESS;
+  }
+
+  return DB20XX_INVISIBLE_VERSION;
+}
+
+int TransactionContext::mvto_read_vchain_own(Table *table,
+                                             VersionChainHead &vchain_head,
                                              Record *&record) {
   Record *version_iter = vchain_head.latest_record_;
+  // a slot skipped by recovery, it never held a version
+  if (version_iter == nullptr) return DB20XX_INVISIBLE_VERSION;
   version_iter->lock_header();
+  // gc has sealed the dead chain
+  if (version_iter->get_transaction_id() == DEAD_TRANSACTION_ID) {
+    version_iter->unlock_header();
+    record = version_iter;
+    return DB20XX_DELETED_VERSION;
+  }
   // a commited version, but not visible
   if (version_iter->get_transaction_id() != INVALID_TRANSACTION_ID) {
     if (version_iter->get_transaction_id() < transaction_id_) {
@@ -336,7 +484,8 @@ int TransactionContext::mvto_read_vchain_own(VersionChainHead &vchain_head,
     // a deleted version
     LOG_DEBUG("Latest version is a delete version, cannot own");
     version_iter->unlock_header();
-    return DB20XX_ABORT;
+    record = version_iter;
+    return DB20XX_DELETED_VERSION;
   } else if (version_iter->get_end_timestamp() < transaction_id_) {
     // not the latest version anymore
     LOG_DEBUG(
@@ -357,7 +506,7 @@ int TransactionContext::mvto_read_vchain_own(VersionChainHead &vchain_head,
       update_last_read_ts_if_need(version_iter);
       version_iter->unlock_header();
       record = version_iter;
-      add_to_modify_set(record);
+      add_to_modify_set(record, table);
       return DB20XX_SUCCESS;
     }
     // latest version, but not free
@@ -382,13 +531,34 @@ void TransactionContext::reset() {
   transaction_id_ = INVALID_TRANSACTION_ID;
   epoch_id_ = 0;
   thread_id_ = 0;
+  read_only_ = false;
   started_ = false;
   should_abort_ = false;
   txn_modify_set_.clear();
+  txn_tables_.clear();
+  GlocalEpochManager::exit_epoch(&local_epoch_);
 }
 
-void TransactionContext::add_to_modify_set(Record *record) {
-  txn_modify_set_.insert(record);
+void TransactionContext::add_to_modify_set(Record *record, Table *table) {
+  txn_modify_set_.emplace(record, table);
+  if (std::find(txn_tables_.begin(), txn_tables_.end(), table) ==
+      txn_tables_.end()) {
+    txn_tables_.push_back(table);
+    table->register_writer();
+  }
+}
+
+/**
+ *@brief
+ *  hand a version that is no longer reachable by new transactions over to
+ *  the garbage collector, it will be reclaimed once all transactions older
+ *  than us have finished.
+ */
+void TransactionContext::retire_record(Table *table, Record *record) {
+  table->add_deleted_version_num(1);
+  retired_records_latch_.lock();
+  retired_records_.push_back({table, record, transaction_id_});
+  retired_records_latch_.unlock();
 }
 
 }  // namespace db20xx
@@ -0,0 +1,53 @@
+#include "varlen_arena.h"
+#include <cstdlib>
+#include <new>
+
+namespace db20xx {
+
+VarlenArena::~VarlenArena() {
+  if (current_chunk_ != nullptr) release_chunk(current_chunk_);
+}
+
+char *VarlenArena::alloc(uint32_t length, uint32_t align) {
+  if (length > LARGE_VALUE_LENGTH) {
+    Chunk *chunk = new_chunk(length, 1);
+    chunk->used_ = length;
+    return chunk->data_;
+  }
+
+  Chunk *chunk = current_chunk_;
+  // capacity of a chunk is a multiple of 8, aligning never overflows it
+  if (chunk != nullptr)
+    chunk->used_ = (chunk->used_ + align - 1) & ~(align - 1);
+  if (chunk == nullptr || chunk->capacity_ - chunk->used_ < length) {
+    // the arena drops its reference to the full chunk
+    if (chunk != nullptr) release_chunk(chunk);
+    chunk = new_chunk(CHUNK_SIZE - sizeof(Chunk), 1);
+    current_chunk_ = chunk;
+  }
+  char *data = chunk->data_ + chunk->used_;
+  chunk->used_ += length;
+  chunk->ref_count_.fetch_add(1, std::memory_order_relaxed);
+  return data;
+}
+
+VarlenArena::Chunk *VarlenArena::new_chunk(uint32_t capacity,
+                                           uint32_t ref_count) {
+  void *chunk_mem = nullptr;
+  if (posix_memalign(&chunk_mem, CHUNK_SIZE, sizeof(Chunk) + capacity) != 0) {
+    LOG_ERROR("varlen arena: out of memory");
+    abort();
+  }
+  Chunk *chunk = reinterpret_cast<Chunk *>(chunk_mem);
+  new (&chunk->ref_count_) std::atomic<uint32_t>(ref_count);
+  chunk->used_ = 0;
+  chunk->capacity_ = capacity;
+  return chunk;
+}
+
+void VarlenArena::release_chunk(Chunk *chunk) {
+  if (chunk->ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    free(chunk);
+}
+
+}  // namespace db20xx